@@ -0,0 +1,25 @@
+QT += core
+QT -= gui
+
+TARGET = boxScalerCheck
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += /usr/include
+INCLUDEPATH += ../../src
+
+SOURCES += main.cpp \
+    ../../src/boxScaler.cpp \
+    ../../src/statistics.cpp
+
+HEADERS += \
+    ../../src/boxScaler.h \
+    ../../src/statistics.h \
+    ../../src/common.h
+
+QMAKE_CXXFLAGS += -std=c++11
+
+LIBS +=  -L/usr/lib
+LIBS +=  -lavutil -lswscale -lm
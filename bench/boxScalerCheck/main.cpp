@@ -0,0 +1,218 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "statistics.h"
+#include "boxScaler.h"
+
+/*
+ * Checks integer ratio box scaler against its plain C kernels and swscale
+ * For every source size and ratio 2, 3, 4:
+ *  - selected (SIMD) kernels must match C kernels bit for bit on random planes,
+ *  - PSNR of box output against sws_scale output (SWS_FAST_BILINEAR, the path VideoScaler falls back to)
+ *    is reported on a smooth test picture, where filters can be compared meaningfully,
+ *  - time per frame of selected kernels, C kernels and sws_scale is reported.
+ * Exit code is non-zero if any output differs from C kernels.
+*/
+
+#define CHECK_ITERATIONS 200
+
+static const int s_sizes[][2] = {{1920, 1080}, {1280, 720}, {704, 576}, {1366, 768}, {642, 482}};
+
+static AVFrame* AllocFrame(int width, int height)
+{
+    AVFrame* pFrame = av_frame_alloc();
+
+    pFrame->format = AV_PIX_FMT_YUV420P;
+    pFrame->width = width;
+    pFrame->height = height;
+    av_frame_get_buffer(pFrame, 32);
+    return pFrame;
+}
+
+static void FillRandom(AVFrame* pFrame)
+{
+    for (int plane = 0; plane < 3; plane++)
+    {
+        int height = (plane == 0) ? pFrame->height : pFrame->height / 2;
+
+        for (int i = 0; i < pFrame->linesize[plane] * height; i++)
+        {
+            pFrame->data[plane][i] = (uint8_t)rand();
+        }
+    }
+}
+
+// Gradients with soft edges and a little noise, roughly what camera pictures look like
+static void FillPicture(AVFrame* pFrame)
+{
+    for (int plane = 0; plane < 3; plane++)
+    {
+        int shift = (plane == 0) ? 0 : 1;
+        int width = pFrame->width >> shift;
+        int height = pFrame->height >> shift;
+
+        for (int y = 0; y < height; y++)
+        {
+            uint8_t* pRow = pFrame->data[plane] + y * pFrame->linesize[plane];
+
+            for (int x = 0; x < width; x++)
+            {
+                double v = 128.0 + 60.0 * sin((x << shift) / 37.0 + plane) * cos((y << shift) / 23.0) + (rand() % 9 - 4);
+                pRow[x] = (uint8_t)av_clip((int)v, 16, 235);
+            }
+        }
+    }
+}
+
+static bool SameFrames(const AVFrame* pA, const AVFrame* pB)
+{
+    for (int plane = 0; plane < 3; plane++)
+    {
+        int shift = (plane == 0) ? 0 : 1;
+
+        for (int y = 0; y < (pA->height >> shift); y++)
+        {
+            if (memcmp(pA->data[plane] + y * pA->linesize[plane], pB->data[plane] + y * pB->linesize[plane], pA->width >> shift))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static double LumaPsnr(const AVFrame* pA, const AVFrame* pB)
+{
+    double  sse = 0.0;
+
+    for (int y = 0; y < pA->height; y++)
+    {
+        for (int x = 0; x < pA->width; x++)
+        {
+            int d = pA->data[0][y * pA->linesize[0] + x] - pB->data[0][y * pB->linesize[0] + x];
+            sse += d * d;
+        }
+    }
+    if (sse == 0.0)
+    {
+        return 99.0;
+    }
+    return 10.0 * log10(255.0 * 255.0 * pA->width * pA->height / sse);
+}
+
+// swscale gets the same cropped source area box scaler uses, so both outputs cover the same picture
+static void SwsScaleCropped(SwsContext* pContext, const AVFrame* pInFrame, AVFrame* pOutFrame, int ratio)
+{
+    int             cropX = ((pInFrame->width - pOutFrame->width * ratio) >> 1) & ~1;
+    int             cropY = ((pInFrame->height - pOutFrame->height * ratio) >> 1) & ~1;
+    const uint8_t*  src[3];
+
+    for (int plane = 0; plane < 3; plane++)
+    {
+        int shift = (plane == 0) ? 0 : 1;
+        src[plane] = pInFrame->data[plane] + (cropY >> shift) * pInFrame->linesize[plane] + (cropX >> shift);
+    }
+    sws_scale(pContext, src, pInFrame->linesize, 0, pOutFrame->height * ratio, pOutFrame->data, pOutFrame->linesize);
+}
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    int failures = 0;
+
+    printf("Box scaler kernels: %s\n", BoxScaleImplementation());
+    printf("%-10s %-5s %-8s %-10s %-12s %-12s %-12s\n", "source", "ratio", "bitexact", "psnr Y dB", "selected ms", "c ms", "swscale ms");
+
+    for (unsigned s = 0; s < sizeof(s_sizes) / sizeof(s_sizes[0]); s++)
+    {
+        for (int ratio = 2; ratio <= 4; ratio++)
+        {
+            int         width = s_sizes[s][0];
+            int         height = s_sizes[s][1];
+            int         outWidth = (width / ratio) & ~3;
+            int         outHeight = (height / ratio) & ~3;
+            AVFrame*    pIn = AllocFrame(width, height);
+            AVFrame*    pOut = AllocFrame(outWidth, outHeight);
+            AVFrame*    pRef = AllocFrame(outWidth, outHeight);
+            SwsContext* pContext = sws_getContext(outWidth * ratio, outHeight * ratio, AV_PIX_FMT_YUV420P,
+                                                  outWidth, outHeight, AV_PIX_FMT_YUV420P,
+                                                  SWS_FAST_BILINEAR, NULL, NULL, NULL);
+
+            if (BoxScaleRatio(pIn, pOut) != ratio)
+            {
+                printf("%dx%d -> %dx%d is not taken by box scaler\n", width, height, outWidth, outHeight);
+                failures++;
+                sws_freeContext(pContext);
+                av_frame_free(&pIn);
+                av_frame_free(&pOut);
+                av_frame_free(&pRef);
+                continue;
+            }
+
+            // Bit exactness on random planes, where every rounding difference shows up
+            bool exact = true;
+
+            for (int i = 0; i < 10; i++)
+            {
+                FillRandom(pIn);
+                BoxScaleFrame(pIn, pOut, ratio);
+                BoxScaleFrameC(pIn, pRef, ratio);
+                exact = exact && SameFrames(pOut, pRef);
+            }
+            failures += exact ? 0 : 1;
+
+            // Quality against swscale on a picture
+            FillPicture(pIn);
+            BoxScaleFrame(pIn, pOut, ratio);
+            SwsScaleCropped(pContext, pIn, pRef, ratio);
+
+            double psnr = LumaPsnr(pOut, pRef);
+
+            // Speed
+            int64_t startUs = MonotonicTimeUs();
+            for (int i = 0; i < CHECK_ITERATIONS; i++)
+            {
+                BoxScaleFrame(pIn, pOut, ratio);
+            }
+            int64_t selectedUs = MonotonicTimeUs() - startUs;
+
+            startUs = MonotonicTimeUs();
+            for (int i = 0; i < CHECK_ITERATIONS; i++)
+            {
+                BoxScaleFrameC(pIn, pOut, ratio);
+            }
+            int64_t cUs = MonotonicTimeUs() - startUs;
+
+            startUs = MonotonicTimeUs();
+            for (int i = 0; i < CHECK_ITERATIONS; i++)
+            {
+                SwsScaleCropped(pContext, pIn, pRef, ratio);
+            }
+            int64_t swsUs = MonotonicTimeUs() - startUs;
+
+            char source[32];
+            snprintf(source, sizeof(source), "%dx%d", width, height);
+            printf("%-10s 1/%-3d %-8s %-10.2f %-12.3f %-12.3f %-12.3f\n",
+                   source,
+                   ratio,
+                   exact ? "yes" : "NO",
+                   psnr,
+                   selectedUs / 1000.0 / CHECK_ITERATIONS,
+                   cUs / 1000.0 / CHECK_ITERATIONS,
+                   swsUs / 1000.0 / CHECK_ITERATIONS);
+
+            sws_freeContext(pContext);
+            av_frame_free(&pIn);
+            av_frame_free(&pOut);
+            av_frame_free(&pRef);
+        }
+    }
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
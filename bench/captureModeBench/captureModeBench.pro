@@ -0,0 +1,54 @@
+QT += core
+QT -= gui
+
+TARGET = captureModeBench
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += /usr/include
+INCLUDEPATH += ../../src
+
+SOURCES += main.cpp \
+    ../../src/errorHandler.cpp \
+    ../../src/stream.cpp \
+    ../../src/frameBuffer.cpp \
+    ../../src/framePool.cpp \
+    ../../src/packetQueue.cpp \
+    ../../src/decoderPool.cpp \
+    ../../src/canvas.cpp \
+    ../../src/overlay.cpp \
+    ../../src/layout.cpp \
+    ../../src/font.cpp \
+    ../../src/planeKernels.cpp \
+    ../../src/videoScaler.cpp \
+    ../../src/boxScaler.cpp \
+    ../../src/videoEncoder.cpp \
+    ../../src/presetGovernor.cpp \
+    ../../src/statistics.cpp
+
+HEADERS += \
+    ../../src/errorHandler.h \
+    ../../src/stream.h \
+    ../../src/frameBuffer.h \
+    ../../src/framePool.h \
+    ../../src/packetQueue.h \
+    ../../src/decoderPool.h \
+    ../../src/canvas.h \
+    ../../src/overlay.h \
+    ../../src/layout.h \
+    ../../src/font.h \
+    ../../src/planeKernels.h \
+    ../../src/videoScaler.h \
+    ../../src/boxScaler.h \
+    ../../src/videoEncoder.h \
+    ../../src/presetGovernor.h \
+    ../../src/spscQueue.h \
+    ../../src/statistics.h \
+    ../../src/common.h
+
+QMAKE_CXXFLAGS += -std=c++11
+
+LIBS +=  -L/usr/lib
+LIBS +=  -lavformat -lavcodec -lavutil -lswscale -lx264 -lm -lz
@@ -0,0 +1,407 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <QCoreApplication>
+#include <QThreadPool>
+#include <QVector>
+
+#include "common.h"
+#include "statistics.h"
+#include "stream.h"
+#include "frameBuffer.h"
+#include "videoEncoder.h"
+
+/*
+ * Capture modes compared on the same live inputs: timer polling against blocking reads
+ * A short H.264 clip is encoded once, then every camera gets its own feeder thread which serves the clip
+ * as MPEG-TS on a local TCP port in real time. Streams connect to those ports like to any camera and
+ * deliver frames into a FrameBuffer, exactly as in the service.
+ * Each clip frame shows its index as black and white bars, so the frame seen in a FrameBuffer tells
+ * which packet it came from. Capture latency is the time from the packet being written to the socket
+ * until the frame is in the FrameBuffer, so polling delay of the timer mode is included.
+ * Cpu per camera is process cpu time without the feeder and polling threads of the bench itself.
+ * Usage: captureModeBench [cameras, 16] [seconds per run, 30] [capture threads in timer mode, 0 - one per core]
+ *                         [width, 1280] [height, 720] [fps, 25]
+*/
+
+#define BENCH_CLIP_FRAMES   250         // Frame index fits into the bars, clip loops after this many frames
+#define BENCH_INDEX_BITS    8
+#define BENCH_TILE_WIDTH    320         // FrameBuffer frame size, like a 4x4 wall tile at 720p
+#define BENCH_TILE_HEIGHT   180
+#define BENCH_POLL_US       250         // FrameBuffer polling period, latency resolution
+#define BENCH_WARMUP_US     2000000     // Frames seen before this are not counted, streams are still connecting
+#define BENCH_BASE_PORT     23400
+
+static int64_t ProcessCpuTimeUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/// Frame index as bars across the top half, moving pattern below so decoding costs something
+static void DrawClipFrame(AVFrame* pFrame, int index)
+{
+    for (int y = 0; y < pFrame->height; y++)
+    {
+        uint8_t* pRow = pFrame->data[0] + y * pFrame->linesize[0];
+
+        for (int x = 0; x < pFrame->width; x++)
+        {
+            if (y < pFrame->height / 2)
+            {
+                int bit = x * BENCH_INDEX_BITS / pFrame->width;
+                pRow[x] = ((index >> bit) & 1) ? 235 : 16;
+            }
+            else
+            {
+                pRow[x] = (uint8_t)(16 + ((x + y * 3 + index * 8) & 127) + (rand() & 15));
+            }
+        }
+    }
+    for (int plane = 1; plane < 3; plane++)
+    {
+        memset(pFrame->data[plane], 128, pFrame->linesize[plane] * (pFrame->height >> 1));
+    }
+}
+
+/// Reads the bars back from a scaled frame
+static int ReadFrameIndex(const AVFrame* pFrame)
+{
+    int         index = 0;
+    const uint8_t* pRow = pFrame->data[0] + (pFrame->height / 4) * pFrame->linesize[0];
+
+    for (int bit = 0; bit < BENCH_INDEX_BITS; bit++)
+    {
+        int x = (2 * bit + 1) * pFrame->width / (2 * BENCH_INDEX_BITS);
+        index |= (pRow[x] > 128) ? (1 << bit) : 0;
+    }
+    return index;
+}
+
+struct Clip
+{
+    Clip() : pParams(NULL), fps(25) {}
+    ~Clip()
+    {
+        for (int i = 0; i < packets.size(); i++)
+        {
+            av_packet_free(&packets[i]);
+        }
+        avcodec_parameters_free(&pParams);
+    }
+
+    QVector<AVPacket*>  packets;    /// One per frame, encoder has no delay with zerolatency tune
+    AVCodecParameters*  pParams;
+    int                 fps;
+};
+
+static bool EncodeClip(Clip* pClip, int width, int height, int fps)
+{
+    EncoderParameters params;
+
+    memset(&params, 0, sizeof(params));
+    params.width = width;
+    params.height = height;
+    params.fps = fps;
+    params.crf = 23;
+    params.codec = ENCODER_CODEC_H264;
+    params.queueDepth = 0;
+    params.queuePolicy = ENCODER_QUEUE_DROP_OLDEST;
+    params.slicedThreads = true;
+    params.lookahead = -1;
+    params.preset = PresetGovernor::PresetIndex("veryfast");
+    params.slowestPreset = params.preset;
+
+    VideoEncoder    encoder(params);
+    AVFrame*        pFrame = av_frame_alloc();
+
+    QObject::connect(&encoder, &VideoEncoder::NewParameters, [pClip](AVCodecParameters* pParams)
+    {
+        pClip->pParams = avcodec_parameters_alloc();
+        avcodec_parameters_copy(pClip->pParams, pParams);
+    });
+    QObject::connect(&encoder, &VideoEncoder::PacketReady, [pClip](QSharedPointer<AVPacket> pPacket)
+    {
+        pClip->packets.append(av_packet_clone(pPacket.data()));
+    });
+
+    pFrame->format = AV_PIX_FMT_YUV420P;
+    pFrame->width = width;
+    pFrame->height = height;
+    av_frame_get_buffer(pFrame, 32);
+
+    encoder.Initialize();
+    for (int i = 0; i < BENCH_CLIP_FRAMES; i++)
+    {
+        DrawClipFrame(pFrame, i);
+        pFrame->pts = i;
+        encoder.EncodeFrame(QSharedPointer<AVFrame>(pFrame, [](AVFrame*){}));
+    }
+    encoder.Flush();
+    av_frame_free(&pFrame);
+
+    pClip->fps = fps;
+    return (NULL != pClip->pParams) && (BENCH_CLIP_FRAMES == pClip->packets.size());
+}
+
+/// Serves the clip on one TCP port as a live camera would
+class FeederThread : public QThread
+{
+public:
+    FeederThread(const Clip* pClip, int port) : QThread(NULL), m_pClip(pClip), m_port(port), m_stop(0), m_cpuUs(0)
+    {
+        for (int i = 0; i < BENCH_CLIP_FRAMES; i++)
+        {
+            m_sendUs[i].store(0);
+        }
+    }
+
+    QString Url() const { return QString("tcp://127.0.0.1:%1").arg(m_port); }
+    void    RequestStop() { m_stop.storeRelease(1); }
+    int64_t SendUs(int index) const { return m_sendUs[index % BENCH_CLIP_FRAMES].loadAcquire(); }
+    int64_t CpuUs() const { return m_cpuUs.loadAcquire(); }
+
+protected:
+    void run()
+    {
+        QByteArray          url = (Url() + "?listen=1&listen_timeout=10000").toLatin1();
+        AVFormatContext*    pContext = NULL;
+
+        avformat_alloc_output_context2(&pContext, NULL, "mpegts", url.constData());
+
+        AVStream* pStream = avformat_new_stream(pContext, NULL);
+        avcodec_parameters_copy(pStream->codecpar, m_pClip->pParams);
+        pStream->time_base = av_make_q(1, m_pClip->fps);
+
+        // Waits for the stream to connect, packets are flushed to the socket one by one
+        pContext->flags |= AVFMT_FLAG_FLUSH_PACKETS;
+        if ((0 > avio_open2(&pContext->pb, url.constData(), AVIO_FLAG_WRITE, NULL, NULL)) ||
+            (0 > avformat_write_header(pContext, NULL)))
+        {
+            avformat_free_context(pContext);
+            return;
+        }
+
+        int64_t periodUs = 1000000 / m_pClip->fps;
+        int64_t startUs = MonotonicTimeUs();
+
+        for (int64_t seq = 0; !m_stop.loadAcquire(); seq++)
+        {
+            int         index = (int)(seq % BENCH_CLIP_FRAMES);
+            AVPacket*   pPacket = av_packet_clone(m_pClip->packets[index]);
+
+            SleepUntilUs(startUs + seq * periodUs);
+
+            int64_t cpuStartUs = ThreadCpuTimeUs();
+
+            pPacket->stream_index = 0;
+            pPacket->pts = seq;
+            pPacket->dts = seq;
+            pPacket->duration = 1;
+            av_packet_rescale_ts(pPacket, av_make_q(1, m_pClip->fps), pStream->time_base);
+
+            int res = av_write_frame(pContext, pPacket);
+            m_sendUs[index].storeRelease(MonotonicTimeUs());
+            av_packet_free(&pPacket);
+            m_cpuUs.fetchAndAddOrdered(ThreadCpuTimeUs() - cpuStartUs);
+
+            // Stream went away
+            if (0 > res)
+            {
+                break;
+            }
+        }
+
+        av_write_trailer(pContext);
+        avio_closep(&pContext->pb);
+        avformat_free_context(pContext);
+    }
+
+private:
+    const Clip*             m_pClip;
+    int                     m_port;
+    QAtomicInt              m_stop;
+    QAtomicInteger<qint64>  m_sendUs[BENCH_CLIP_FRAMES];   /// Time each clip frame was last written to the socket
+    QAtomicInteger<qint64>  m_cpuUs;
+};
+
+static void RunBench(const Clip& clip, CaptureMode mode, int numCameras, int seconds, int captureThreads, int port)
+{
+    QThreadPool*            pConnectPool = (CAPTURE_MODE_TIMER == mode) ? new QThreadPool() : NULL;
+    QVector<FeederThread*>  feeders;
+    QVector<Stream*>        streams;
+    QVector<FrameBuffer*>   buffers;
+    QVector<QThread*>       threads;
+    StreamParameters        params;
+
+    params.captureMode = mode;
+    params.decodePolicy = DECODE_POLICY_FULL;
+    params.outputFps = clip.fps;
+
+    for (int i = 0; i < numCameras; i++)
+    {
+        feeders.append(new FeederThread(&clip, port + i));
+        feeders[i]->start();
+    }
+
+    // Same thread distribution as Kvadrator::Initialize()
+    int numThreads = numCameras;
+
+    if (CAPTURE_MODE_TIMER == mode)
+    {
+        numThreads = (captureThreads > 0) ? captureThreads : QThread::idealThreadCount();
+        numThreads = FFMAX(1, FFMIN(numThreads, numCameras));
+        pConnectPool->setMaxThreadCount(numCameras);
+    }
+    for (int i = 0; i < numThreads; i++)
+    {
+        threads.append(new QThread());
+    }
+    for (int i = 0; i < numCameras; i++)
+    {
+        streams.append(new Stream(QString("cam%1").arg(i), feeders[i]->Url(), params, NULL, pConnectPool));
+        buffers.append(new FrameBuffer(1));
+        streams[i]->AddFrameBuffer(buffers[i], BENCH_TILE_WIDTH, BENCH_TILE_HEIGHT);
+
+        QObject::connect(threads[i % numThreads], SIGNAL(started()), streams[i], SLOT(StartCapture()));
+        streams[i]->moveToThread(threads[i % numThreads]);
+    }
+
+    int64_t     startUs = MonotonicTimeUs();
+    for (int i = 0; i < numThreads; i++)
+    {
+        threads[i]->start();
+    }
+
+    // Frames are picked up from the buffers the way builder does, only much more often
+    QVector<const AVFrame*> lastFrames(numCameras, NULL);
+    RunningStat             latencyStat;
+    int64_t                 unknownFrames = 0;
+    int64_t                 endUs = startUs + BENCH_WARMUP_US + (int64_t)seconds * 1000000;
+    int64_t                 cpuStartUs = 0;
+    int64_t                 pollCpuUs = 0;
+    int64_t                 feederCpuStartUs = 0;
+    bool                    warm = false;
+
+    for (int64_t nowUs = MonotonicTimeUs(); nowUs < endUs; nowUs = MonotonicTimeUs())
+    {
+        if (!warm && (nowUs - startUs >= BENCH_WARMUP_US))
+        {
+            warm = true;
+            cpuStartUs = ProcessCpuTimeUs();
+            pollCpuUs = -ThreadCpuTimeUs();
+            for (int i = 0; i < numCameras; i++)
+            {
+                feederCpuStartUs += feeders[i]->CpuUs();
+            }
+        }
+
+        for (int i = 0; i < numCameras; i++)
+        {
+            QSharedPointer<AVFrame> pFrame = buffers[i]->GetFrame(nowUs);
+
+            if (pFrame.isNull() || (pFrame.data() == lastFrames[i]))
+            {
+                continue;
+            }
+            lastFrames[i] = pFrame.data();
+
+            int64_t sendUs = feeders[i]->SendUs(ReadFrameIndex(pFrame.data()));
+            if (!warm)
+            {
+                continue;
+            }
+            // Index from a previous loop of the clip means the bars were misread
+            if ((0 == sendUs) || (nowUs - sendUs > 1000000))
+            {
+                unknownFrames++;
+                continue;
+            }
+            latencyStat.Add(nowUs - sendUs);
+        }
+        SleepUntilUs(nowUs + BENCH_POLL_US);
+    }
+
+    int64_t cpuUs = ProcessCpuTimeUs() - cpuStartUs;
+    int64_t feederCpuUs = -feederCpuStartUs;
+
+    pollCpuUs += ThreadCpuTimeUs();
+    for (int i = 0; i < numCameras; i++)
+    {
+        feederCpuUs += feeders[i]->CpuUs();
+    }
+
+    // Same shutdown order as Kvadrator::StopAll()
+    for (int i = 0; i < numCameras; i++)
+    {
+        streams[i]->RequestStop();
+        QMetaObject::invokeMethod(streams[i], "StopCapture", Qt::QueuedConnection);
+    }
+    for (int i = 0; i < numThreads; i++)
+    {
+        threads[i]->quit();
+        threads[i]->wait();
+    }
+    if (NULL != pConnectPool)
+    {
+        pConnectPool->waitForDone();
+    }
+    for (int i = 0; i < numCameras; i++)
+    {
+        delete streams[i];
+        feeders[i]->RequestStop();
+        feeders[i]->wait();
+        delete feeders[i];
+        delete buffers[i];
+    }
+    for (int i = 0; i < numThreads; i++)
+    {
+        delete threads[i];
+    }
+    delete pConnectPool;
+
+    int64_t captureCpuUs = cpuUs - pollCpuUs - feederCpuUs;
+
+    printf("%-9s %-8d %-8d %-10lld %-12.2f %-12.2f %-12.2f %-10lld\n",
+           (CAPTURE_MODE_TIMER == mode) ? "timer" : "blocking",
+           numCameras,
+           numThreads,
+           (long long)latencyStat.Count(),
+           100.0 * captureCpuUs / ((int64_t)seconds * 1000000) / numCameras,
+           latencyStat.Average() / 1000.0,
+           latencyStat.Max() / 1000.0,
+           (long long)unknownFrames);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    int numCameras = (argc > 1) ? atoi(argv[1]) : 16;
+    int seconds = (argc > 2) ? atoi(argv[2]) : 30;
+    int captureThreads = (argc > 3) ? atoi(argv[3]) : 0;
+    int width = (argc > 4) ? atoi(argv[4]) : 1280;
+    int height = (argc > 5) ? atoi(argv[5]) : 720;
+    int fps = (argc > 6) ? atoi(argv[6]) : 25;
+
+    Clip clip;
+
+    if (!EncodeClip(&clip, width, height, fps))
+    {
+        printf("Failed to encode test clip\n");
+        return 1;
+    }
+
+    printf("%d cameras %dx%d at %d fps over local TCP, %d s per run, %d cpu cores\n",
+           numCameras, width, height, fps, seconds, QThread::idealThreadCount());
+    printf("%-9s %-8s %-8s %-10s %-12s %-12s %-12s %-10s\n",
+           "mode", "cameras", "threads", "frames", "cpu %/cam", "lat avg ms", "lat max ms", "misread");
+
+    // Ports differ between runs, so listening sockets of the first run do not get in the way
+    RunBench(clip, CAPTURE_MODE_TIMER, numCameras, seconds, captureThreads, BENCH_BASE_PORT);
+    RunBench(clip, CAPTURE_MODE_BLOCKING, numCameras, seconds, captureThreads, BENCH_BASE_PORT + numCameras);
+
+    return 0;
+}
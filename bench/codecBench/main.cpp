@@ -0,0 +1,475 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <QCoreApplication>
+#include <QMap>
+#include <QVector>
+
+#include "common.h"
+#include "statistics.h"
+#include "videoEncoder.h"
+
+/*
+ * Same clip through libx264, libx265 and AV1 at several crf values
+ * Every run decodes the recording again and feeds the same frames through VideoEncoder, synchronously.
+ * Packets are decoded back and compared with the frames that went in: global PSNR of luma and of all planes,
+ * and luma SSIM over 8x8 windows every 4 pixels. Encode time is EncodeFrame() duration per frame.
+ * Equal crf is meant to give about equal quality on every codec, AV1 gets crf * 63 / 51 on its own scale,
+ * so quality columns of one crf should line up and bitrate shows what each codec pays for it.
+ * Usage: codecBench <clip> [crf list, 23,28,33] [preset, veryfast] [frames, 250, 0 - whole file] [codecs, h264,hevc,av1]
+*/
+
+#define BENCH_MAX_CODECS    3
+
+struct RunResult
+{
+    RunResult() : frames(0), decoded(0), packets(0), bytes(0), fps(0), lumaSse(0), planesSse(0),
+                  lumaSamples(0), planesSamples(0), ssimSum(0.0), ssimWindows(0) {}
+
+    int64_t     frames;
+    int64_t     decoded;            /// Frames decoded back and compared
+    int64_t     packets;
+    int64_t     bytes;
+    int         fps;
+    RunningStat encodeTimeStat;     /// EncodeFrame() duration, us
+    int64_t     lumaSse;
+    int64_t     planesSse;
+    int64_t     lumaSamples;
+    int64_t     planesSamples;
+    double      ssimSum;
+    int64_t     ssimWindows;
+
+    double LumaPsnr() const { return Psnr(lumaSse, lumaSamples); }
+    double PlanesPsnr() const { return Psnr(planesSse, planesSamples); }
+    double Ssim() const { return ssimWindows ? ssimSum / ssimWindows : 0.0; }
+
+    static double Psnr(int64_t sse, int64_t samples)
+    {
+        return (0 == samples) ? 0.0 : (0 == sse) ? 100.0 : 10.0 * log10(255.0 * 255.0 * samples / sse);
+    }
+};
+
+/// Decodes recording into YUV420P frames of its own size
+class Replay
+{
+public:
+    Replay() : m_pFormat(NULL), m_pDecoder(NULL), m_pScaler(NULL), m_pPacket(NULL), m_pDecoded(NULL), m_streamIndex(-1), m_eof(false) {}
+    ~Replay() { Close(); }
+
+    bool Open(const char* pPath)
+    {
+        if ((0 > avformat_open_input(&m_pFormat, pPath, NULL, NULL)) || (0 > avformat_find_stream_info(m_pFormat, NULL)))
+        {
+            return false;
+        }
+        m_streamIndex = av_find_best_stream(m_pFormat, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+        if (0 > m_streamIndex)
+        {
+            return false;
+        }
+
+        AVStream*       pStream = m_pFormat->streams[m_streamIndex];
+        const AVCodec*  pCodec = avcodec_find_decoder(pStream->codecpar->codec_id);
+
+        m_pDecoder = avcodec_alloc_context3(pCodec);
+        avcodec_parameters_to_context(m_pDecoder, pStream->codecpar);
+        if (0 > avcodec_open2(m_pDecoder, pCodec, NULL))
+        {
+            return false;
+        }
+        m_fps = (pStream->avg_frame_rate.num > 0) ? (int)(av_q2d(pStream->avg_frame_rate) + 0.5) : 25;
+        m_pPacket = av_packet_alloc();
+        m_pDecoded = av_frame_alloc();
+        m_eof = false;
+        return true;
+    }
+
+    void Close()
+    {
+        sws_freeContext(m_pScaler);
+        m_pScaler = NULL;
+        av_frame_free(&m_pDecoded);
+        av_packet_free(&m_pPacket);
+        avcodec_free_context(&m_pDecoder);
+        avformat_close_input(&m_pFormat);
+    }
+
+    int Width() const { return m_pDecoder->width & ~1; }
+    int Height() const { return m_pDecoder->height & ~1; }
+    int Fps() const { return m_fps; }
+
+    /// Next picture converted into pFrame. False at end of file
+    bool NextFrame(AVFrame* pFrame)
+    {
+        while (true)
+        {
+            int res = avcodec_receive_frame(m_pDecoder, m_pDecoded);
+
+            if (0 == res)
+            {
+                m_pScaler = sws_getCachedContext(m_pScaler, m_pDecoded->width, m_pDecoded->height, (AVPixelFormat)m_pDecoded->format,
+                                                 pFrame->width, pFrame->height, AV_PIX_FMT_YUV420P, SWS_POINT, NULL, NULL, NULL);
+                sws_scale(m_pScaler, m_pDecoded->data, m_pDecoded->linesize, 0, m_pDecoded->height, pFrame->data, pFrame->linesize);
+                av_frame_unref(m_pDecoded);
+                return true;
+            }
+            if ((AVERROR(EAGAIN) != res) || m_eof)
+            {
+                return false;
+            }
+
+            if (0 > av_read_frame(m_pFormat, m_pPacket))
+            {
+                m_eof = true;
+                avcodec_send_packet(m_pDecoder, NULL);
+                continue;
+            }
+            if (m_pPacket->stream_index == m_streamIndex)
+            {
+                avcodec_send_packet(m_pDecoder, m_pPacket);
+            }
+            av_packet_unref(m_pPacket);
+        }
+    }
+
+private:
+    AVFormatContext*    m_pFormat;
+    AVCodecContext*     m_pDecoder;
+    SwsContext*         m_pScaler;
+    AVPacket*           m_pPacket;
+    AVFrame*            m_pDecoded;
+    int                 m_streamIndex;
+    int                 m_fps;
+    bool                m_eof;
+};
+
+/// Decodes encoder output and compares it with the source frames still waiting for their packets
+class Verifier
+{
+public:
+    Verifier(RunResult* pResult, int fps) : m_pResult(pResult), m_pDecoder(NULL), m_pDecoded(av_frame_alloc()), m_fps(fps) {}
+
+    ~Verifier()
+    {
+        for (QMap<int64_t, AVFrame*>::iterator it = m_sources.begin(); it != m_sources.end(); ++it)
+        {
+            av_frame_free(&it.value());
+        }
+        av_frame_free(&m_pDecoded);
+        avcodec_free_context(&m_pDecoder);
+    }
+
+    bool Open(const AVCodecParameters* pParams)
+    {
+        // Native AV1 decoder of FFmpeg 4 needs hardware, dav1d decodes in software
+        const AVCodec* pCodec = (AV_CODEC_ID_AV1 == pParams->codec_id) ? avcodec_find_decoder_by_name("libdav1d") : NULL;
+
+        pCodec = (NULL != pCodec) ? pCodec : avcodec_find_decoder(pParams->codec_id);
+        avcodec_free_context(&m_pDecoder);
+        m_pDecoder = avcodec_alloc_context3(pCodec);
+        if ((NULL == m_pDecoder) || (0 > avcodec_parameters_to_context(m_pDecoder, pParams)) ||
+            (0 > avcodec_open2(m_pDecoder, pCodec, NULL)))
+        {
+            printf("Failed to open %s decoder\n", avcodec_get_name(pParams->codec_id));
+            avcodec_free_context(&m_pDecoder);
+            return false;
+        }
+        return true;
+    }
+
+    void AddSource(const AVFrame* pFrame)
+    {
+        AVFrame* pCopy = av_frame_alloc();
+
+        pCopy->format = pFrame->format;
+        pCopy->width = pFrame->width;
+        pCopy->height = pFrame->height;
+        av_frame_get_buffer(pCopy, 32);
+        av_frame_copy(pCopy, pFrame);
+        m_sources.insert(pFrame->pts, pCopy);
+    }
+
+    /// NULL packet flushes the decoder
+    void Decode(const AVPacket* pPacket)
+    {
+        if (NULL == m_pDecoder)
+        {
+            return;
+        }
+
+        avcodec_send_packet(m_pDecoder, pPacket);
+        while (0 == avcodec_receive_frame(m_pDecoder, m_pDecoded))
+        {
+            // Packet timestamps come out of VideoEncoder in AV_TIME_BASE units
+            int64_t index = av_rescale_q(m_pDecoded->best_effort_timestamp, AV_TIME_BASE_Q, av_make_q(1, m_fps));
+            AVFrame* pSource = m_sources.take(index);
+
+            if ((NULL != pSource) && (AV_PIX_FMT_YUV420P == m_pDecoded->format) &&
+                (pSource->width == m_pDecoded->width) && (pSource->height == m_pDecoded->height))
+            {
+                Compare(pSource, m_pDecoded);
+                m_pResult->decoded++;
+            }
+            av_frame_free(&pSource);
+            av_frame_unref(m_pDecoded);
+        }
+    }
+
+private:
+    RunResult*                  m_pResult;
+    AVCodecContext*             m_pDecoder;
+    AVFrame*                    m_pDecoded;
+    int                         m_fps;
+    QMap<int64_t, AVFrame*>     m_sources;  /// Keyed on frame index
+
+    void Compare(const AVFrame* pA, const AVFrame* pB)
+    {
+        for (int plane = 0; plane < 3; plane++)
+        {
+            int     shift = (plane == 0) ? 0 : 1;
+            int64_t sse = 0;
+
+            for (int y = 0; y < (pA->height >> shift); y++)
+            {
+                const uint8_t* pRowA = pA->data[plane] + y * pA->linesize[plane];
+                const uint8_t* pRowB = pB->data[plane] + y * pB->linesize[plane];
+
+                for (int x = 0; x < (pA->width >> shift); x++)
+                {
+                    int diff = pRowA[x] - pRowB[x];
+                    sse += diff * diff;
+                }
+            }
+
+            int64_t samples = (int64_t)(pA->width >> shift) * (pA->height >> shift);
+
+            m_pResult->planesSse += sse;
+            m_pResult->planesSamples += samples;
+            if (0 == plane)
+            {
+                m_pResult->lumaSse += sse;
+                m_pResult->lumaSamples += samples;
+            }
+        }
+
+        const double c1 = (0.01 * 255) * (0.01 * 255);
+        const double c2 = (0.03 * 255) * (0.03 * 255);
+
+        for (int y = 0; y + 8 <= pA->height; y += 4)
+        {
+            for (int x = 0; x + 8 <= pA->width; x += 4)
+            {
+                int64_t sumA = 0, sumB = 0, sumAA = 0, sumBB = 0, sumAB = 0;
+
+                for (int row = y; row < y + 8; row++)
+                {
+                    const uint8_t* pRowA = pA->data[0] + row * pA->linesize[0];
+                    const uint8_t* pRowB = pB->data[0] + row * pB->linesize[0];
+
+                    for (int col = x; col < x + 8; col++)
+                    {
+                        sumA += pRowA[col];
+                        sumB += pRowB[col];
+                        sumAA += pRowA[col] * pRowA[col];
+                        sumBB += pRowB[col] * pRowB[col];
+                        sumAB += pRowA[col] * pRowB[col];
+                    }
+                }
+
+                double meanA = sumA / 64.0;
+                double meanB = sumB / 64.0;
+                double varA = sumAA / 64.0 - meanA * meanA;
+                double varB = sumBB / 64.0 - meanB * meanB;
+                double cov = sumAB / 64.0 - meanA * meanB;
+
+                m_pResult->ssimSum += ((2 * meanA * meanB + c1) * (2 * cov + c2)) /
+                                      ((meanA * meanA + meanB * meanB + c1) * (varA + varB + c2));
+                m_pResult->ssimWindows++;
+            }
+        }
+    }
+};
+
+static AVFrame* AllocFrame(int width, int height)
+{
+    AVFrame* pFrame = av_frame_alloc();
+
+    pFrame->format = AV_PIX_FMT_YUV420P;
+    pFrame->width = width;
+    pFrame->height = height;
+    av_frame_get_buffer(pFrame, 32);
+    return pFrame;
+}
+
+static QVector<int> ParseList(const char* pList)
+{
+    QVector<int> values;
+    char*        pEnd = NULL;
+
+    for (const char* pValue = pList; *pValue; pValue = (',' == *pEnd) ? pEnd + 1 : pEnd)
+    {
+        values.append((int)strtol(pValue, &pEnd, 10));
+        if ((pEnd == pValue) || ((',' != *pEnd) && *pEnd))
+        {
+            return QVector<int>();
+        }
+    }
+    return values;
+}
+
+static void DecodePending(Verifier* pVerifier, QVector<QSharedPointer<AVPacket> >* pPending)
+{
+    for (int i = 0; i < pPending->size(); i++)
+    {
+        pVerifier->Decode((*pPending)[i].data());
+    }
+    pPending->clear();
+}
+
+static bool RunClip(const char* pPath, EncoderParameters params, int maxFrames, RunResult* pResult)
+{
+    Replay replay;
+
+    if (!replay.Open(pPath))
+    {
+        printf("Failed to open %s\n", pPath);
+        return false;
+    }
+
+    params.width = replay.Width();
+    params.height = replay.Height();
+    params.fps = replay.Fps();
+    pResult->fps = params.fps;
+
+    VideoEncoder    encoder(params);
+    Verifier        verifier(pResult, params.fps);
+    AVFrame*        pFrame = AllocFrame(params.width, params.height);
+    bool            decoderOpen = false;
+    QVector<QSharedPointer<AVPacket> > pending;
+
+    // Synchronous encoder emits on the caller thread, from inside Initialize(), EncodeFrame() or Flush()
+    QObject::connect(&encoder, &VideoEncoder::NewParameters, [&verifier, &decoderOpen](AVCodecParameters* pParams)
+    {
+        decoderOpen = verifier.Open(pParams);
+    });
+    // Packets are decoded after EncodeFrame() returns, so decoding does not count as encode time
+    QObject::connect(&encoder, &VideoEncoder::PacketReady, [pResult, &pending](QSharedPointer<AVPacket> pPacket)
+    {
+        pResult->packets++;
+        pResult->bytes += pPacket->size;
+        pending.append(pPacket);
+    });
+
+    encoder.Initialize();
+
+    for (int64_t index = 0; ((0 == maxFrames) || (index < maxFrames)) && replay.NextFrame(pFrame); index++)
+    {
+        // Encoder only reads the frame, it is rewritten after the call returns
+        pFrame->pts = index;
+        verifier.AddSource(pFrame);
+
+        int64_t startUs = MonotonicTimeUs();
+        encoder.EncodeFrame(QSharedPointer<AVFrame>(pFrame, [](AVFrame*){}));
+        pResult->encodeTimeStat.Add(MonotonicTimeUs() - startUs);
+        pResult->frames++;
+
+        DecodePending(&verifier, &pending);
+    }
+    encoder.Flush();
+    DecodePending(&verifier, &pending);
+    verifier.Decode(NULL);
+
+    av_frame_free(&pFrame);
+    return decoderOpen && (pResult->frames > 0);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    if (argc < 2)
+    {
+        printf("Usage: codecBench <clip> [crf list] [preset] [frames] [codecs]\n");
+        return 1;
+    }
+
+    const char*     pPath = argv[1];
+    QVector<int>    crfs = ParseList((argc > 2) ? argv[2] : "23,28,33");
+    int             preset = PresetGovernor::PresetIndex((argc > 3) ? argv[3] : "veryfast");
+    int             maxFrames = (argc > 4) ? atoi(argv[4]) : 250;
+    const char*     pCodecList = (argc > 5) ? argv[5] : "h264,hevc,av1";
+
+    static const char*  codecNames[BENCH_MAX_CODECS] = {"h264", "hevc", "av1"};
+    static const EncoderCodec codecs[BENCH_MAX_CODECS] = {ENCODER_CODEC_H264, ENCODER_CODEC_HEVC, ENCODER_CODEC_AV1};
+
+    if (crfs.isEmpty() || (preset < 0))
+    {
+        printf("Bad crf list or unknown preset\n");
+        return 1;
+    }
+
+    EncoderParameters params;
+
+    memset(&params, 0, sizeof(params));
+    params.queueDepth = 0;
+    params.queuePolicy = ENCODER_QUEUE_DROP_OLDEST;
+    params.threads = 0;
+    params.slicedThreads = true;
+    params.lookahead = -1;
+    params.preset = preset;
+    params.slowestPreset = preset;
+    params.adaptivePreset = false;
+    params.intraRefresh = false;
+
+    printf("%s, preset %s, %d frames (0 - whole file)\n", pPath, PresetGovernor::PresetName(preset), maxFrames);
+    printf("%-6s %-5s %-5s %-8s %-10s %-10s %-10s %-8s %-12s %-12s\n",
+           "codec", "crf", "qp", "frames", "kbit/s", "PSNR Y", "PSNR YUV", "SSIM Y", "enc avg ms", "enc max ms");
+
+    int failures = 0;
+
+    for (int c = 0; c < crfs.size(); c++)
+    {
+        for (int codec = 0; codec < BENCH_MAX_CODECS; codec++)
+        {
+            if (NULL == strstr(pCodecList, codecNames[codec]))
+            {
+                continue;
+            }
+
+            RunResult result;
+
+            params.crf = crfs[c];
+            params.codec = codecs[codec];
+            if (!RunClip(pPath, params, maxFrames, &result))
+            {
+                printf("%-6s %-5d failed\n", codecNames[codec], params.crf);
+                failures++;
+                continue;
+            }
+
+            // Same mapping as VideoEncoder::SetCodecOptions()
+            int quantiser = (ENCODER_CODEC_AV1 == params.codec) ? av_clip(params.crf * 63 / 51, 0, 63) : params.crf;
+
+            printf("%-6s %-5d %-5d %-8lld %-10.1f %-10.2f %-10.2f %-8.4f %-12.2f %-12.2f\n",
+                   codecNames[codec],
+                   params.crf,
+                   quantiser,
+                   (long long)result.frames,
+                   result.bytes * 8.0 * result.fps / 1000.0 / FFMAX(1, result.frames),
+                   result.LumaPsnr(),
+                   result.PlanesPsnr(),
+                   result.Ssim(),
+                   result.encodeTimeStat.Average() / 1000.0,
+                   result.encodeTimeStat.Max() / 1000.0);
+            if (result.decoded != result.frames)
+            {
+                printf("       %lld of %lld frames decoded back, quality is over those only\n",
+                       (long long)result.decoded, (long long)result.frames);
+            }
+        }
+    }
+
+    return failures ? 1 : 0;
+}
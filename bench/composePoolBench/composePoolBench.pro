@@ -0,0 +1,31 @@
+QT += core
+QT -= gui
+
+TARGET = composePoolBench
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += /usr/include
+INCLUDEPATH += ../../src
+
+SOURCES += main.cpp \
+    ../../src/errorHandler.cpp \
+    ../../src/composePool.cpp \
+    ../../src/layout.cpp \
+    ../../src/planeKernels.cpp \
+    ../../src/statistics.cpp
+
+HEADERS += \
+    ../../src/errorHandler.h \
+    ../../src/composePool.h \
+    ../../src/layout.h \
+    ../../src/planeKernels.h \
+    ../../src/statistics.h \
+    ../../src/common.h
+
+QMAKE_CXXFLAGS += -std=c++11
+
+LIBS +=  -L/usr/lib
+LIBS +=  -lavutil
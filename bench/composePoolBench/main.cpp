@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <QVector>
+
+#include "common.h"
+#include "statistics.h"
+#include "layout.h"
+#include "composePool.h"
+#include "planeKernels.h"
+
+/*
+ * Copy mode composition on ComposePool with 1 to 16 threads
+ * A 6x6 grid with one picture-in-picture tile on top (37 tiles, the ones under it are split into several
+ * visible rectangles) is composed at 1080p and 2160p. Pictures do not match tile aspect, so tiles get letterbox fills.
+ * Jobs do what Builder::RunComposeJob() does without overlay: plan, fill letterbox, blit the picture.
+ * Result must be byte identical for every thread count. Target is preset to a pattern first, so bytes no job
+ * should write (line padding) are compared too. Exit code is non-zero if any result differs from the single thread one.
+ * Usage: composePoolBench [max threads, 16] [frames per run, 200]
+*/
+
+#define BENCH_GRID  6
+
+static const int s_outputs[][2] = {{1920, 1080}, {3840, 2160}};
+
+static AVFrame* AllocFrame(int width, int height)
+{
+    AVFrame* pFrame = av_frame_alloc();
+
+    pFrame->format = AV_PIX_FMT_YUV420P;
+    pFrame->width = width;
+    pFrame->height = height;
+    av_frame_get_buffer(pFrame, 32);
+    return pFrame;
+}
+
+static void FillPattern(AVFrame* pFrame, int seed)
+{
+    for (int plane = 0; plane < 3; plane++)
+    {
+        int height = (plane == 0) ? pFrame->height : pFrame->height / 2;
+
+        for (int i = 0; i < pFrame->linesize[plane] * height; i++)
+        {
+            pFrame->data[plane][i] = (uint8_t)(i * 7 + seed * 13 + plane);
+        }
+    }
+}
+
+static bool SameFrames(const AVFrame* pA, const AVFrame* pB)
+{
+    for (int plane = 0; plane < 3; plane++)
+    {
+        int height = (plane == 0) ? pA->height : pA->height / 2;
+
+        if (memcmp(pA->data[plane], pB->data[plane], pA->linesize[plane] * height))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+class BenchJob : public ComposeJob
+{
+public:
+    BenchJob(const Layout& layout, AVFrame* pTarget) : m_layout(layout), m_pTarget(pTarget), m_replan(true)
+    {
+        m_plans.resize(layout.NumTiles());
+
+        // Every third tile gets a 4:3 picture, the others a 16:9 one a bit smaller than the tile
+        for (int tile = 0; tile < layout.NumTiles(); tile++)
+        {
+            const LayoutRect& rect = layout.TileRect(tile);
+            int width = (tile % 3) ? (rect.width - 8) & ~1 : (rect.height * 4 / 3) & ~1;
+            int height = (tile % 3) ? (rect.height - 6) & ~1 : rect.height & ~1;
+
+            m_pictures.append(AllocFrame(FFMIN(width, rect.width & ~1), height));
+            FillPattern(m_pictures[tile], tile);
+        }
+    }
+
+    ~BenchJob()
+    {
+        for (int i = 0; i < m_pictures.size(); i++)
+        {
+            av_frame_free(&m_pictures[i]);
+        }
+    }
+
+    void SetReplan(bool replan) { m_replan = replan; }
+
+    int64_t BytesPerFrame(bool replan) const
+    {
+        int64_t bytes = 0;
+
+        for (int i = 0; i < m_plans.size(); i++)
+        {
+            bytes += m_plans[i].blitBytes + (replan ? m_plans[i].fillBytes : 0);
+        }
+        return bytes;
+    }
+
+    void RunComposeJob(int index)
+    {
+        TilePlan&       plan = m_plans[index];
+        const AVFrame*  pPicture = m_pictures[index];
+
+        if (m_replan)
+        {
+            m_layout.PlanTile(index, pPicture->width, pPicture->height, m_pTarget->linesize, &plan);
+
+            for (int i = 0; i < plan.fills.size(); i++)
+            {
+                FillRect(plan.fills[i]);
+            }
+        }
+
+        for (int i = 0; i < plan.blits.size(); i++)
+        {
+            const TilePlan::Blit& blit = plan.blits[i];
+
+            for (int plane = 0; plane < 3; plane++)
+            {
+                int shift = (plane == 0) ? 0 : 1;
+
+                CopyPlane(m_pTarget->data[plane] + blit.dstOffset[plane], m_pTarget->linesize[plane],
+                          pPicture->data[plane] + (blit.srcY >> shift) * pPicture->linesize[plane] + (blit.srcX >> shift), pPicture->linesize[plane],
+                          blit.width >> shift, blit.height >> shift);
+            }
+        }
+    }
+
+private:
+    const Layout&       m_layout;
+    AVFrame*            m_pTarget;
+    bool                m_replan;
+    QVector<TilePlan>   m_plans;
+    QVector<AVFrame*>   m_pictures;
+
+    // Same as Builder::FillRect()
+    void FillRect(const LayoutRect& rect)
+    {
+        for (int row = 0; row < rect.height; row++)
+        {
+            memset(m_pTarget->data[0] + (rect.y + row) * m_pTarget->linesize[0] + rect.x, 16, rect.width);
+        }
+        for (int row = 0; row < (rect.height >> 1); row++)
+        {
+            memset(m_pTarget->data[1] + ((rect.y >> 1) + row) * m_pTarget->linesize[1] + (rect.x >> 1), 128, rect.width >> 1);
+            memset(m_pTarget->data[2] + ((rect.y >> 1) + row) * m_pTarget->linesize[2] + (rect.x >> 1), 128, rect.width >> 1);
+        }
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    int maxThreads = (argc > 1) ? atoi(argv[1]) : 16;
+    int frames = (argc > 2) ? atoi(argv[2]) : 200;
+    int failures = 0;
+
+    printf("Plane kernels: %s, %d cpu cores\n", PlaneKernelsImplementation(), QThread::idealThreadCount());
+
+    for (unsigned o = 0; o < sizeof(s_outputs) / sizeof(s_outputs[0]); o++)
+    {
+        int     width = s_outputs[o][0];
+        int     height = s_outputs[o][1];
+        Layout  layout = Layout::Grid(width, height, BENCH_GRID, BENCH_GRID);
+
+        // Picture-in-picture over the middle of the grid, cells under it are only partly visible
+        layout.AddTile(width / 3 + 10, height / 3 + 6, width / 3, height / 3, 1);
+        if (!layout.Compile())
+        {
+            printf("Failed to compile %dx%d layout\n", width, height);
+            return 1;
+        }
+
+        AVFrame*    pReference = AllocFrame(width, height);
+        AVFrame*    pTarget = AllocFrame(width, height);
+        BenchJob    referenceJob(layout, pReference);
+
+        // Single thread result without the pool is the reference
+        FillPattern(pReference, 255);
+        for (int tile = 0; tile < layout.NumTiles(); tile++)
+        {
+            referenceJob.RunComposeJob(tile);
+        }
+
+        printf("%dx%d, %d tiles\n", width, height, layout.NumTiles());
+        printf("%-8s %-14s %-14s %-10s %-10s %-8s\n", "threads", "replan ms", "redraw ms", "speedup", "MB/s", "equal");
+
+        double singleUs = 0.0;
+
+        for (int threads = 1; threads <= maxThreads; threads++)
+        {
+            ComposePool pool(threads);
+            BenchJob    job(layout, pTarget);
+
+            // First frame plans every tile and clears letterboxes, later ones only blit, like builder ticks
+            FillPattern(pTarget, 255);
+
+            int64_t startUs = MonotonicTimeUs();
+            job.SetReplan(true);
+            pool.Run(&job, layout.NumTiles());
+            int64_t replanUs = MonotonicTimeUs() - startUs;
+
+            bool equal = SameFrames(pTarget, pReference);
+
+            job.SetReplan(false);
+            startUs = MonotonicTimeUs();
+            for (int i = 0; i < frames; i++)
+            {
+                pool.Run(&job, layout.NumTiles());
+            }
+            double redrawUs = (double)(MonotonicTimeUs() - startUs) / FFMAX(1, frames);
+
+            equal = equal && SameFrames(pTarget, pReference);
+            failures += equal ? 0 : 1;
+            singleUs = (1 == threads) ? redrawUs : singleUs;
+
+            printf("%-8d %-14.3f %-14.3f %-10.2f %-10.0f %-8s\n",
+                   pool.NumThreads(),
+                   replanUs / 1000.0,
+                   redrawUs / 1000.0,
+                   redrawUs > 0.0 ? singleUs / redrawUs : 0.0,
+                   redrawUs > 0.0 ? job.BytesPerFrame(false) / redrawUs : 0.0,
+                   equal ? "yes" : "NO");
+        }
+
+        av_frame_free(&pReference);
+        av_frame_free(&pTarget);
+    }
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
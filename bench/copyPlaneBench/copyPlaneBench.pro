@@ -0,0 +1,24 @@
+QT -= core gui
+
+TARGET = copyPlaneBench
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+
+TEMPLATE = app
+
+INCLUDEPATH += /usr/include
+INCLUDEPATH += ../../src
+
+SOURCES += main.cpp \
+    ../../src/planeKernels.cpp \
+    ../../src/statistics.cpp
+
+HEADERS += \
+    ../../src/planeKernels.h \
+    ../../src/statistics.h
+
+QMAKE_CXXFLAGS += -std=c++11
+
+LIBS +=  -L/usr/lib
+LIBS +=  -lavutil -lopencv_core
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <opencv2/core/core.hpp>
+
+#include "statistics.h"
+#include "planeKernels.h"
+
+/*
+ * Tile blit speed of CopyPlane against cv::Mat::copyTo, the way Builder::DrawFrameOnTarget used them
+ * Each tile frame is copied plane by plane into a 1920x1080 YUV420P canvas, both paths must leave identical canvases.
+ * Exit code is non-zero if they differ.
+*/
+
+#define BENCH_CANVAS_WIDTH  1920
+#define BENCH_CANVAS_HEIGHT 1080
+#define BENCH_ITERATIONS    2000
+
+static const int s_tiles[][2] = {{160, 120}, {320, 180}, {480, 270}, {640, 360}, {960, 540}, {1920, 1080}};
+
+struct Planes
+{
+    uint8_t*    data[3];
+    int         linesize[3];
+    int         height;
+};
+
+static void AllocPlanes(Planes* pPlanes, int width, int height)
+{
+    for (int plane = 0; plane < 3; plane++)
+    {
+        int shift = (plane == 0) ? 0 : 1;
+
+        // Same 32 byte line alignment as frames from av_frame_get_buffer()
+        pPlanes->linesize[plane] = (((width >> shift) + 31) & ~31);
+        pPlanes->data[plane] = (uint8_t*)malloc(pPlanes->linesize[plane] * (height >> shift));
+        for (int i = 0; i < pPlanes->linesize[plane] * (height >> shift); i++)
+        {
+            pPlanes->data[plane][i] = (uint8_t)rand();
+        }
+    }
+    pPlanes->height = height;
+}
+
+static void FreePlanes(Planes* pPlanes)
+{
+    for (int plane = 0; plane < 3; plane++)
+    {
+        free(pPlanes->data[plane]);
+    }
+}
+
+static void BlitCopyPlane(Planes& canvas, const Planes& tile, int x, int y, int width, int height)
+{
+    for (int plane = 0; plane < 3; plane++)
+    {
+        int shift = (plane == 0) ? 0 : 1;
+
+        CopyPlane(canvas.data[plane] + (y >> shift) * canvas.linesize[plane] + (x >> shift), canvas.linesize[plane],
+                  tile.data[plane], tile.linesize[plane],
+                  width >> shift, height >> shift);
+    }
+}
+
+static void BlitOpenCv(Planes& canvas, const Planes& tile, int x, int y, int width, int height)
+{
+    for (int plane = 0; plane < 3; plane++)
+    {
+        int shift = (plane == 0) ? 0 : 1;
+
+        cv::Mat src(height >> shift, width >> shift, CV_8UC1,
+                    tile.data[plane],
+                    tile.linesize[plane]);
+        cv::Mat dst(height >> shift, width >> shift, CV_8UC1,
+                    canvas.data[plane] + (y >> shift) * canvas.linesize[plane] + (x >> shift),
+                    canvas.linesize[plane]);
+
+        src.copyTo(dst);
+    }
+}
+
+static bool SamePlanes(const Planes& a, const Planes& b)
+{
+    for (int plane = 0; plane < 3; plane++)
+    {
+        int shift = (plane == 0) ? 0 : 1;
+
+        if (memcmp(a.data[plane], b.data[plane], a.linesize[plane] * (a.height >> shift)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    int failures = 0;
+
+    printf("Plane kernels: %s\n", PlaneKernelsImplementation());
+    printf("%-10s %-14s %-14s %-10s %-8s\n", "tile", "CopyPlane us", "copyTo us", "speedup", "equal");
+
+    for (unsigned t = 0; t < sizeof(s_tiles) / sizeof(s_tiles[0]); t++)
+    {
+        int     width = s_tiles[t][0];
+        int     height = s_tiles[t][1];
+        Planes  tile;
+        Planes  canvasA;
+        Planes  canvasB;
+
+        AllocPlanes(&tile, width, height);
+        AllocPlanes(&canvasA, BENCH_CANVAS_WIDTH, BENCH_CANVAS_HEIGHT);
+        AllocPlanes(&canvasB, BENCH_CANVAS_WIDTH, BENCH_CANVAS_HEIGHT);
+        memcpy(canvasB.data[0], canvasA.data[0], canvasA.linesize[0] * BENCH_CANVAS_HEIGHT);
+        memcpy(canvasB.data[1], canvasA.data[1], canvasA.linesize[1] * BENCH_CANVAS_HEIGHT / 2);
+        memcpy(canvasB.data[2], canvasA.data[2], canvasA.linesize[2] * BENCH_CANVAS_HEIGHT / 2);
+
+        // Tiles walk over the canvas, so destination offsets are not always aligned
+        int     stepsX = BENCH_CANVAS_WIDTH / width;
+        int     stepsY = BENCH_CANVAS_HEIGHT / height;
+        int64_t copyPlaneUs = 0;
+        int64_t openCvUs = 0;
+
+        for (int i = 0; i < BENCH_ITERATIONS; i++)
+        {
+            int x = (i % stepsX) * width + (i & 7) * 2;
+            int y = (i / stepsX % stepsY) * height & ~1;
+
+            x = (x + width > BENCH_CANVAS_WIDTH) ? BENCH_CANVAS_WIDTH - width : x;
+
+            int64_t startUs = MonotonicTimeUs();
+            BlitCopyPlane(canvasA, tile, x, y, width, height);
+            int64_t midUs = MonotonicTimeUs();
+            BlitOpenCv(canvasB, tile, x, y, width, height);
+            int64_t endUs = MonotonicTimeUs();
+
+            copyPlaneUs += midUs - startUs;
+            openCvUs += endUs - midUs;
+        }
+
+        bool equal = SamePlanes(canvasA, canvasB);
+        failures += equal ? 0 : 1;
+
+        char name[32];
+        snprintf(name, sizeof(name), "%dx%d", width, height);
+        printf("%-10s %-14.2f %-14.2f %-10.2f %-8s\n",
+               name,
+               (double)copyPlaneUs / BENCH_ITERATIONS,
+               (double)openCvUs / BENCH_ITERATIONS,
+               copyPlaneUs ? (double)openCvUs / (double)copyPlaneUs : 0.0,
+               equal ? "yes" : "NO");
+
+        FreePlanes(&tile);
+        FreePlanes(&canvasA);
+        FreePlanes(&canvasB);
+    }
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
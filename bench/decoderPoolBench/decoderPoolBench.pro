@@ -0,0 +1,27 @@
+QT += core
+QT -= gui
+
+TARGET = decoderPoolBench
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += /usr/include
+INCLUDEPATH += ../../src
+
+SOURCES += main.cpp \
+    ../../src/decoderPool.cpp \
+    ../../src/errorHandler.cpp \
+    ../../src/statistics.cpp
+
+HEADERS += \
+    ../../src/decoderPool.h \
+    ../../src/errorHandler.h \
+    ../../src/statistics.h \
+    ../../src/common.h
+
+QMAKE_CXXFLAGS += -std=c++11
+
+LIBS +=  -L/usr/lib
+LIBS +=  -lavutil
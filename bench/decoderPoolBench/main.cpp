@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include <QCoreApplication>
+
+#include "common.h"
+#include "statistics.h"
+#include "decoderPool.h"
+
+/*
+ * Scaling of decode scheduling with camera count: DecoderPool against one thread per camera
+ * Each camera delivers a packet every 1/fps seconds, "decoding" it burns a fixed amount of cpu time.
+ *  - threads: each camera sleeps and decodes on its own thread, as streams did before the pool,
+ *  - pool:    one feeder thread queues packets, DecoderPool workers decode them with the same
+ *             pending counter and batching Stream uses.
+ * For 4, 16, 64 and 128 cameras the share of packets decoded within one frame period, read->decoded latency,
+ * cpu use and context switches are reported.
+ * Usage: decoderPoolBench [decode cpu us per packet, 2000] [seconds per run, 10] [fps, 25] [pool threads, 0 - one per core]
+*/
+
+#define BENCH_TASK_BATCH 8          // Same as DECODE_TASK_BATCH
+
+static const int s_cameraCounts[] = {4, 16, 64, 128};
+
+static int64_t ProcessCpuTimeUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t ContextSwitches()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (int64_t)usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+// Burns cpu time rather than wall time, so an oversubscribed machine shows up as latency
+static void DecodeWork(int costUs)
+{
+    int64_t endUs = ThreadCpuTimeUs() + costUs;
+
+    while (ThreadCpuTimeUs() < endUs)
+    {
+    }
+}
+
+class FakeCamera : public DecodeTask
+{
+public:
+    FakeCamera(DecoderPool* pPool, int costUs, int64_t periodUs) :
+        m_pPool(pPool),
+        m_affinity(pPool ? pPool->NextAffinity() : 0),
+        m_costUs(costUs),
+        m_periodUs(periodUs),
+        m_pending(0),
+        m_inTime(0)
+    {
+    }
+
+    /// Feeder thread. Packet read at readUs is queued for decoding
+    void Arrive(int64_t readUs)
+    {
+        {
+            QMutexLocker lock(&m_mutex);
+            m_arrivals.append(readUs);
+        }
+        if (0 == m_pending.fetchAndAddOrdered(1))
+        {
+            m_pPool->Submit(this, m_affinity);
+        }
+    }
+
+    void RunDecodeTask()
+    {
+        int processed = 0;
+
+        while (processed < BENCH_TASK_BATCH)
+        {
+            int64_t readUs;
+            {
+                QMutexLocker lock(&m_mutex);
+                if (m_arrivals.isEmpty())
+                {
+                    break;
+                }
+                readUs = m_arrivals.takeFirst();
+            }
+            Decode(readUs);
+            processed++;
+        }
+
+        if ((processed > 0) && (m_pending.fetchAndAddOrdered(-processed) > processed))
+        {
+            m_pPool->Submit(this, m_affinity);
+        }
+    }
+
+    /// Camera thread mode. Decodes packet read at readUs on the calling thread
+    void Decode(int64_t readUs)
+    {
+        DecodeWork(m_costUs);
+
+        int64_t latencyUs = MonotonicTimeUs() - readUs;
+
+        QMutexLocker lock(&m_statsMutex);
+        m_latencyStat.Add(latencyUs);
+        m_inTime += (latencyUs <= m_periodUs) ? 1 : 0;
+    }
+
+    RunningStat Latency(int64_t* pInTime)
+    {
+        QMutexLocker lock(&m_statsMutex);
+        *pInTime = m_inTime;
+        return m_latencyStat;
+    }
+
+private:
+    DecoderPool*        m_pPool;
+    int                 m_affinity;
+    int                 m_costUs;
+    int64_t             m_periodUs;
+    QAtomicInt          m_pending;
+    QMutex              m_mutex;
+    QList<int64_t>      m_arrivals;     /// Guarded by m_mutex
+    QMutex              m_statsMutex;
+    RunningStat         m_latencyStat;  /// Guarded by m_statsMutex
+    int64_t             m_inTime;       /// Guarded by m_statsMutex. Packets decoded within one frame period
+};
+
+class CameraThread : public QThread
+{
+public:
+    CameraThread(FakeCamera* pCamera, int64_t startUs, int64_t endUs, int64_t periodUs) :
+        QThread(NULL), m_pCamera(pCamera), m_startUs(startUs), m_endUs(endUs), m_periodUs(periodUs) {}
+
+protected:
+    void run()
+    {
+        for (int64_t readUs = m_startUs; readUs < m_endUs; readUs += m_periodUs)
+        {
+            SleepUntilUs(readUs);
+            m_pCamera->Decode(readUs);
+        }
+    }
+
+private:
+    FakeCamera* m_pCamera;
+    int64_t     m_startUs;
+    int64_t     m_endUs;
+    int64_t     m_periodUs;
+};
+
+class FeederThread : public QThread
+{
+public:
+    FeederThread(const QVector<FakeCamera*>& cameras, int64_t startUs, int64_t endUs, int64_t periodUs) :
+        QThread(NULL), m_cameras(cameras), m_startUs(startUs), m_endUs(endUs), m_periodUs(periodUs) {}
+
+protected:
+    void run()
+    {
+        int     numCameras = m_cameras.size();
+        int64_t slotUs = m_periodUs / numCameras;
+
+        // Cameras are spread evenly over the frame period, like unsynchronized real ones
+        for (int64_t i = 0; m_startUs + i * slotUs < m_endUs; i++)
+        {
+            int64_t readUs = m_startUs + i * slotUs;
+
+            SleepUntilUs(readUs);
+            m_cameras[i % numCameras]->Arrive(readUs);
+        }
+    }
+
+private:
+    QVector<FakeCamera*>    m_cameras;
+    int64_t                 m_startUs;
+    int64_t                 m_endUs;
+    int64_t                 m_periodUs;
+};
+
+static void RunBench(int numCameras, bool usePool, int costUs, int seconds, int fps, int poolThreads)
+{
+    DecoderPool*            pPool = usePool ? new DecoderPool(poolThreads) : NULL;
+    QVector<FakeCamera*>    cameras;
+    QVector<QThread*>       threads;
+    int64_t                 periodUs = 1000000 / fps;
+    int64_t                 startUs = MonotonicTimeUs() + 100000;
+    int64_t                 endUs = startUs + (int64_t)seconds * 1000000;
+
+    for (int i = 0; i < numCameras; i++)
+    {
+        cameras.append(new FakeCamera(pPool, costUs, periodUs));
+    }
+
+    if (usePool)
+    {
+        pPool->Start();
+        threads.append(new FeederThread(cameras, startUs, endUs, periodUs));
+    }
+    else
+    {
+        for (int i = 0; i < numCameras; i++)
+        {
+            threads.append(new CameraThread(cameras[i], startUs + i * periodUs / numCameras, endUs, periodUs));
+        }
+    }
+
+    int64_t cpuStartUs = ProcessCpuTimeUs();
+    int64_t switchesStart = ContextSwitches();
+
+    for (int i = 0; i < threads.size(); i++)
+    {
+        threads[i]->start();
+    }
+    for (int i = 0; i < threads.size(); i++)
+    {
+        threads[i]->wait();
+    }
+
+    // Packets still queued one frame period after the run were not decoded in time anyway
+    if (usePool)
+    {
+        SleepUntilUs(endUs + periodUs);
+        pPool->Stop();
+    }
+
+    int64_t     cpuUs = ProcessCpuTimeUs() - cpuStartUs;
+    int64_t     switches = ContextSwitches() - switchesStart;
+    int64_t     decoded = 0;
+    int64_t     inTime = 0;
+    int64_t     latencySum = 0;
+    int64_t     latencyMax = 0;
+    int64_t     expected = (int64_t)numCameras * seconds * fps;
+
+    for (int i = 0; i < numCameras; i++)
+    {
+        int64_t     cameraInTime;
+        RunningStat latency = cameras[i]->Latency(&cameraInTime);
+
+        inTime += cameraInTime;
+        decoded += latency.Count();
+        latencySum += latency.Sum();
+        latencyMax = FFMAX(latencyMax, latency.Max());
+    }
+
+    printf("%-8d %-8s %-8d %-10.1f %-10.2f %-10.2f %-10.1f %-12.0f\n",
+           numCameras,
+           usePool ? "pool" : "threads",
+           usePool ? pPool->NumThreads() : numCameras,
+           100.0 * inTime / FFMAX(1, expected),
+           decoded ? latencySum / 1000.0 / decoded : 0.0,
+           latencyMax / 1000.0,
+           100.0 * cpuUs / ((int64_t)seconds * 1000000),
+           (double)switches / seconds);
+
+    for (int i = 0; i < threads.size(); i++)
+    {
+        delete threads[i];
+    }
+    for (int i = 0; i < numCameras; i++)
+    {
+        delete cameras[i];
+    }
+    delete pPool;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    int costUs = (argc > 1) ? atoi(argv[1]) : 2000;
+    int seconds = (argc > 2) ? atoi(argv[2]) : 10;
+    int fps = (argc > 3) ? atoi(argv[3]) : 25;
+    int poolThreads = (argc > 4) ? atoi(argv[4]) : 0;
+
+    printf("Decode cost %d us per packet, %d fps, %d s per run, %d cpu cores\n", costUs, fps, seconds, QThread::idealThreadCount());
+    printf("%-8s %-8s %-8s %-10s %-10s %-10s %-10s %-12s\n", "cameras", "mode", "threads", "in time %", "lat avg ms", "lat max ms", "cpu %", "ctx sw/s");
+
+    for (unsigned i = 0; i < sizeof(s_cameraCounts) / sizeof(s_cameraCounts[0]); i++)
+    {
+        RunBench(s_cameraCounts[i], false, costUs, seconds, fps, poolThreads);
+        RunBench(s_cameraCounts[i], true, costUs, seconds, fps, poolThreads);
+    }
+
+    return 0;
+}
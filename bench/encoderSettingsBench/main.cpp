@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <QCoreApplication>
+#include <QVector>
+
+#include "common.h"
+#include "statistics.h"
+#include "videoEncoder.h"
+
+/*
+ * x264 throughput and latency for each threads / sliced threads / lookahead setting, at 1080p and 2160p
+ * Synthetic frames pan across a textured picture, so every frame has motion and detail to code.
+ * Frames are fed synchronously through VideoEncoder, as fast as it takes them or paced at the output rate.
+ * Latency is the time from EncodeFrame() of a frame to PacketReady() of its packet, delay is how many frames
+ * were sent in between. Unpaced fps is what the setting can sustain; latency of frame threading and lookahead
+ * only shows up right when paced, unpaced it is shortened by frames arriving faster than real time.
+ * Usage: encoderSettingsBench [frames per run, 250] [preset, veryfast] [crf, 23] [paced 0|1, 0] [fps, 25]
+ *                             [thread counts, 1,4,0] [lookaheads, -1,10]
+*/
+
+#define BENCH_PAN_X 256     // Horizontal pan range, pixels
+#define BENCH_PAN_Y 128     // Vertical pan range, pixels
+
+static const int s_outputs[][2] = {{1920, 1080}, {3840, 2160}};
+
+struct RunResult
+{
+    RunResult() : frames(0), packets(0), bytes(0), sent(0), wallUs(0) {}
+
+    int64_t     frames;
+    int64_t     packets;
+    int64_t     bytes;
+    int64_t     sent;               /// Frames handed to the encoder so far
+    int64_t     wallUs;             /// First frame sent to last packet out
+    RunningStat latencyStat;        /// us
+    RunningStat delayStat;          /// Frames sent after the one the packet belongs to
+    QVector<int64_t> sendTimeUs;    /// Indexed by frame
+};
+
+static AVFrame* AllocFrame(int width, int height)
+{
+    AVFrame* pFrame = av_frame_alloc();
+
+    pFrame->format = AV_PIX_FMT_YUV420P;
+    pFrame->width = width;
+    pFrame->height = height;
+    av_frame_get_buffer(pFrame, 32);
+    return pFrame;
+}
+
+/// Texture larger than the frame by the pan range: gradients with blocks of noise on top
+static AVFrame* MakeTexture(int width, int height)
+{
+    AVFrame*    pTexture = AllocFrame(width + BENCH_PAN_X, height + BENCH_PAN_Y);
+    uint32_t    seed = 12345;
+
+    for (int plane = 0; plane < 3; plane++)
+    {
+        int shift = (plane == 0) ? 0 : 1;
+
+        for (int y = 0; y < (pTexture->height >> shift); y++)
+        {
+            uint8_t* pRow = pTexture->data[plane] + y * pTexture->linesize[plane];
+
+            for (int x = 0; x < (pTexture->width >> shift); x++)
+            {
+                seed = seed * 1103515245 + 12345;
+                bool noisy = ((x >> (5 - shift)) + (y >> (5 - shift))) & 1;
+                pRow[x] = (uint8_t)(((x + y) >> (2 - shift)) + plane * 40 + (noisy ? (int)((seed >> 16) & 0x1f) : 0));
+            }
+        }
+    }
+    return pTexture;
+}
+
+static void PanFrame(const AVFrame* pTexture, AVFrame* pFrame, int64_t index)
+{
+    int panX = (int)((index * 4) % BENCH_PAN_X) & ~1;
+    int panY = (int)((index * 2) % BENCH_PAN_Y) & ~1;
+
+    for (int plane = 0; plane < 3; plane++)
+    {
+        int shift = (plane == 0) ? 0 : 1;
+
+        for (int y = 0; y < (pFrame->height >> shift); y++)
+        {
+            memcpy(pFrame->data[plane] + y * pFrame->linesize[plane],
+                   pTexture->data[plane] + ((panY >> shift) + y) * pTexture->linesize[plane] + (panX >> shift),
+                   pFrame->width >> shift);
+        }
+    }
+}
+
+static QVector<int> ParseList(const char* pList)
+{
+    QVector<int> values;
+    char*        pEnd = NULL;
+
+    for (const char* pValue = pList; *pValue; pValue = (',' == *pEnd) ? pEnd + 1 : pEnd)
+    {
+        values.append((int)strtol(pValue, &pEnd, 10));
+        if ((pEnd == pValue) || ((',' != *pEnd) && *pEnd))
+        {
+            return QVector<int>();
+        }
+    }
+    return values;
+}
+
+static void RunEncoder(EncoderParameters params, const AVFrame* pTexture, int frames, bool paced, RunResult* pResult)
+{
+    VideoEncoder    encoder(params);
+    AVFrame*        pFrame = AllocFrame(params.width, params.height);
+    int64_t         periodUs = 1000000 / params.fps;
+
+    pResult->sendTimeUs.resize(frames);
+
+    // Synchronous encoder emits on the caller thread, from inside EncodeFrame() or Flush()
+    QObject::connect(&encoder, &VideoEncoder::PacketReady, [pResult, &params](QSharedPointer<AVPacket> pPacket)
+    {
+        int64_t nowUs = MonotonicTimeUs();
+        int64_t index = av_rescale_q(pPacket->pts, AV_TIME_BASE_Q, av_make_q(1, params.fps));
+
+        if ((index >= 0) && (index < pResult->sendTimeUs.size()))
+        {
+            pResult->latencyStat.Add(nowUs - pResult->sendTimeUs[index]);
+            pResult->delayStat.Add(pResult->sent - 1 - index);
+        }
+        pResult->packets++;
+        pResult->bytes += pPacket->size;
+    });
+
+    encoder.Initialize();
+
+    int64_t startUs = MonotonicTimeUs();
+
+    for (int64_t index = 0; index < frames; index++)
+    {
+        if (paced)
+        {
+            SleepUntilUs(startUs + index * periodUs);
+        }
+
+        // Encoder only reads the frame, it is rewritten after the call returns. Drawing is not timed
+        PanFrame(pTexture, pFrame, index);
+        pFrame->pts = index;
+
+        pResult->sendTimeUs[index] = MonotonicTimeUs();
+        pResult->sent++;
+        encoder.EncodeFrame(QSharedPointer<AVFrame>(pFrame, [](AVFrame*){}));
+        pResult->frames++;
+    }
+    encoder.Flush();
+    pResult->wallUs = MonotonicTimeUs() - startUs;
+
+    av_frame_free(&pFrame);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    int             frames = (argc > 1) ? atoi(argv[1]) : 250;
+    int             preset = PresetGovernor::PresetIndex((argc > 2) ? argv[2] : "veryfast");
+    int             crf = (argc > 3) ? atoi(argv[3]) : 23;
+    bool            paced = (argc > 4) ? (0 != atoi(argv[4])) : false;
+    int             fps = (argc > 5) ? atoi(argv[5]) : 25;
+    QVector<int>    threadCounts = ParseList((argc > 6) ? argv[6] : "1,4,0");
+    QVector<int>    lookaheads = ParseList((argc > 7) ? argv[7] : "-1,10");
+
+    if ((frames < 1) || (preset < 0) || (fps < 1) || threadCounts.isEmpty() || lookaheads.isEmpty())
+    {
+        printf("Usage: encoderSettingsBench [frames] [preset] [crf] [paced 0|1] [fps] [thread counts] [lookaheads]\n");
+        return 1;
+    }
+
+    EncoderParameters params;
+
+    memset(&params, 0, sizeof(params));
+    params.fps = fps;
+    params.crf = crf;
+    params.codec = ENCODER_CODEC_H264;
+    params.queueDepth = 0;
+    params.queuePolicy = ENCODER_QUEUE_DROP_OLDEST;
+    params.preset = preset;
+    params.slowestPreset = preset;
+    params.adaptivePreset = false;
+    params.intraRefresh = false;
+
+    printf("libx264 preset %s crf %d, %d frames per run, %s at %d fps, %d cpu cores\n",
+           PresetGovernor::PresetName(preset), crf, frames, paced ? "paced" : "unpaced", fps, QThread::idealThreadCount());
+
+    for (unsigned o = 0; o < sizeof(s_outputs) / sizeof(s_outputs[0]); o++)
+    {
+        params.width = s_outputs[o][0];
+        params.height = s_outputs[o][1];
+
+        AVFrame* pTexture = MakeTexture(params.width, params.height);
+
+        printf("%dx%d\n", params.width, params.height);
+        printf("%-8s %-8s %-10s %-8s %-12s %-12s %-10s %-10s %-10s\n",
+               "threads", "sliced", "lookahead", "fps", "lat avg ms", "lat max ms", "delay avg", "delay max", "kbit/s");
+
+        for (int t = 0; t < threadCounts.size(); t++)
+        {
+            for (int sliced = 1; sliced >= 0; sliced--)
+            {
+                for (int l = 0; l < lookaheads.size(); l++)
+                {
+                    RunResult result;
+
+                    params.threads = threadCounts[t];
+                    params.slicedThreads = (0 != sliced);
+                    params.lookahead = lookaheads[l];
+                    RunEncoder(params, pTexture, frames, paced, &result);
+
+                    printf("%-8d %-8s %-10d %-8.1f %-12.2f %-12.2f %-10.2f %-10lld %-10.1f\n",
+                           params.threads,
+                           sliced ? "yes" : "no",
+                           params.lookahead,
+                           result.frames * 1000000.0 / FFMAX(1, result.wallUs),
+                           result.latencyStat.Average() / 1000.0,
+                           result.latencyStat.Max() / 1000.0,
+                           result.delayStat.Average(),
+                           (long long)result.delayStat.Max(),
+                           result.bytes * 8.0 * fps / 1000.0 / FFMAX(1, result.frames));
+                }
+            }
+        }
+
+        av_frame_free(&pTexture);
+    }
+
+    return 0;
+}
@@ -0,0 +1,28 @@
+QT += core
+QT -= gui
+
+TARGET = frameDeliveryBench
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += /usr/include
+INCLUDEPATH += ../../src
+
+SOURCES += main.cpp \
+    ../../src/errorHandler.cpp \
+    ../../src/frameBuffer.cpp \
+    ../../src/statistics.cpp
+
+HEADERS += \
+    ../../src/errorHandler.h \
+    ../../src/frameBuffer.h \
+    ../../src/spscQueue.h \
+    ../../src/statistics.h \
+    ../../src/common.h
+
+QMAKE_CXXFLAGS += -std=c++11
+
+LIBS +=  -L/usr/lib
+LIBS +=  -lavutil
@@ -0,0 +1,324 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QMutex>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+
+#include "common.h"
+#include "statistics.h"
+#include "frameBuffer.h"
+
+/*
+ * Frame delivery from decoding threads to the compositor tick on the main event loop
+ *   queued - FrameBuffer before the triple buffer: QMutex and QVector, living on the main thread, fed through
+ *            a queued connection, so every decoded frame is an event the main loop has to dispatch
+ *   mutex  - the same buffer fed through a direct connection, decoding threads and the tick share its mutex
+ *   triple - current FrameBuffer, fed through a direct connection as Kvadrator connects it
+ * Camera threads publish frames at camera rate, spread over the frame period. The main loop ticks at output rate
+ * and spends tick work ms per tick, standing in for composing and encoding, then reads every buffer.
+ * Per run: event queue depth (frames posted and not yet delivered, sampled every tick), age of a frame when
+ * the tick first sees it, tick lateness against its schedule, main thread CPU and mutex contention
+ * (lock attempts that found the mutex taken). Ticks the main loop was too late for are counted as missed.
+ * Usage: frameDeliveryBench [cameras, 64] [camera fps, 25] [output fps, 25] [tick work ms, 20] [seconds per run, 20]
+*/
+
+enum DeliveryMode
+{
+    DELIVERY_QUEUED,
+    DELIVERY_MUTEX,
+    DELIVERY_TRIPLE
+};
+
+static const char* s_modeNames[] = {"queued", "mutex", "triple"};
+
+static QAtomicInt s_posted;     // Frames emitted through queued connection
+static QAtomicInt s_delivered;  // Frames the queued connection delivered
+
+/// FrameBuffer as it was before the triple buffer, with contention counted
+class LegacyFrameBuffer : public QObject
+{
+    Q_OBJECT
+public:
+    LegacyFrameBuffer() : m_locks(0), m_contended(0)
+    {
+        m_buffer.resize(1);
+    }
+
+    QSharedPointer<AVFrame> GetFrame()
+    {
+        Lock();
+        QSharedPointer<AVFrame> pFrame = m_buffer.empty() ? QSharedPointer<AVFrame>() : m_buffer.front();
+        m_mutex.unlock();
+        return pFrame;
+    }
+
+    int TakeLocks() { return m_locks.fetchAndStoreRelaxed(0); }
+    int TakeContended() { return m_contended.fetchAndStoreRelaxed(0); }
+
+public slots:
+    void AddFrame(QSharedPointer<AVFrame> pNewFrame)
+    {
+        if (QThread::currentThread() == thread())
+        {
+            s_delivered.fetchAndAddRelaxed(1);
+        }
+
+        Lock();
+        m_buffer.clear();
+        m_buffer.append(pNewFrame);
+        m_mutex.unlock();
+    }
+
+private:
+    QMutex      m_mutex;
+    QVector<QSharedPointer<AVFrame> > m_buffer;
+    QAtomicInt  m_locks;
+    QAtomicInt  m_contended;
+
+    void Lock()
+    {
+        m_locks.fetchAndAddRelaxed(1);
+        if (!m_mutex.tryLock())
+        {
+            m_contended.fetchAndAddRelaxed(1);
+            m_mutex.lock();
+        }
+    }
+};
+
+class CameraThread : public QThread
+{
+    Q_OBJECT
+public:
+    CameraThread(bool queued, int64_t startUs, int64_t periodUs) :
+        QThread(NULL), m_queued(queued), m_startUs(startUs), m_periodUs(periodUs), m_stop(0) {}
+
+    void RequestStop() { m_stop.storeRelease(1); }
+
+signals:
+    void FrameReady(QSharedPointer<AVFrame> pFrame);
+
+protected:
+    void run()
+    {
+        for (int64_t seq = 0; !m_stop.loadAcquire(); seq++)
+        {
+            SleepUntilUs(m_startUs + seq * m_periodUs);
+
+            // Content does not matter, only the shared pointer travels. Publish time goes in the timestamp
+            AVFrame* pFrame = av_frame_alloc();
+            pFrame->best_effort_timestamp = MonotonicTimeUs();
+
+            s_posted.fetchAndAddRelaxed(m_queued ? 1 : 0);
+            emit FrameReady(QSharedPointer<AVFrame>(pFrame, [] (AVFrame *ptr) {av_frame_free(&ptr);}));
+        }
+    }
+
+private:
+    bool        m_queued;
+    int64_t     m_startUs;
+    int64_t     m_periodUs;
+    QAtomicInt  m_stop;
+};
+
+struct RunResult
+{
+    RunResult() : ticks(0), missed(0), shown(0), locks(0), contended(0), mainCpuUs(0), wallUs(0) {}
+
+    int64_t     ticks;
+    int64_t     missed;             /// Ticks skipped because the previous one ran late
+    int64_t     shown;              /// Frames seen by a tick for the first time
+    int64_t     locks;
+    int64_t     contended;
+    int64_t     mainCpuUs;
+    int64_t     wallUs;
+    RunningStat queueDepthStat;     /// Posted and not delivered frames at tick
+    RunningStat frameAgeStat;       /// Publish to first seen by a tick, us
+    RunningStat tickLateStat;       /// Tick start against schedule, us
+};
+
+static void RunBench(DeliveryMode mode, int numCameras, int fps, int outFps, int workMs, int seconds, RunResult* pResult)
+{
+    QVector<CameraThread*>          cameras;
+    QVector<LegacyFrameBuffer*>     legacyBuffers;
+    QVector<FrameBuffer*>           buffers;
+    QVector<AVFrame*>               lastSeen(numCameras, NULL);
+    int64_t                         periodUs = 1000000 / fps;
+    int64_t                         tickUs = 1000000 / outFps;
+    int64_t                         startUs = MonotonicTimeUs() + 100000;
+
+    s_posted.storeRelease(0);
+    s_delivered.storeRelease(0);
+
+    for (int i = 0; i < numCameras; i++)
+    {
+        // Cameras are spread over the frame period, like unsynchronized real ones
+        cameras.append(new CameraThread(DELIVERY_QUEUED == mode, startUs + i * periodUs / numCameras, periodUs));
+        if (DELIVERY_TRIPLE == mode)
+        {
+            buffers.append(new FrameBuffer());
+            QObject::connect(cameras[i], &CameraThread::FrameReady, buffers[i], &FrameBuffer::AddFrame, Qt::DirectConnection);
+        }
+        else
+        {
+            // Buffer lives on the main thread, as before, so the automatic connection was a queued one
+            legacyBuffers.append(new LegacyFrameBuffer());
+            QObject::connect(cameras[i], &CameraThread::FrameReady, legacyBuffers[i], &LegacyFrameBuffer::AddFrame,
+                             (DELIVERY_QUEUED == mode) ? Qt::QueuedConnection : Qt::DirectConnection);
+        }
+    }
+
+    QEventLoop  loop;
+    QTimer      timer;
+    int64_t     tick = 1;
+    int64_t     endUs = startUs + (int64_t)seconds * 1000000;
+
+    timer.setTimerType(Qt::PreciseTimer);
+    timer.setInterval((int)(tickUs / 1000));
+    QObject::connect(&timer, &QTimer::timeout, [&]()
+    {
+        int64_t nowUs = MonotonicTimeUs();
+
+        if (nowUs >= endUs)
+        {
+            loop.quit();
+            return;
+        }
+
+        // Ticks missed entirely are skipped, like Builder does
+        int64_t dueTick = (nowUs - startUs) / tickUs;
+        if (dueTick > tick)
+        {
+            pResult->missed += dueTick - tick;
+            tick = dueTick;
+        }
+        pResult->tickLateStat.Add(nowUs - (startUs + tick * tickUs));
+        pResult->queueDepthStat.Add(s_posted.loadAcquire() - s_delivered.loadAcquire());
+        tick++;
+        pResult->ticks++;
+
+        // Composing and encoding keep the main thread busy before the buffers are read
+        while (MonotonicTimeUs() < nowUs + workMs * 1000) {}
+
+        int64_t readUs = MonotonicTimeUs();
+
+        for (int i = 0; i < numCameras; i++)
+        {
+            QSharedPointer<AVFrame> pFrame = (DELIVERY_TRIPLE == mode) ? buffers[i]->GetFrame(readUs) : legacyBuffers[i]->GetFrame();
+
+            if (!pFrame.isNull() && (pFrame.data() != lastSeen[i]))
+            {
+                lastSeen[i] = pFrame.data();
+                pResult->frameAgeStat.Add(readUs - pFrame->best_effort_timestamp);
+                pResult->shown++;
+            }
+        }
+    });
+
+    for (int i = 0; i < numCameras; i++)
+    {
+        cameras[i]->start();
+    }
+
+    // Ticks are scheduled from the camera start, one output period apart
+    SleepUntilUs(startUs);
+
+    int64_t cpuStartUs = ThreadCpuTimeUs();
+    int64_t wallStartUs = MonotonicTimeUs();
+
+    timer.start();
+    loop.exec();
+    timer.stop();
+
+    pResult->mainCpuUs = ThreadCpuTimeUs() - cpuStartUs;
+    pResult->wallUs = MonotonicTimeUs() - wallStartUs;
+
+    for (int i = 0; i < numCameras; i++)
+    {
+        cameras[i]->RequestStop();
+    }
+    for (int i = 0; i < numCameras; i++)
+    {
+        cameras[i]->wait();
+    }
+
+    // Frames still queued are delivered before their receivers go away
+    QCoreApplication::sendPostedEvents();
+
+    for (int i = 0; i < legacyBuffers.size(); i++)
+    {
+        pResult->locks += legacyBuffers[i]->TakeLocks();
+        pResult->contended += legacyBuffers[i]->TakeContended();
+        delete legacyBuffers[i];
+    }
+    for (int i = 0; i < buffers.size(); i++)
+    {
+        delete buffers[i];
+    }
+    for (int i = 0; i < numCameras; i++)
+    {
+        delete cameras[i];
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    int numCameras = (argc > 1) ? atoi(argv[1]) : 64;
+    int fps = (argc > 2) ? atoi(argv[2]) : 25;
+    int outFps = (argc > 3) ? atoi(argv[3]) : 25;
+    int workMs = (argc > 4) ? atoi(argv[4]) : 20;
+    int seconds = (argc > 5) ? atoi(argv[5]) : 20;
+
+    if ((numCameras < 1) || (fps < 1) || (outFps < 1) || (workMs < 0) || (seconds < 1))
+    {
+        printf("Usage: frameDeliveryBench [cameras] [camera fps] [output fps] [tick work ms] [seconds per run]\n");
+        return 1;
+    }
+
+    qRegisterMetaType< QSharedPointer<AVFrame > >("QSharedPointer<AVFrame >");
+
+    printf("%d cameras at %d fps, %d fps out, %d ms work per tick, %d s per run, %d cpu cores\n",
+           numCameras, fps, outFps, workMs, seconds, QThread::idealThreadCount());
+    printf("%-8s %-8s %-8s %-10s %-10s %-10s %-12s %-12s %-12s %-12s %-10s %-10s\n",
+           "mode", "ticks", "missed", "shown/s", "queue avg", "queue max", "age avg ms", "age max ms",
+           "late avg ms", "late max ms", "main cpu %", "contended %");
+
+    for (int mode = DELIVERY_QUEUED; mode <= DELIVERY_TRIPLE; mode++)
+    {
+        RunResult result;
+
+        RunBench((DeliveryMode)mode, numCameras, fps, outFps, workMs, seconds, &result);
+
+        printf("%-8s %-8lld %-8lld %-10.1f %-10.1f %-10lld %-12.2f %-12.2f %-12.2f %-12.2f %-10.1f ",
+               s_modeNames[mode],
+               (long long)result.ticks,
+               (long long)result.missed,
+               result.shown * 1000000.0 / FFMAX(1, result.wallUs),
+               result.queueDepthStat.Average(),
+               (long long)result.queueDepthStat.Max(),
+               result.frameAgeStat.Average() / 1000.0,
+               result.frameAgeStat.Max() / 1000.0,
+               result.tickLateStat.Average() / 1000.0,
+               result.tickLateStat.Max() / 1000.0,
+               100.0 * result.mainCpuUs / FFMAX(1, result.wallUs));
+        if (DELIVERY_TRIPLE == mode)
+        {
+            printf("%-10s\n", "-");
+        }
+        else
+        {
+            printf("%-10.2f\n", 100.0 * result.contended / FFMAX(1, result.locks));
+        }
+    }
+
+    return 0;
+}
+
+#include "main.moc"
@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <QCoreApplication>
+#include <QThread>
+#include <QVector>
+
+#include "common.h"
+#include "statistics.h"
+#include "framePool.h"
+#include "frameBuffer.h"
+
+/*
+ * Scaled frame allocation: FramePool against av_frame_get_buffer() per frame
+ * Frames take the same way as in the service: each camera thread gets a tile sized frame, writes it as the scaler
+ * would and hands it to its FrameBuffer wrapped in QSharedPointer. Compositor thread picks frames up every tick
+ * and holds each one until the tile shows a newer frame, so the last reference is dropped on another thread,
+ * sometimes several ticks later.
+ * Once a second pool hits and misses and process RSS are printed, for the pool first, then for the baseline.
+ * RSS growth is counted from the start of each run, the baseline inherits whatever heap the pool run left behind.
+ * Usage: framePoolBench [cameras, 64] [tile width, 480] [tile height, 270] [camera fps, 25] [output fps, 25]
+ *                       [seconds per run, 30] [frame buffer depth, 1]
+*/
+
+static AVFrame* AllocFrame(int width, int height)
+{
+    AVFrame* pFrame = av_frame_alloc();
+
+    // What Stream::ScaleFrame() did before the pool
+    pFrame->format = AV_PIX_FMT_YUV420P;
+    pFrame->width = width;
+    pFrame->height = height;
+    if (0 > av_frame_get_buffer(pFrame, 32))
+    {
+        av_frame_free(&pFrame);
+    }
+    return pFrame;
+}
+
+class CameraThread : public QThread
+{
+public:
+    CameraThread(FrameBuffer* pBuffer, bool usePool, int width, int height, int64_t startUs, int64_t periodUs) :
+        QThread(NULL), m_pBuffer(pBuffer), m_usePool(usePool), m_width(width), m_height(height),
+        m_startUs(startUs), m_periodUs(periodUs), m_stop(0), m_allocated(0) {}
+
+    FramePool   pool;
+
+    void    RequestStop() { m_stop.storeRelease(1); }
+    int     TakeAllocated() { return m_allocated.fetchAndStoreRelaxed(0); }
+
+protected:
+    void run()
+    {
+        for (int64_t seq = 0; !m_stop.loadAcquire(); seq++)
+        {
+            SleepUntilUs(m_startUs + seq * m_periodUs);
+
+            AVFrame* pFrame = m_usePool ? pool.GetFrame(m_width, m_height) : AllocFrame(m_width, m_height);
+            if (NULL == pFrame)
+            {
+                continue;
+            }
+            m_allocated.fetchAndAddRelaxed(m_usePool ? 0 : 1);
+
+            // Scaler writes every line of the frame
+            for (int plane = 0; plane < 3; plane++)
+            {
+                int shift = (plane == 0) ? 0 : 1;
+                memset(pFrame->data[plane], (int)(seq & 0xff), pFrame->linesize[plane] * (m_height >> shift));
+            }
+            pFrame->best_effort_timestamp = seq * m_periodUs;
+
+            m_pBuffer->AddFrame(QSharedPointer<AVFrame>(pFrame, [] (AVFrame *ptr) {av_frame_free(&ptr);}));
+        }
+    }
+
+private:
+    FrameBuffer*    m_pBuffer;
+    bool            m_usePool;
+    int             m_width;
+    int             m_height;
+    int64_t         m_startUs;
+    int64_t         m_periodUs;
+    QAtomicInt      m_stop;
+    QAtomicInt      m_allocated;    /// Baseline frames allocated since last TakeAllocated()
+};
+
+static void RunBench(bool usePool, int numCameras, int width, int height, int fps, int outFps, int seconds, int depth)
+{
+    QVector<FrameBuffer*>           buffers;
+    QVector<CameraThread*>          cameras;
+    QVector<QSharedPointer<AVFrame> > shown(numCameras);
+    int64_t                         periodUs = 1000000 / fps;
+    int64_t                         tickUs = 1000000 / outFps;
+    int64_t                         startUs = MonotonicTimeUs() + 100000;
+    int64_t                         rssStartKb = ResidentSetSizeKb();
+
+    for (int i = 0; i < numCameras; i++)
+    {
+        buffers.append(new FrameBuffer(depth));
+        // Cameras are spread over the frame period, like unsynchronized real ones
+        cameras.append(new CameraThread(buffers[i], usePool, width, height, startUs + i * periodUs / numCameras, periodUs));
+        cameras[i]->start();
+    }
+
+    int64_t nextReportUs = startUs + 1000000;
+    int     second = 1;
+
+    for (int64_t tick = 0; second <= seconds; tick++)
+    {
+        int64_t nowUs = startUs + tick * tickUs;
+
+        SleepUntilUs(nowUs);
+
+        // Previous frame of the tile is released here, on the compositor thread
+        for (int i = 0; i < numCameras; i++)
+        {
+            QSharedPointer<AVFrame> pFrame = buffers[i]->GetFrame(nowUs);
+
+            if (!pFrame.isNull())
+            {
+                shown[i] = pFrame;
+            }
+        }
+
+        if (nowUs < nextReportUs)
+        {
+            continue;
+        }
+
+        int64_t hits = 0;
+        int64_t misses = 0;
+        int64_t pooledKb = 0;
+
+        for (int i = 0; i < numCameras; i++)
+        {
+            if (usePool)
+            {
+                hits += cameras[i]->pool.hits.fetchAndStoreRelaxed(0);
+                misses += cameras[i]->pool.misses.fetchAndStoreRelaxed(0);
+                pooledKb += cameras[i]->pool.PooledBytes() / 1024;
+            }
+            else
+            {
+                misses += cameras[i]->TakeAllocated();
+            }
+        }
+
+        int64_t rssKb = ResidentSetSizeKb();
+
+        printf("%-9s %-6d %-10lld %-10lld %-10.1f %-12.1f %-10.1f %-10.1f\n",
+               usePool ? "pool" : "alloc",
+               second,
+               (long long)hits,
+               (long long)misses,
+               (hits + misses) ? 100.0 * hits / (hits + misses) : 0.0,
+               pooledKb / 1024.0,
+               rssKb / 1024.0,
+               (rssKb - rssStartKb) / 1024.0);
+        nextReportUs += 1000000;
+        second++;
+    }
+
+    for (int i = 0; i < numCameras; i++)
+    {
+        cameras[i]->RequestStop();
+    }
+    for (int i = 0; i < numCameras; i++)
+    {
+        cameras[i]->wait();
+    }
+
+    // Frames go back to their pools before the pools are deleted, as streams outlive builder references too
+    shown.clear();
+    for (int i = 0; i < numCameras; i++)
+    {
+        delete buffers[i];
+        delete cameras[i];
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    int numCameras = (argc > 1) ? atoi(argv[1]) : 64;
+    int width = (argc > 2) ? atoi(argv[2]) : 480;
+    int height = (argc > 3) ? atoi(argv[3]) : 270;
+    int fps = (argc > 4) ? atoi(argv[4]) : 25;
+    int outFps = (argc > 5) ? atoi(argv[5]) : 25;
+    int seconds = (argc > 6) ? atoi(argv[6]) : 30;
+    int depth = (argc > 7) ? atoi(argv[7]) : 1;
+
+    printf("%d cameras, %dx%d tiles, %d fps in, %d fps out, frame buffer depth %d\n", numCameras, width, height, fps, outFps, depth);
+    printf("%-9s %-6s %-10s %-10s %-10s %-12s %-10s %-10s\n", "mode", "s", "hits/s", "misses/s", "hit %", "pooled MB", "rss MB", "rss +MB");
+
+    RunBench(true, numCameras, width, height, fps, outFps, seconds, depth);
+    RunBench(false, numCameras, width, height, fps, outFps, seconds, depth);
+
+    return 0;
+}
@@ -0,0 +1,31 @@
+QT += core
+QT -= gui
+
+TARGET = intraRefreshBench
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += /usr/include
+INCLUDEPATH += ../../src
+
+SOURCES += main.cpp \
+    ../../src/videoEncoder.cpp \
+    ../../src/videoScaler.cpp \
+    ../../src/presetGovernor.cpp \
+    ../../src/errorHandler.cpp \
+    ../../src/statistics.cpp
+
+HEADERS += \
+    ../../src/videoEncoder.h \
+    ../../src/videoScaler.h \
+    ../../src/presetGovernor.h \
+    ../../src/errorHandler.h \
+    ../../src/statistics.h \
+    ../../src/common.h
+
+QMAKE_CXXFLAGS += -std=c++11
+
+LIBS +=  -L/usr/lib
+LIBS +=  -lavformat -lavcodec -lavutil -lswscale -lx264 -lm -lz
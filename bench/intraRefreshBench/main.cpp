@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <QCoreApplication>
+#include <QVector>
+
+#include "common.h"
+#include "statistics.h"
+#include "videoEncoder.h"
+
+/*
+ * Packet size spread and end-to-end latency of libx264 with keyframes against intra refresh
+ * The recording is decoded and replayed twice through VideoEncoder at its own frame rate, exactly the same frames
+ * each time, once with a keyframe every GOP and once with intra refresh.
+ * Packets are sent over a modelled constant rate link, so a keyframe several times the average size holds
+ * the link for several frame periods and every packet behind it waits. End-to-end latency is from the frame
+ * being sent to the encoder until the last bit of its packet is over the link.
+ * Link rate defaults to 1.5 times the average bitrate with keyframes, both runs use the same rate.
+ * Usage: intraRefreshBench <recorded wall> [preset, veryfast] [crf, 23] [link kbit/s, 0 - auto] [frames, 0 - whole file]
+*/
+
+#define BENCH_LINK_HEADROOM 1.5     // Link rate over average bitrate when not given
+
+struct Packet
+{
+    int64_t index;      /// Frame the packet belongs to
+    int64_t readyUs;    /// PacketReady() time
+    int     size;
+    bool    key;
+};
+
+struct RunResult
+{
+    RunResult() : frames(0), bytes(0), keyPackets(0), fps(0) {}
+
+    int64_t         frames;
+    int64_t         bytes;
+    int64_t         keyPackets;
+    int             fps;
+    RunningStat     packetSizeStat;     /// Bytes
+    RunningStat     encodeLatencyStat;  /// EncodeFrame() of a frame to PacketReady() of its packet, us
+    RunningStat     endToEndStat;       /// EncodeFrame() of a frame to its packet over the link, us
+    QVector<int64_t> sendTimeUs;        /// Indexed by frame
+    QVector<Packet> packets;
+
+    double AverageKbps() const { return bytes * 8.0 * fps / 1000.0 / FFMAX(1, frames); }
+
+    /// Packets leave in order, one after another, each as soon as it is ready and the link is free
+    void SendOverLink(double kbps)
+    {
+        int64_t linkFreeUs = 0;
+
+        endToEndStat.Reset();
+        for (int i = 0; i < packets.size(); i++)
+        {
+            const Packet& packet = packets[i];
+
+            linkFreeUs = FFMAX(linkFreeUs, packet.readyUs) + (int64_t)(packet.size * 8.0 * 1000.0 / kbps);
+            endToEndStat.Add(linkFreeUs - sendTimeUs[packet.index]);
+        }
+    }
+};
+
+/// Decodes recording into YUV420P frames of its own size
+class Replay
+{
+public:
+    Replay() : m_pFormat(NULL), m_pDecoder(NULL), m_pScaler(NULL), m_pPacket(NULL), m_pDecoded(NULL), m_streamIndex(-1), m_eof(false) {}
+    ~Replay() { Close(); }
+
+    bool Open(const char* pPath)
+    {
+        if ((0 > avformat_open_input(&m_pFormat, pPath, NULL, NULL)) || (0 > avformat_find_stream_info(m_pFormat, NULL)))
+        {
+            return false;
+        }
+        m_streamIndex = av_find_best_stream(m_pFormat, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+        if (0 > m_streamIndex)
+        {
+            return false;
+        }
+
+        AVStream*       pStream = m_pFormat->streams[m_streamIndex];
+        const AVCodec*  pCodec = avcodec_find_decoder(pStream->codecpar->codec_id);
+
+        m_pDecoder = avcodec_alloc_context3(pCodec);
+        avcodec_parameters_to_context(m_pDecoder, pStream->codecpar);
+        if (0 > avcodec_open2(m_pDecoder, pCodec, NULL))
+        {
+            return false;
+        }
+        m_fps = (pStream->avg_frame_rate.num > 0) ? (int)(av_q2d(pStream->avg_frame_rate) + 0.5) : 25;
+        m_pPacket = av_packet_alloc();
+        m_pDecoded = av_frame_alloc();
+        m_eof = false;
+        return true;
+    }
+
+    void Close()
+    {
+        sws_freeContext(m_pScaler);
+        m_pScaler = NULL;
+        av_frame_free(&m_pDecoded);
+        av_packet_free(&m_pPacket);
+        avcodec_free_context(&m_pDecoder);
+        avformat_close_input(&m_pFormat);
+    }
+
+    int Width() const { return m_pDecoder->width & ~1; }
+    int Height() const { return m_pDecoder->height & ~1; }
+    int Fps() const { return m_fps; }
+
+    /// Next picture converted into pFrame. False at end of file
+    bool NextFrame(AVFrame* pFrame)
+    {
+        while (true)
+        {
+            int res = avcodec_receive_frame(m_pDecoder, m_pDecoded);
+
+            if (0 == res)
+            {
+                m_pScaler = sws_getCachedContext(m_pScaler, m_pDecoded->width, m_pDecoded->height, (AVPixelFormat)m_pDecoded->format,
+                                                 pFrame->width, pFrame->height, AV_PIX_FMT_YUV420P, SWS_POINT, NULL, NULL, NULL);
+                sws_scale(m_pScaler, m_pDecoded->data, m_pDecoded->linesize, 0, m_pDecoded->height, pFrame->data, pFrame->linesize);
+                av_frame_unref(m_pDecoded);
+                return true;
+            }
+            if ((AVERROR(EAGAIN) != res) || m_eof)
+            {
+                return false;
+            }
+
+            if (0 > av_read_frame(m_pFormat, m_pPacket))
+            {
+                m_eof = true;
+                avcodec_send_packet(m_pDecoder, NULL);
+                continue;
+            }
+            if (m_pPacket->stream_index == m_streamIndex)
+            {
+                avcodec_send_packet(m_pDecoder, m_pPacket);
+            }
+            av_packet_unref(m_pPacket);
+        }
+    }
+
+private:
+    AVFormatContext*    m_pFormat;
+    AVCodecContext*     m_pDecoder;
+    SwsContext*         m_pScaler;
+    AVPacket*           m_pPacket;
+    AVFrame*            m_pDecoded;
+    int                 m_streamIndex;
+    int                 m_fps;
+    bool                m_eof;
+};
+
+static AVFrame* AllocFrame(int width, int height)
+{
+    AVFrame* pFrame = av_frame_alloc();
+
+    pFrame->format = AV_PIX_FMT_YUV420P;
+    pFrame->width = width;
+    pFrame->height = height;
+    av_frame_get_buffer(pFrame, 32);
+    return pFrame;
+}
+
+static bool RunReplay(const char* pPath, EncoderParameters params, int maxFrames, RunResult* pResult)
+{
+    Replay replay;
+
+    if (!replay.Open(pPath))
+    {
+        printf("Failed to open %s\n", pPath);
+        return false;
+    }
+
+    params.width = replay.Width();
+    params.height = replay.Height();
+    params.fps = replay.Fps();
+    pResult->fps = params.fps;
+
+    VideoEncoder    encoder(params);
+    AVFrame*        pFrame = AllocFrame(params.width, params.height);
+    int64_t         periodUs = 1000000 / params.fps;
+
+    // Synchronous encoder emits on the caller thread, from inside EncodeFrame() or Flush()
+    QObject::connect(&encoder, &VideoEncoder::PacketReady, [pResult, &params](QSharedPointer<AVPacket> pPacket)
+    {
+        Packet packet;
+
+        packet.index = av_rescale_q(pPacket->pts, AV_TIME_BASE_Q, av_make_q(1, params.fps));
+        packet.readyUs = MonotonicTimeUs();
+        packet.size = pPacket->size;
+        packet.key = (0 != (pPacket->flags & AV_PKT_FLAG_KEY));
+        if ((packet.index < 0) || (packet.index >= pResult->sendTimeUs.size()))
+        {
+            return;
+        }
+
+        pResult->packets.append(packet);
+        pResult->bytes += packet.size;
+        pResult->keyPackets += packet.key ? 1 : 0;
+        pResult->packetSizeStat.Add(packet.size);
+        pResult->encodeLatencyStat.Add(packet.readyUs - pResult->sendTimeUs[packet.index]);
+    });
+
+    encoder.Initialize();
+
+    int64_t startUs = MonotonicTimeUs();
+
+    // Paced at the recording frame rate, so the link model sees packets as a live source would give them
+    for (int64_t index = 0; ((0 == maxFrames) || (index < maxFrames)) && replay.NextFrame(pFrame); index++)
+    {
+        SleepUntilUs(startUs + index * periodUs);
+
+        // Encoder only reads the frame, it is rewritten after the call returns
+        pFrame->pts = index;
+        pResult->sendTimeUs.append(MonotonicTimeUs());
+        encoder.EncodeFrame(QSharedPointer<AVFrame>(pFrame, [](AVFrame*){}));
+        pResult->frames++;
+    }
+    encoder.Flush();
+
+    av_frame_free(&pFrame);
+    return pResult->frames > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    if (argc < 2)
+    {
+        printf("Usage: intraRefreshBench <recorded wall> [preset] [crf] [link kbit/s] [frames]\n");
+        return 1;
+    }
+
+    const char* pPath = argv[1];
+    int         preset = PresetGovernor::PresetIndex((argc > 2) ? argv[2] : "veryfast");
+    int         crf = (argc > 3) ? atoi(argv[3]) : 23;
+    double      linkKbps = (argc > 4) ? atof(argv[4]) : 0.0;
+    int         maxFrames = (argc > 5) ? atoi(argv[5]) : 0;
+
+    if (preset < 0)
+    {
+        printf("Unknown preset\n");
+        return 1;
+    }
+
+    EncoderParameters params;
+
+    memset(&params, 0, sizeof(params));
+    params.crf = crf;
+    params.codec = ENCODER_CODEC_H264;
+    params.queueDepth = 0;
+    params.queuePolicy = ENCODER_QUEUE_DROP_OLDEST;
+    params.threads = 0;
+    params.slicedThreads = true;
+    params.lookahead = -1;
+    params.preset = preset;
+    params.slowestPreset = preset;
+    params.adaptivePreset = false;
+
+    RunResult keyframes;
+    RunResult refresh;
+
+    params.intraRefresh = false;
+    if (!RunReplay(pPath, params, maxFrames, &keyframes))
+    {
+        return 1;
+    }
+    params.intraRefresh = true;
+    if (!RunReplay(pPath, params, maxFrames, &refresh))
+    {
+        return 1;
+    }
+
+    linkKbps = (linkKbps > 0.0) ? linkKbps : keyframes.AverageKbps() * BENCH_LINK_HEADROOM;
+    keyframes.SendOverLink(linkKbps);
+    refresh.SendOverLink(linkKbps);
+
+    printf("%s, libx264 preset %s crf %d, link %.0f kbit/s\n", pPath, PresetGovernor::PresetName(preset), crf, linkKbps);
+    printf("%-10s %-8s %-10s %-8s %-10s %-10s %-8s %-12s %-12s %-12s\n",
+           "refresh", "frames", "kbit/s", "key", "avg KB", "max KB", "peak/avg", "enc avg ms", "e2e avg ms", "e2e max ms");
+
+    RunResult* results[2] = {&keyframes, &refresh};
+
+    for (int i = 0; i < 2; i++)
+    {
+        const RunResult& r = *results[i];
+
+        printf("%-10s %-8lld %-10.1f %-8lld %-10.1f %-10.1f %-8.2f %-12.2f %-12.2f %-12.2f\n",
+               i ? "on" : "off",
+               (long long)r.frames,
+               r.AverageKbps(),
+               (long long)r.keyPackets,
+               r.packetSizeStat.Average() / 1024.0,
+               r.packetSizeStat.Max() / 1024.0,
+               r.packetSizeStat.Average() > 0.0 ? r.packetSizeStat.Max() / r.packetSizeStat.Average() : 0.0,
+               r.encodeLatencyStat.Average() / 1000.0,
+               r.endToEndStat.Average() / 1000.0,
+               r.endToEndStat.Max() / 1000.0);
+    }
+
+    return 0;
+}
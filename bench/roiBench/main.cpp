@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <QCoreApplication>
+#include <QVector>
+
+#include "common.h"
+#include "statistics.h"
+#include "videoEncoder.h"
+
+/*
+ * Bitrate and encode time of a recorded mosaic with regions of interest off and on
+ * The recording is decoded and replayed twice through VideoEncoder, exactly the same frames each time.
+ * With ROI on, each frame gets the side data Builder would attach: the picture is split into a rows x cols grid,
+ * a tile whose luma did not move for the static time is coded coarse, the others fine.
+ * Tile activity is judged from the recording itself, as the live per-tile frame times are not recorded.
+ * Usage: roiBench <recorded wall> [rows, 4] [cols, 4] [codec h264|hevc|av1, h264] [preset, veryfast] [crf, 23]
+ *                 [coarse qp, 6] [fine qp, -2] [static ms, 1000] [frames, 0 - whole file]
+*/
+
+#define BENCH_MOTION_THRESHOLD 1.5  // Mean absolute luma difference of a tile that counts as motion, above coding noise
+
+struct RunResult
+{
+    RunResult() : frames(0), packets(0), bytes(0), fineTiles(0), coarseTiles(0), fps(0), pIgnoredBy(NULL) {}
+
+    int64_t     frames;
+    int64_t     packets;
+    int64_t     bytes;
+    RunningStat encodeTimeStat;     /// EncodeFrame() duration, us
+    int64_t     fineTiles;
+    int64_t     coarseTiles;
+    int         fps;
+    const char* pIgnoredBy;
+};
+
+/// Decodes recording into YUV420P frames of its own size
+class Replay
+{
+public:
+    Replay() : m_pFormat(NULL), m_pDecoder(NULL), m_pScaler(NULL), m_pPacket(NULL), m_pDecoded(NULL), m_streamIndex(-1), m_eof(false) {}
+    ~Replay() { Close(); }
+
+    bool Open(const char* pPath)
+    {
+        if ((0 > avformat_open_input(&m_pFormat, pPath, NULL, NULL)) || (0 > avformat_find_stream_info(m_pFormat, NULL)))
+        {
+            return false;
+        }
+        m_streamIndex = av_find_best_stream(m_pFormat, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+        if (0 > m_streamIndex)
+        {
+            return false;
+        }
+
+        AVStream*       pStream = m_pFormat->streams[m_streamIndex];
+        const AVCodec*  pCodec = avcodec_find_decoder(pStream->codecpar->codec_id);
+
+        m_pDecoder = avcodec_alloc_context3(pCodec);
+        avcodec_parameters_to_context(m_pDecoder, pStream->codecpar);
+        if (0 > avcodec_open2(m_pDecoder, pCodec, NULL))
+        {
+            return false;
+        }
+        m_fps = (pStream->avg_frame_rate.num > 0) ? (int)(av_q2d(pStream->avg_frame_rate) + 0.5) : 25;
+        m_pPacket = av_packet_alloc();
+        m_pDecoded = av_frame_alloc();
+        m_eof = false;
+        return true;
+    }
+
+    void Close()
+    {
+        sws_freeContext(m_pScaler);
+        m_pScaler = NULL;
+        av_frame_free(&m_pDecoded);
+        av_packet_free(&m_pPacket);
+        avcodec_free_context(&m_pDecoder);
+        avformat_close_input(&m_pFormat);
+    }
+
+    int Width() const { return m_pDecoder->width & ~1; }
+    int Height() const { return m_pDecoder->height & ~1; }
+    int Fps() const { return m_fps; }
+
+    /// Next picture converted into pFrame. False at end of file
+    bool NextFrame(AVFrame* pFrame)
+    {
+        while (true)
+        {
+            int res = avcodec_receive_frame(m_pDecoder, m_pDecoded);
+
+            if (0 == res)
+            {
+                m_pScaler = sws_getCachedContext(m_pScaler, m_pDecoded->width, m_pDecoded->height, (AVPixelFormat)m_pDecoded->format,
+                                                 pFrame->width, pFrame->height, AV_PIX_FMT_YUV420P, SWS_POINT, NULL, NULL, NULL);
+                sws_scale(m_pScaler, m_pDecoded->data, m_pDecoded->linesize, 0, m_pDecoded->height, pFrame->data, pFrame->linesize);
+                av_frame_unref(m_pDecoded);
+                return true;
+            }
+            if ((AVERROR(EAGAIN) != res) || m_eof)
+            {
+                return false;
+            }
+
+            if (0 > av_read_frame(m_pFormat, m_pPacket))
+            {
+                m_eof = true;
+                avcodec_send_packet(m_pDecoder, NULL);
+                continue;
+            }
+            if (m_pPacket->stream_index == m_streamIndex)
+            {
+                avcodec_send_packet(m_pDecoder, m_pPacket);
+            }
+            av_packet_unref(m_pPacket);
+        }
+    }
+
+private:
+    AVFormatContext*    m_pFormat;
+    AVCodecContext*     m_pDecoder;
+    SwsContext*         m_pScaler;
+    AVPacket*           m_pPacket;
+    AVFrame*            m_pDecoded;
+    int                 m_streamIndex;
+    int                 m_fps;
+    bool                m_eof;
+};
+
+static AVFrame* AllocFrame(int width, int height)
+{
+    AVFrame* pFrame = av_frame_alloc();
+
+    pFrame->format = AV_PIX_FMT_YUV420P;
+    pFrame->width = width;
+    pFrame->height = height;
+    av_frame_get_buffer(pFrame, 32);
+    return pFrame;
+}
+
+static double TileMotion(const AVFrame* pA, const AVFrame* pB, int x, int y, int width, int height)
+{
+    int64_t sum = 0;
+    int64_t count = 0;
+
+    // Every other row and column is enough to tell motion from noise
+    for (int row = y; row < y + height; row += 2)
+    {
+        const uint8_t* pRowA = pA->data[0] + row * pA->linesize[0];
+        const uint8_t* pRowB = pB->data[0] + row * pB->linesize[0];
+
+        for (int col = x; col < x + width; col += 2)
+        {
+            sum += abs(pRowA[col] - pRowB[col]);
+            count++;
+        }
+    }
+    return count ? (double)sum / count : 0.0;
+}
+
+static void AddRegion(QVector<AVRegionOfInterest>* pRegions, int x, int y, int width, int height, int qp)
+{
+    if (0 == qp)
+    {
+        return;
+    }
+
+    AVRegionOfInterest region;
+
+    // Same as Builder::AddRegion
+    region.self_size = sizeof(AVRegionOfInterest);
+    region.top = y;
+    region.bottom = y + height;
+    region.left = x;
+    region.right = x + width;
+    region.qoffset = av_make_q(qp, 51);
+    pRegions->append(region);
+}
+
+static bool RunReplay(const char* pPath, bool roi, EncoderParameters params, int rows, int cols,
+                      int coarseQp, int fineQp, int staticMs, int maxFrames, RunResult* pResult)
+{
+    Replay replay;
+
+    if (!replay.Open(pPath))
+    {
+        printf("Failed to open %s\n", pPath);
+        return false;
+    }
+
+    params.width = replay.Width();
+    params.height = replay.Height();
+    params.fps = replay.Fps();
+
+    VideoEncoder                encoder(params);
+    AVFrame*                    pFrame = AllocFrame(params.width, params.height);
+    AVFrame*                    pPrevious = AllocFrame(params.width, params.height);
+    QVector<int64_t>            stillFrames(rows * cols, 0);
+    QVector<AVRegionOfInterest> regions;
+    int64_t                     staticFrames = (int64_t)staticMs * params.fps / 1000;
+
+    pResult->fps = params.fps;
+
+    QObject::connect(&encoder, &VideoEncoder::PacketReady, [pResult](QSharedPointer<AVPacket> pPacket)
+    {
+        pResult->packets++;
+        pResult->bytes += pPacket->size;
+    });
+
+    encoder.Initialize();
+    pResult->pIgnoredBy = encoder.RegionsIgnoredBy();
+
+    for (int64_t index = 0; ((0 == maxFrames) || (index < maxFrames)) && replay.NextFrame(pFrame); index++)
+    {
+        av_frame_remove_side_data(pFrame, AV_FRAME_DATA_REGIONS_OF_INTEREST);
+
+        if (roi)
+        {
+            regions.clear();
+            for (int tile = 0; tile < rows * cols; tile++)
+            {
+                int x = (tile % cols) * params.width / cols & ~1;
+                int y = (tile / cols) * params.height / rows & ~1;
+                int width = ((tile % cols + 1) * params.width / cols & ~1) - x;
+                int height = ((tile / cols + 1) * params.height / rows & ~1) - y;
+
+                bool moved = (0 == index) || (TileMotion(pFrame, pPrevious, x, y, width, height) > BENCH_MOTION_THRESHOLD);
+                stillFrames[tile] = moved ? 0 : stillFrames[tile] + 1;
+
+                bool coarse = stillFrames[tile] > staticFrames;
+                AddRegion(&regions, x, y, width, height, coarse ? coarseQp : fineQp);
+                pResult->coarseTiles += coarse ? 1 : 0;
+                pResult->fineTiles += coarse ? 0 : 1;
+            }
+
+            AVFrameSideData* pSideData = regions.isEmpty() ? NULL :
+                                         av_frame_new_side_data(pFrame, AV_FRAME_DATA_REGIONS_OF_INTEREST, regions.size() * sizeof(AVRegionOfInterest));
+            if (NULL != pSideData)
+            {
+                memcpy(pSideData->data, regions.constData(), regions.size() * sizeof(AVRegionOfInterest));
+            }
+            av_frame_copy(pPrevious, pFrame);
+        }
+
+        // Encoder only reads the frame, it is rewritten after the call returns
+        pFrame->pts = index;
+
+        int64_t startUs = MonotonicTimeUs();
+        encoder.EncodeFrame(QSharedPointer<AVFrame>(pFrame, [](AVFrame*){}));
+        pResult->encodeTimeStat.Add(MonotonicTimeUs() - startUs);
+        pResult->frames++;
+    }
+    encoder.Flush();
+
+    av_frame_free(&pFrame);
+    av_frame_free(&pPrevious);
+    return pResult->frames > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    if (argc < 2)
+    {
+        printf("Usage: roiBench <recorded wall> [rows] [cols] [codec] [preset] [crf] [coarse qp] [fine qp] [static ms] [frames]\n");
+        return 1;
+    }
+
+    const char* pPath = argv[1];
+    int         rows = (argc > 2) ? atoi(argv[2]) : 4;
+    int         cols = (argc > 3) ? atoi(argv[3]) : 4;
+    QString     codec = (argc > 4) ? argv[4] : "h264";
+    int         preset = PresetGovernor::PresetIndex((argc > 5) ? argv[5] : "veryfast");
+    int         crf = (argc > 6) ? atoi(argv[6]) : 23;
+    int         coarseQp = (argc > 7) ? atoi(argv[7]) : 6;
+    int         fineQp = (argc > 8) ? atoi(argv[8]) : -2;
+    int         staticMs = (argc > 9) ? atoi(argv[9]) : 1000;
+    int         maxFrames = (argc > 10) ? atoi(argv[10]) : 0;
+
+    if ((rows < 1) || (cols < 1) || (preset < 0))
+    {
+        printf("Bad grid or unknown preset\n");
+        return 1;
+    }
+
+    EncoderParameters params;
+
+    memset(&params, 0, sizeof(params));
+    params.crf = crf;
+    params.codec = (codec == "hevc") ? ENCODER_CODEC_HEVC : (codec == "av1") ? ENCODER_CODEC_AV1 : ENCODER_CODEC_H264;
+    params.queueDepth = 0;
+    params.queuePolicy = ENCODER_QUEUE_DROP_OLDEST;
+    params.threads = 0;
+    params.slicedThreads = true;
+    params.lookahead = -1;
+    params.preset = preset;
+    params.slowestPreset = preset;
+    params.adaptivePreset = false;
+    params.intraRefresh = false;
+
+    RunResult off;
+    RunResult on;
+
+    if (!RunReplay(pPath, false, params, rows, cols, coarseQp, fineQp, staticMs, maxFrames, &off) ||
+        !RunReplay(pPath, true, params, rows, cols, coarseQp, fineQp, staticMs, maxFrames, &on))
+    {
+        return 1;
+    }
+
+    printf("%s, %dx%d grid, %s preset %s crf %d, qp coarse %+d fine %+d, static after %d ms\n",
+           pPath, rows, cols, codec.toUtf8().constData(), PresetGovernor::PresetName(preset), crf, coarseQp, fineQp, staticMs);
+    if (NULL != on.pIgnoredBy)
+    {
+        printf("Regions of interest are ignored by %s, both runs should match\n", on.pIgnoredBy);
+    }
+    printf("%-6s %-8s %-12s %-12s %-12s %-12s %-10s\n", "roi", "frames", "kbit/s", "enc avg ms", "enc max ms", "KB/frame", "coarse %");
+
+    RunResult* results[2] = {&off, &on};
+
+    for (int i = 0; i < 2; i++)
+    {
+        const RunResult& r = *results[i];
+
+        printf("%-6s %-8lld %-12.1f %-12.2f %-12.2f %-12.1f %-10.1f\n",
+               i ? "on" : "off",
+               (long long)r.frames,
+               r.bytes * 8.0 * r.fps / 1000.0 / FFMAX(1, r.frames),
+               r.encodeTimeStat.Average() / 1000.0,
+               r.encodeTimeStat.Max() / 1000.0,
+               r.bytes / 1024.0 / FFMAX(1, r.frames),
+               100.0 * r.coarseTiles / FFMAX(1, r.coarseTiles + r.fineTiles));
+    }
+    printf("Bitrate with ROI %.1f%% of without, encode time %.1f%%\n",
+           100.0 * on.bytes / FFMAX(1, off.bytes),
+           100.0 * on.encodeTimeStat.Sum() / FFMAX(1, off.encodeTimeStat.Sum()));
+
+    return 0;
+}
@@ -18,7 +18,20 @@ SOURCES += ../src/main.cpp \
     ../src/stream.cpp \
     ../src/builder.cpp \
     ../src/videoScaler.cpp \
-    ../src/videoEncoder.cpp
+    ../src/videoEncoder.cpp \
+    ../src/statistics.cpp \
+    ../src/packetQueue.cpp \
+    ../src/decoderPool.cpp \
+    ../src/framePool.cpp \
+    ../src/canvas.cpp \
+    ../src/boxScaler.cpp \
+    ../src/composePool.cpp \
+    ../src/layout.cpp \
+    ../src/font.cpp \
+    ../src/planeKernels.cpp \
+    ../src/overlay.cpp \
+    ../src/placeholder.cpp \
+    ../src/presetGovernor.cpp
 
 HEADERS += \
     ../src/errorHandler.h \
@@ -29,10 +42,23 @@ HEADERS += \
     ../src/common.h \
     ../src/builder.h \
     ../src/videoScaler.h \
-    ../src/videoEncoder.h
+    ../src/videoEncoder.h \
+    ../src/statistics.h \
+    ../src/spscQueue.h \
+    ../src/packetQueue.h \
+    ../src/decoderPool.h \
+    ../src/framePool.h \
+    ../src/canvas.h \
+    ../src/boxScaler.h \
+    ../src/composePool.h \
+    ../src/layout.h \
+    ../src/font.h \
+    ../src/planeKernels.h \
+    ../src/overlay.h \
+    ../src/placeholder.h \
+    ../src/presetGovernor.h
 
 QMAKE_CXXFLAGS += -std=c++11
 
 LIBS +=  -L/usr/lib
 LIBS +=  -lavformat -lavcodec -lavutil -lswresample -lswscale -lxcb-xfixes -lxcb-render -lxcb-shape -lxcb -lX11 -lx264 -lm -lz
-LIBS +=  -lopencv_core
@@ -0,0 +1,315 @@
+#include "boxScaler.h"
+
+extern "C" {
+#include <libavutil/cpu.h>
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BOX_SCALER_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define BOX_SCALER_NEON
+#include <arm_neon.h>
+#endif
+
+#define BOX_SCALER_MAX_RATIO 4
+
+// Produces dstWidth pixels of one output row from ratio rows of source
+typedef void (*BoxRowFunc)(const uint8_t* pSrc, int srcStride, uint8_t* pDst, int dstWidth);
+
+template <int R>
+static void BoxRowC(const uint8_t* pSrc, int srcStride, uint8_t* pDst, int dstWidth)
+{
+    for (int x = 0; x < dstWidth; x++)
+    {
+        const uint8_t*  p = pSrc + x * R;
+        int             sum = 0;
+
+        for (int j = 0; j < R; j++)
+        {
+            for (int i = 0; i < R; i++)
+            {
+                sum += p[i];
+            }
+            p += srcStride;
+        }
+        pDst[x] = (uint8_t)((sum + R * R / 2) / (R * R));
+    }
+}
+
+#ifdef BOX_SCALER_X86
+
+// Sums of horizontal byte pairs as 16-bit lanes
+static inline __m128i PairSumsSSE2(__m128i v)
+{
+    return _mm_add_epi16(_mm_and_si128(v, _mm_set1_epi16(0x00FF)), _mm_srli_epi16(v, 8));
+}
+
+static void BoxRow2SSE2(const uint8_t* pSrc, int srcStride, uint8_t* pDst, int dstWidth)
+{
+    const uint8_t*  pRow0 = pSrc;
+    const uint8_t*  pRow1 = pSrc + srcStride;
+    const __m128i   round = _mm_set1_epi16(2);
+    int             x = 0;
+
+    for (; x + 16 <= dstWidth; x += 16)
+    {
+        __m128i s0 = _mm_add_epi16(PairSumsSSE2(_mm_loadu_si128((const __m128i*)(pRow0 + 2 * x))),
+                                   PairSumsSSE2(_mm_loadu_si128((const __m128i*)(pRow1 + 2 * x))));
+        __m128i s1 = _mm_add_epi16(PairSumsSSE2(_mm_loadu_si128((const __m128i*)(pRow0 + 2 * x + 16))),
+                                   PairSumsSSE2(_mm_loadu_si128((const __m128i*)(pRow1 + 2 * x + 16))));
+
+        s0 = _mm_srli_epi16(_mm_add_epi16(s0, round), 2);
+        s1 = _mm_srli_epi16(_mm_add_epi16(s1, round), 2);
+        _mm_storeu_si128((__m128i*)(pDst + x), _mm_packus_epi16(s0, s1));
+    }
+    BoxRowC<2>(pSrc + 2 * x, srcStride, pDst + x, dstWidth - x);
+}
+
+static void BoxRow4SSE2(const uint8_t* pSrc, int srcStride, uint8_t* pDst, int dstWidth)
+{
+    const __m128i   round = _mm_set1_epi32(8);
+    const __m128i   lowMask = _mm_set1_epi32(0x0000FFFF);
+    int             x = 0;
+
+    for (; x + 16 <= dstWidth; x += 16)
+    {
+        __m128i quads[4];
+
+        // Each 16 source bytes of a row give 4 output pixels
+        for (int k = 0; k < 4; k++)
+        {
+            const uint8_t*  p = pSrc + 4 * x + 16 * k;
+            __m128i         pairs = PairSumsSSE2(_mm_loadu_si128((const __m128i*)p));
+
+            pairs = _mm_add_epi16(pairs, PairSumsSSE2(_mm_loadu_si128((const __m128i*)(p + srcStride))));
+            pairs = _mm_add_epi16(pairs, PairSumsSSE2(_mm_loadu_si128((const __m128i*)(p + 2 * srcStride))));
+            pairs = _mm_add_epi16(pairs, PairSumsSSE2(_mm_loadu_si128((const __m128i*)(p + 3 * srcStride))));
+
+            quads[k] = _mm_add_epi32(_mm_and_si128(pairs, lowMask), _mm_srli_epi32(pairs, 16));
+            quads[k] = _mm_srli_epi32(_mm_add_epi32(quads[k], round), 4);
+        }
+        _mm_storeu_si128((__m128i*)(pDst + x), _mm_packus_epi16(_mm_packs_epi32(quads[0], quads[1]),
+                                                                 _mm_packs_epi32(quads[2], quads[3])));
+    }
+    BoxRowC<4>(pSrc + 4 * x, srcStride, pDst + x, dstWidth - x);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i PairSumsAVX2(__m256i v)
+{
+    return _mm256_add_epi16(_mm256_and_si256(v, _mm256_set1_epi16(0x00FF)), _mm256_srli_epi16(v, 8));
+}
+
+__attribute__((target("avx2")))
+static void BoxRow2AVX2(const uint8_t* pSrc, int srcStride, uint8_t* pDst, int dstWidth)
+{
+    const uint8_t*  pRow0 = pSrc;
+    const uint8_t*  pRow1 = pSrc + srcStride;
+    const __m256i   round = _mm256_set1_epi16(2);
+    int             x = 0;
+
+    for (; x + 32 <= dstWidth; x += 32)
+    {
+        __m256i s0 = _mm256_add_epi16(PairSumsAVX2(_mm256_loadu_si256((const __m256i*)(pRow0 + 2 * x))),
+                                      PairSumsAVX2(_mm256_loadu_si256((const __m256i*)(pRow1 + 2 * x))));
+        __m256i s1 = _mm256_add_epi16(PairSumsAVX2(_mm256_loadu_si256((const __m256i*)(pRow0 + 2 * x + 32))),
+                                      PairSumsAVX2(_mm256_loadu_si256((const __m256i*)(pRow1 + 2 * x + 32))));
+
+        s0 = _mm256_srli_epi16(_mm256_add_epi16(s0, round), 2);
+        s1 = _mm256_srli_epi16(_mm256_add_epi16(s1, round), 2);
+
+        // Pack works within 128-bit lanes, restore pixel order afterwards
+        _mm256_storeu_si256((__m256i*)(pDst + x), _mm256_permute4x64_epi64(_mm256_packus_epi16(s0, s1), 0xD8));
+    }
+    BoxRowC<2>(pSrc + 2 * x, srcStride, pDst + x, dstWidth - x);
+}
+
+__attribute__((target("avx2")))
+static void BoxRow4AVX2(const uint8_t* pSrc, int srcStride, uint8_t* pDst, int dstWidth)
+{
+    const __m256i   round = _mm256_set1_epi32(8);
+    const __m256i   lowMask = _mm256_set1_epi32(0x0000FFFF);
+    const __m256i   order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    int             x = 0;
+
+    for (; x + 32 <= dstWidth; x += 32)
+    {
+        __m256i quads[4];
+
+        // Each 32 source bytes of a row give 8 output pixels
+        for (int k = 0; k < 4; k++)
+        {
+            const uint8_t*  p = pSrc + 4 * x + 32 * k;
+            __m256i         pairs = PairSumsAVX2(_mm256_loadu_si256((const __m256i*)p));
+
+            pairs = _mm256_add_epi16(pairs, PairSumsAVX2(_mm256_loadu_si256((const __m256i*)(p + srcStride))));
+            pairs = _mm256_add_epi16(pairs, PairSumsAVX2(_mm256_loadu_si256((const __m256i*)(p + 2 * srcStride))));
+            pairs = _mm256_add_epi16(pairs, PairSumsAVX2(_mm256_loadu_si256((const __m256i*)(p + 3 * srcStride))));
+
+            quads[k] = _mm256_add_epi32(_mm256_and_si256(pairs, lowMask), _mm256_srli_epi32(pairs, 16));
+            quads[k] = _mm256_srli_epi32(_mm256_add_epi32(quads[k], round), 4);
+        }
+
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(quads[0], quads[1]),
+                                             _mm256_packs_epi32(quads[2], quads[3]));
+
+        _mm256_storeu_si256((__m256i*)(pDst + x), _mm256_permutevar8x32_epi32(packed, order));
+    }
+    BoxRowC<4>(pSrc + 4 * x, srcStride, pDst + x, dstWidth - x);
+}
+
+#endif // BOX_SCALER_X86
+
+#ifdef BOX_SCALER_NEON
+
+static void BoxRow2NEON(const uint8_t* pSrc, int srcStride, uint8_t* pDst, int dstWidth)
+{
+    const uint8_t*  pRow0 = pSrc;
+    const uint8_t*  pRow1 = pSrc + srcStride;
+    int             x = 0;
+
+    for (; x + 16 <= dstWidth; x += 16)
+    {
+        uint16x8_t s0 = vpadalq_u8(vpaddlq_u8(vld1q_u8(pRow0 + 2 * x)), vld1q_u8(pRow1 + 2 * x));
+        uint16x8_t s1 = vpadalq_u8(vpaddlq_u8(vld1q_u8(pRow0 + 2 * x + 16)), vld1q_u8(pRow1 + 2 * x + 16));
+
+        vst1q_u8(pDst + x, vcombine_u8(vrshrn_n_u16(s0, 2), vrshrn_n_u16(s1, 2)));
+    }
+    BoxRowC<2>(pSrc + 2 * x, srcStride, pDst + x, dstWidth - x);
+}
+
+static void BoxRow4NEON(const uint8_t* pSrc, int srcStride, uint8_t* pDst, int dstWidth)
+{
+    int x = 0;
+
+    for (; x + 8 <= dstWidth; x += 8)
+    {
+        const uint8_t*  p = pSrc + 4 * x;
+        uint16x8_t      s0 = vpaddlq_u8(vld1q_u8(p));
+        uint16x8_t      s1 = vpaddlq_u8(vld1q_u8(p + 16));
+
+        for (int j = 1; j < 4; j++)
+        {
+            s0 = vpadalq_u8(s0, vld1q_u8(p + j * srcStride));
+            s1 = vpadalq_u8(s1, vld1q_u8(p + j * srcStride + 16));
+        }
+
+        uint16x8_t q = vcombine_u16(vrshrn_n_u32(vpaddlq_u16(s0), 4), vrshrn_n_u32(vpaddlq_u16(s1), 4));
+
+        vst1_u8(pDst + x, vmovn_u16(q));
+    }
+    BoxRowC<4>(pSrc + 4 * x, srcStride, pDst + x, dstWidth - x);
+}
+
+#endif // BOX_SCALER_NEON
+
+struct BoxKernels
+{
+    BoxKernels()
+    {
+        int flags = av_get_cpu_flags();
+
+        name = "c";
+        rows[2] = &BoxRowC<2>;
+        rows[3] = &BoxRowC<3>;
+        rows[4] = &BoxRowC<4>;
+
+#ifdef BOX_SCALER_X86
+        if (flags & AV_CPU_FLAG_AVX2)
+        {
+            name = "avx2";
+            rows[2] = &BoxRow2AVX2;
+            rows[4] = &BoxRow4AVX2;
+        }
+        else if (flags & AV_CPU_FLAG_SSE2)
+        {
+            name = "sse2";
+            rows[2] = &BoxRow2SSE2;
+            rows[4] = &BoxRow4SSE2;
+        }
+#endif
+#ifdef BOX_SCALER_NEON
+        if (flags & AV_CPU_FLAG_NEON)
+        {
+            name = "neon";
+            rows[2] = &BoxRow2NEON;
+            rows[4] = &BoxRow4NEON;
+        }
+#endif
+        (void)flags;
+    }
+
+    const char* name;
+    BoxRowFunc  rows[BOX_SCALER_MAX_RATIO + 1];
+};
+
+static const BoxKernels& Kernels()
+{
+    static BoxKernels kernels;  // Selected once, on first use
+    return kernels;
+}
+
+int BoxScaleRatio(const AVFrame* pInFrame, const AVFrame* pOutFrame)
+{
+    if (((pInFrame->format != AV_PIX_FMT_YUV420P) && (pInFrame->format != AV_PIX_FMT_YUVJ420P)) ||
+        (pOutFrame->format != AV_PIX_FMT_YUV420P) ||
+        (pOutFrame->width <= 0) || (pOutFrame->height <= 0) ||
+        (pOutFrame->width & 1) || (pOutFrame->height & 1))
+    {
+        return 0;
+    }
+
+    for (int ratio = 2; ratio <= BOX_SCALER_MAX_RATIO; ratio++)
+    {
+        int cropX = pInFrame->width - pOutFrame->width * ratio;
+        int cropY = pInFrame->height - pOutFrame->height * ratio;
+
+        // Allow cropping what target size rounding (multiple of 4) has cut off
+        if ((cropX >= 0) && (cropX < 4 * ratio) && (cropY >= 0) && (cropY < 4 * ratio))
+        {
+            return ratio;
+        }
+    }
+    return 0;
+}
+
+static void BoxScalePlanes(const AVFrame* pInFrame, AVFrame* pOutFrame, int ratio, BoxRowFunc rowFunc)
+{
+    int         cropX = ((pInFrame->width - pOutFrame->width * ratio) >> 1) & ~1;
+    int         cropY = ((pInFrame->height - pOutFrame->height * ratio) >> 1) & ~1;
+
+    for (int plane = 0; plane < 3; plane++)
+    {
+        int             shift = (plane == 0) ? 0 : 1;
+        int             srcStride = pInFrame->linesize[plane];
+        int             dstWidth = pOutFrame->width >> shift;
+        int             dstHeight = pOutFrame->height >> shift;
+        const uint8_t*  pSrc = pInFrame->data[plane] + (cropY >> shift) * srcStride + (cropX >> shift);
+        uint8_t*        pDst = pOutFrame->data[plane];
+
+        for (int y = 0; y < dstHeight; y++)
+        {
+            rowFunc(pSrc, srcStride, pDst, dstWidth);
+            pSrc += ratio * srcStride;
+            pDst += pOutFrame->linesize[plane];
+        }
+    }
+}
+
+void BoxScaleFrame(const AVFrame* pInFrame, AVFrame* pOutFrame, int ratio)
+{
+    BoxScalePlanes(pInFrame, pOutFrame, ratio, Kernels().rows[ratio]);
+}
+
+void BoxScaleFrameC(const AVFrame* pInFrame, AVFrame* pOutFrame, int ratio)
+{
+    static const BoxRowFunc s_rows[BOX_SCALER_MAX_RATIO + 1] = {NULL, NULL, &BoxRowC<2>, &BoxRowC<3>, &BoxRowC<4>};
+
+    BoxScalePlanes(pInFrame, pOutFrame, ratio, s_rows[ratio]);
+}
+
+const char* BoxScaleImplementation()
+{
+    return Kernels().name;
+}
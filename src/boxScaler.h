@@ -0,0 +1,18 @@
+#ifndef BOXSCALER_H
+#define BOXSCALER_H
+
+#include "common.h"
+
+/*
+ * Box filter downscaling of YUV420P frames by integer ratio (1/2, 1/3, 1/4)
+ * Fast path for the most common tile sizes (e.g. 1920x1080 -> 480x270).
+ * Up to a few source pixels are cropped symmetrically, when target size was rounded down.
+ * Row kernels (AVX2, SSE2, NEON or plain C) are selected at runtime from cpu features.
+*/
+
+int         BoxScaleRatio(const AVFrame* pInFrame, const AVFrame* pOutFrame);   /// Ratio usable for these frames, 0 if none
+void        BoxScaleFrame(const AVFrame* pInFrame, AVFrame* pOutFrame, int ratio);
+void        BoxScaleFrameC(const AVFrame* pInFrame, AVFrame* pOutFrame, int ratio);    /// Plain C kernels, reference for the selected ones
+const char* BoxScaleImplementation();                                           /// Name of selected kernels
+
+#endif // BOXSCALER_H
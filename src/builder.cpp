@@ -1,88 +1,693 @@
 #include "builder.h"
 
-#include <opencv2/core/core.hpp>
+#include "planeKernels.h"
 
 Builder::Builder(BuilderParameters parameters) :
     QObject(NULL),
+    pCanvas(NULL),
     m_params(parameters),
-    m_pResultFrame(NULL)
+    m_ownerName(parameters.name.isEmpty() ? QByteArray("Builder") : ("Builder " + parameters.name).toUtf8()),
+    m_writeIndex(0),
+    m_pResultFrame(NULL),
+    m_pThread(NULL),
+    m_pComposePool(NULL),
+    m_pOverlay(NULL),
+    m_stop(0),
+    m_statsStartUs(MonotonicTimeUs()),
+    m_missedDeadlines(0),
+    m_unchangedTicks(0),
+    m_lastBuiltUs(0),
+    m_tilesCarried(0),
+    m_bytesCarried(0),
+    m_buffersBusy(0),
+    m_startUs(0)
 {
-    m_pResultFrame = av_frame_alloc();
+    const OverlayParameters& overlay = parameters.overlay;
 
-    // Allocate memory for result frame
-    m_pResultFrame->format = AV_PIX_FMT_YUV420P;
-    m_pResultFrame->width = parameters.outWidth;
-    m_pResultFrame->height = parameters.outHeight;
+    if ((overlay.borderWidth > 0) || overlay.showNames || overlay.showClock)
+    {
+        m_pOverlay = new Overlay(parameters.layout, overlay);
+    }
 
-    if (0 > av_frame_get_buffer(m_pResultFrame, 32))  // allocates aligned buffer for y,u,v planes
+    if (COMPOSE_MODE_ZEROCOPY == parameters.composeMode)
     {
-        ERROR_MESSAGE0(ERR_TYPE_ERROR, "Builder", "Failed to alocate frame buffer");
+        // Each camera gets its layout tile as canvas tile (layout has no overlaps in this mode)
+        // Encoder thread holds up to queue depth frames plus the one being encoded, streams need one more to write
+        int numBuffers = parameters.canvasBuffers;
+        if ((parameters.encoder.queueDepth > 0) && (numBuffers < parameters.encoder.queueDepth + 2))
+        {
+            numBuffers = parameters.encoder.queueDepth + 2;
+            ERROR_MESSAGE2(ERR_TYPE_WARNING, m_ownerName.constData(), "Canvas buffers raised to %d for encoder queue depth %d",
+                           numBuffers, parameters.encoder.queueDepth);
+        }
+        pCanvas = new Canvas(parameters.outWidth, parameters.outHeight, numBuffers);
+
+        for (int i = 0; i < parameters.layout.NumTiles(); i++)
+        {
+            const LayoutRect& rect = parameters.layout.TileRect(i);
+            pCanvas->AddTile(rect.x, rect.y, rect.width, rect.height);
+        }
+        pCanvas->SetOverlay(m_pOverlay);
     }
+    else
+    {
+        // Queued frames are composed into buffers of their own, tiles are brought up to date in the next write buffer
+        // the same way canvas carries them over. Synchronous encoder is done with the frame before the next tick
+        int numBuffers = (parameters.encoder.queueDepth > 0) ? parameters.encoder.queueDepth + 2 : 1;
+        m_resultBuffers.resize(numBuffers);
 
-    m_pProcessingTimer = new QTimer;
-    m_pProcessingTimer->setTimerType(Qt::PreciseTimer);
-    m_pProcessingTimer->setInterval((int)(1000.0f / (float)parameters.fps + 0.5f));
-    QObject::connect(m_pProcessingTimer, SIGNAL(timeout()), this, SLOT(BuildFrame()));
+        for (int i = 0; i < numBuffers; i++)
+        {
+            ResultBuffer&   buffer = m_resultBuffers[i];
+            AVFrame*        pFrame = av_frame_alloc();
+
+            // Allocate memory for result frame
+            pFrame->format = AV_PIX_FMT_YUV420P;
+            pFrame->width = parameters.outWidth;
+            pFrame->height = parameters.outHeight;
+
+            buffer.pFrame = pFrame;
+            buffer.inUse.store(0);
+            buffer.tileGen.fill(0, parameters.layout.NumTiles());
+            buffer.tileWidth.fill(0, parameters.layout.NumTiles());
+            buffer.tileHeight.fill(0, parameters.layout.NumTiles());
+
+            if (0 > av_frame_get_buffer(pFrame, 32))  // allocates aligned buffer for y,u,v planes
+            {
+                ERROR_MESSAGE0(ERR_TYPE_ERROR, m_ownerName.constData(), "Failed to alocate frame buffer");
+                continue;
+            }
 
-    pEncoder = new VideoEncoder(parameters.outWidth, parameters.outHeight, parameters.fps, parameters.crf);
-    QObject::connect(this, SIGNAL(FrameBuilt(AVFrame*)), pEncoder, SLOT(EncodeFrame(AVFrame*)));
+            // Result frames are kept between ticks, background is drawn only once
+            m_pResultFrame = pFrame;
+            FillRect(0, 0, pFrame->width, pFrame->height);
+
+            // Tiles without source still get their borders and names
+            for (int tile = 0; (NULL != m_pOverlay) && (tile < parameters.layout.NumTiles()); tile++)
+            {
+                m_pOverlay->BlendTile(pFrame, tile, LayoutRect(), true);
+            }
+        }
+        m_pResultFrame = m_resultBuffers[m_writeIndex].pFrame;
+
+        m_tileStates.resize(parameters.layout.NumTiles());
+        m_pComposePool = new ComposePool(parameters.composeThreads);
+    }
+
+    m_sourceStates.resize(parameters.layout.NumTiles());
+
+    m_roiPinned.fill(false, parameters.layout.NumTiles());
+    for (int i = 0; i < parameters.roiPinnedTiles.size(); i++)
+    {
+        int tile = parameters.roiPinnedTiles[i];
+
+        if ((tile >= 0) && (tile < m_roiPinned.size()))
+        {
+            m_roiPinned[tile] = true;
+        }
+    }
+    memset(m_roiTiles, 0, sizeof(m_roiTiles));
+    m_roiLetterboxes = 0;
+    m_pRoiIgnoredBy = NULL;
+    m_pThread = new CompositorThread(this);
+
+    EncoderParameters encoder = parameters.encoder;
+    encoder.width = parameters.outWidth;
+    encoder.height = parameters.outHeight;
+    encoder.fps = parameters.fps;
+    encoder.crf = parameters.crf;
+    encoder.codec = parameters.codec;
+    pEncoder = new VideoEncoder(encoder);
+
+    // Encoder either encodes right away or queues the frame for its own thread, it never blocks on the queue
+    QObject::connect(this, SIGNAL(FrameBuilt(QSharedPointer<AVFrame>)), pEncoder, SLOT(EncodeFrame(QSharedPointer<AVFrame>)), Qt::DirectConnection);
+    QObject::connect(this, SIGNAL(FrameSkipped()), pEncoder, SLOT(SkipFrame()), Qt::DirectConnection);
 }
 
 Builder::~Builder()
 {
-    ERROR_MESSAGE0(ERR_TYPE_MESSAGE, "Builder", "~Builder() called");
-    if (m_pResultFrame)
+    ERROR_MESSAGE0(ERR_TYPE_MESSAGE, m_ownerName.constData(), "~Builder() called");
+    Stop();
+
+    // Encoder queue may still reference canvas buffers
+    delete pEncoder;
+    for (int i = 0; i < m_resultBuffers.size(); i++)
     {
-        av_frame_unref(m_pResultFrame);
-        av_frame_free(&m_pResultFrame);
+        av_frame_free(&m_resultBuffers[i].pFrame);
     }
-    delete pEncoder;
-    delete m_pProcessingTimer;
+    delete m_pThread;
+    delete m_pComposePool;
+    delete pCanvas;
+    delete m_pOverlay;
+}
+
+void Builder::Start()
+{
+    m_stop.storeRelease(0);
+    pEncoder->Start();
+    m_pThread->start();
+}
+
+void Builder::Stop()
+{
+    // Compositor notices the flag at the next tick
+    m_stop.storeRelease(1);
+    m_pThread->wait();
+    pEncoder->Stop();
+}
+
+void Builder::ComposeLoop()
+{
+    int64_t startUs = MonotonicTimeUs();
+    int64_t tick = 0;
+
+    m_startUs = startUs;
+
+    ERROR_MESSAGE1(ERR_TYPE_MESSAGE, m_ownerName.constData(), "Compositor started, %d fps", m_params.fps);
+
+    while (!m_stop.loadAcquire())
+    {
+        // Deadlines are computed from the start time, so rounding never accumulates
+        int64_t deadlineUs = startUs + tick * 1000000 / m_params.fps;
+
+        SleepUntilUs(deadlineUs);
+
+        int64_t wakeUs = MonotonicTimeUs();
+        m_tickJitterStat.Add(wakeUs - deadlineUs);
+
+        BuildFrame(tick, deadlineUs);
+
+        int64_t doneUs = MonotonicTimeUs();
+        m_buildTimeStat.Add(doneUs - wakeUs);
+        ReportStatistics(doneUs);
+
+        // Overrun: deadlines already passed are skipped instead of building frames back to back
+        tick++;
+        int64_t dueTick = (doneUs - startUs) * m_params.fps / 1000000;
+        if (dueTick > tick)
+        {
+            m_missedDeadlines += dueTick - tick;
+            tick = dueTick;
+        }
+    }
+
+    // Synchronous encoder runs on this thread, delayed packets must follow the ones emitted from here
+    pEncoder->Flush();
+
+    ERROR_MESSAGE0(ERR_TYPE_MESSAGE, m_ownerName.constData(), "Compositor stopped");
 }
 
-void Builder::BuildFrame()
+void Builder::BuildFrame(int64_t tick, int64_t tickUs)
 {
-    // Make current frame black first
-    memset(m_pResultFrame->data[0], 16, m_pResultFrame->height * m_pResultFrame->linesize[0]);
-    memset(m_pResultFrame->data[1], 128,  (m_pResultFrame->height >> 1) * m_pResultFrame->linesize[1]);
-    memset(m_pResultFrame->data[2], 128,  (m_pResultFrame->height >> 1) * m_pResultFrame->linesize[1]);
+    UpdateSourceStates(tickUs);
 
-    for (int camY = 0; camY < m_params.numCamsY; camY++)
+    // Tiles are already drawn by streams
+    if (NULL != pCanvas)
     {
-        for (int camX = 0; camX < m_params.numCamsX; camX++)
+        // Placeholder is drawn once, it is carried over between canvas buffers and replaced by the stream when it comes back
+        for (int tile = 0; tile < m_sourceStates.size(); tile++)
         {
-            // If we have source for current position - read frame from it
-            if (!sources[camY*m_params.numCamsX + camX].isNull())
+            SourceState&            state = m_sourceStates[tile];
+            QSharedPointer<AVFrame> pPlaceholder = Placeholder(tile);
+
+            if (!pPlaceholder.isNull() && !state.placeholderDrawn)
             {
-                DrawFrameOnTarget(sources[camY*m_params.numCamsX + camX]->GetFrame(), camX, camY);
+                state.placeholderDrawn = pCanvas->WritePlaceholder(tile, pPlaceholder.data());
             }
         }
+
+        // Nothing to carry over or encode, write buffer simply stays the same
+        bool changed = pCanvas->HasUpdates() || ((NULL != m_pOverlay) && m_pOverlay->ClockChanged());
+        if (SkipTick(changed, tickUs))
+        {
+            return;
+        }
+
+        QSharedPointer<AVFrame> pFrame = pCanvas->Publish();
+
+        if (NULL != m_pOverlay)
+        {
+            m_pOverlay->DrawClock(pFrame.data());
+        }
+        AttachRegions(pFrame.data());
+        pFrame->pts = tick;
+        emit FrameBuilt(pFrame);
+        return;
+    }
+
+    ResultBuffer&   buffer = m_resultBuffers[m_writeIndex];
+    int64_t         bytesTouched = 0;
+    int             newFrames = 0;
+
+    // Frame buffers are read by compositor thread only, tiles to redraw are collected first
+    m_composeItems.clear();
+    for (int tile = 0; tile < m_tileStates.size(); tile++)
+    {
+        TileState&              state = m_tileStates[tile];
+        QSharedPointer<AVFrame> pFrame = Placeholder(tile);
+
+        // Tile with live source shows frame from its buffer
+        if (pFrame.isNull())
+        {
+            pFrame = sources[tile]->GetFrame(tickUs);
+        }
+
+        ComposeItem item;
+        item.tile = tile;
+        item.replan = false;
+        item.carried = true;
+
+        // Tile does not show this frame yet (drawn frame is referenced, so its address can't be reused)
+        if (!pFrame.isNull() && (pFrame.data() != state.pFrame.data()))
+        {
+            // Plan is rebuilt only when picture size changes
+            item.replan = state.pFrame.isNull() ||
+                          (state.plan.pictureWidth != pFrame->width) || (state.plan.pictureHeight != pFrame->height);
+
+            item.carried = false;
+            state.pFrame = pFrame;
+            state.gen++;
+            newFrames++;
+        }
+
+        // Write buffer already shows the latest frame of the tile
+        if (state.pFrame.isNull() || (buffer.tileGen[tile] == state.gen))
+        {
+            continue;
+        }
+
+        // Letterbox area is cleared only when picture size in this buffer changes
+        item.fill = (buffer.tileWidth[tile] != state.pFrame->width) || (buffer.tileHeight[tile] != state.pFrame->height);
+
+        buffer.tileGen[tile] = state.gen;
+        buffer.tileWidth[tile] = state.pFrame->width;
+        buffer.tileHeight[tile] = state.pFrame->height;
+        m_composeItems.append(item);
+    }
+
+    // Tiles are disjoint, so the result does not depend on thread count or job order
+    int64_t composeStartUs = MonotonicTimeUs();
+    m_pComposePool->Run(this, m_composeItems.size());
+    m_composeTimeStat.Add(MonotonicTimeUs() - composeStartUs);
+
+    for (int i = 0; i < m_composeItems.size(); i++)
+    {
+        const ComposeItem&  item = m_composeItems[i];
+        const TilePlan&     plan = m_tileStates[item.tile].plan;
+        int64_t             bytes = plan.blitBytes + (item.fill ? plan.fillBytes : 0);
+
+        bytesTouched += bytes;
+        if (item.carried)
+        {
+            m_tilesCarried++;
+            m_bytesCarried += bytes;
+        }
+    }
+
+    m_tilesRedrawnStat.Add(m_composeItems.size());
+    m_bytesTouchedStat.Add(bytesTouched);
+
+    // Write buffer stays the same over skipped ticks, carried tiles are not redrawn again
+    bool changed = (newFrames > 0) || ((NULL != m_pOverlay) && m_pOverlay->ClockChanged());
+    if (SkipTick(changed, tickUs))
+    {
+        return;
+    }
+
+    // Clock box is opaque, so it is simply redrawn over whatever tiles changed under it
+    if (NULL != m_pOverlay)
+    {
+        m_pOverlay->DrawClock(m_pResultFrame);
+    }
+
+    QSharedPointer<AVFrame> pFrame = HandOffResultFrame();
+
+    AttachRegions(pFrame.data());
+    pFrame->pts = tick;
+    emit FrameBuilt(pFrame);
+}
+
+bool Builder::SkipTick(bool changed, int64_t tickUs)
+{
+    // Pts stay tick based, so the frame after a pause lands at its wall clock time.
+    // A frame is still sent now and then, so clients joining late and muxers waiting for data are not starved
+    if (!m_params.skipUnchanged || changed || (tickUs - m_lastBuiltUs >= (int64_t)m_params.maxFrameIntervalMs * 1000))
+    {
+        m_lastBuiltUs = tickUs;
+        return false;
+    }
+
+    m_unchangedTicks++;
+    emit FrameSkipped();
+    return true;
+}
+
+void Builder::AttachRegions(AVFrame* pFrame)
+{
+    // Frames are reused, regions of the previous tick must not stay attached
+    av_frame_remove_side_data(pFrame, AV_FRAME_DATA_REGIONS_OF_INTEREST);
+
+    if (!m_params.roiEnabled)
+    {
+        return;
+    }
+
+    // Regions still go out with the frame, they take effect again once the encoder switches back
+    const char* pIgnoredBy = pEncoder->RegionsIgnoredBy();
+    if (pIgnoredBy != m_pRoiIgnoredBy)
+    {
+        if (NULL != pIgnoredBy)
+        {
+            ERROR_MESSAGE1(ERR_TYPE_WARNING, m_ownerName.constData(), "Regions of interest are ignored by %s, tiles are coded at uniform quality", pIgnoredBy);
+        }
+        m_pRoiIgnoredBy = pIgnoredBy;
+    }
+
+    m_regions.clear();
+
+    // First region wins where regions overlap, so letterbox goes ahead of the tile around it
+    for (int tile = 0; tile < m_tileStates.size(); tile++)
+    {
+        const TileState& state = m_tileStates[tile];
+
+        for (int i = 0; !state.pFrame.isNull() && (i < state.plan.fills.size()); i++)
+        {
+            AddRegion(state.plan.fills[i], m_params.roiCoarseQp);
+            m_roiLetterboxes++;
+        }
+    }
+
+    for (int tile = 0; tile < m_sourceStates.size(); tile++)
+    {
+        const SourceState&  state = m_sourceStates[tile];
+        RoiClass            roiClass = ROI_ACTIVE;
+
+        if (sources[tile].isNull() || state.stale)
+        {
+            roiClass = ROI_EMPTY;
+        }
+        else if (m_roiPinned[tile])
+        {
+            roiClass = ROI_PINNED;
+        }
+        else if (state.ageUs > (int64_t)m_params.roiStaticMs * 1000)
+        {
+            roiClass = ROI_STATIC;
+        }
+        m_roiTiles[roiClass]++;
+
+        int qp = ((ROI_ACTIVE == roiClass) || (ROI_PINNED == roiClass)) ? m_params.roiFineQp : m_params.roiCoarseQp;
+        const QVector<LayoutRect>& visible = m_params.layout.VisibleRects(tile);
+
+        for (int i = 0; i < visible.size(); i++)
+        {
+            AddRegion(visible[i], qp);
+        }
     }
-    emit FrameBuilt(m_pResultFrame);
+
+    if (m_regions.isEmpty())
+    {
+        return;
+    }
+
+    AVFrameSideData* pSideData = av_frame_new_side_data(pFrame, AV_FRAME_DATA_REGIONS_OF_INTEREST,
+                                                        m_regions.size() * sizeof(AVRegionOfInterest));
+    if (NULL == pSideData)
+    {
+        ERROR_MESSAGE0(ERR_TYPE_ERROR, m_ownerName.constData(), "Failed to attach regions of interest");
+        return;
+    }
+    memcpy(pSideData->data, m_regions.constData(), m_regions.size() * sizeof(AVRegionOfInterest));
 }
 
-void Builder::DrawFrameOnTarget(QSharedPointer<AVFrame> pFrame, int row, int col)
+void Builder::AddRegion(const LayoutRect& rect, int qp)
 {
-    if (nullptr == pFrame)
+    if ((0 == qp) || rect.IsEmpty())
     {
-        ERROR_MESSAGE1(ERR_TYPE_ERROR, "Builder", "Null frame received from frame buffer %d", col*m_params.numCamsX + row);
         return;
     }
 
-//    int posX = m_params.camWidth  * row + m_params.borderWidth * (row + 1);
-//    int posY = m_params.camHeight * col + m_params.borderWidth * (col + 1);
-    int posX = m_params.camWidth  * row + ((m_params.camWidth - pFrame->width) >> 1);
-    int posY = m_params.camHeight * col + ((m_params.camHeight - pFrame->height) >> 1);
+    AVRegionOfInterest region;
+
+    region.self_size = sizeof(AVRegionOfInterest);
+    region.top = rect.y;
+    region.bottom = rect.y + rect.height;
+    region.left = rect.x;
+    region.right = rect.x + rect.width;
+    // libx264 scales the offset by its QP range, which is 51 at 8 bits
+    region.qoffset = av_make_q(qp, 51);
+    m_regions.append(region);
+}
+
+QSharedPointer<AVFrame> Builder::HandOffResultFrame()
+{
+    // Synchronous encoder is done with the frame before the next tick redraws it
+    if (1 == m_resultBuffers.size())
+    {
+        return QSharedPointer<AVFrame>(m_pResultFrame, [](AVFrame*){});
+    }
+
+    ResultBuffer&   buffer = m_resultBuffers[m_writeIndex];
+    QAtomicInt*     pInUse = &buffer.inUse;
 
-    cv::Mat     dstY(m_pResultFrame->height,    m_pResultFrame->width,    CV_8UC1, m_pResultFrame->data[0], m_pResultFrame->linesize[0]);
-    cv::Mat     dstU(m_pResultFrame->height>>1, m_pResultFrame->width>>1, CV_8UC1, m_pResultFrame->data[1], m_pResultFrame->linesize[1]);
-    cv::Mat     dstV(m_pResultFrame->height>>1, m_pResultFrame->width>>1, CV_8UC1, m_pResultFrame->data[2], m_pResultFrame->linesize[1]);
+    // Reference is released by encoder once it has consumed the frame
+    QSharedPointer<AVFrame> pHandedOff(buffer.pFrame, [pInUse](AVFrame*){ pInUse->storeRelease(0); });
 
-    cv::Mat     srcY(pFrame->height,    pFrame->width,    CV_8UC1, pFrame->data[0], pFrame->linesize[0]);
-    cv::Mat     srcU(pFrame->height>>1, pFrame->width>>1, CV_8UC1, pFrame->data[1], pFrame->linesize[1]);
-    cv::Mat     srcV(pFrame->height>>1, pFrame->width>>1, CV_8UC1, pFrame->data[2], pFrame->linesize[1]);
+    buffer.inUse.storeRelease(1);
 
-    srcY.copyTo(dstY(cv::Rect(posX, posY, pFrame->width, pFrame->height)));
-    srcU.copyTo(dstU(cv::Rect(posX>>1, posY>>1, pFrame->width>>1, pFrame->height>>1)));
-    srcV.copyTo(dstV(cv::Rect(posX>>1, posY>>1, pFrame->width>>1, pFrame->height>>1)));
+    // Next free buffer becomes the write buffer. Falling back to a busy one may tear the frame being encoded
+    int next = (m_writeIndex + 1) % m_resultBuffers.size();
+    for (int i = 0; (i < m_resultBuffers.size() - 1) && m_resultBuffers[next].inUse.loadAcquire(); i++)
+    {
+        next = (next + 1) % m_resultBuffers.size();
+    }
+    if (next == m_writeIndex)
+    {
+        next = (m_writeIndex + 1) % m_resultBuffers.size();
+        m_buffersBusy++;
+    }
+    m_writeIndex = next;
+    m_pResultFrame = m_resultBuffers[next].pFrame;
+
+    return pHandedOff;
+}
+
+void Builder::UpdateSourceStates(int64_t tickUs)
+{
+    for (int tile = 0; tile < m_sourceStates.size(); tile++)
+    {
+        if (sources[tile].isNull())
+        {
+            continue;
+        }
+
+        SourceState& state = m_sourceStates[tile];
+
+        // Streams write canvas tiles without going through frame buffers
+        int64_t lastFrameUs = (NULL != pCanvas) ? pCanvas->TileUpdateUs(tile) : sources[tile]->LastFrameUs();
+        int64_t ageUs = FFMAX(0, tickUs - FFMAX(lastFrameUs, m_startUs));
+        bool    stale = (m_params.staleTimeoutMs > 0) && (ageUs > (int64_t)m_params.staleTimeoutMs * 1000);
+
+        state.frameAgeStat.Add(ageUs);
+        state.ageUs = ageUs;
+
+        if (stale && !state.stale)
+        {
+            ERROR_MESSAGE2(ERR_TYPE_WARNING, m_ownerName.constData(), "Tile %d: no frames for %lld ms, showing placeholder",
+                           tile, (long long)(ageUs / 1000));
+            state.outageStartUs = FFMAX(lastFrameUs, m_startUs);
+            state.placeholderDrawn = false;
+        }
+        else if (!stale && state.stale)
+        {
+            ERROR_MESSAGE2(ERR_TYPE_MESSAGE, m_ownerName.constData(), "Tile %d: frames are back after %lld ms",
+                           tile, (long long)((lastFrameUs - state.outageStartUs) / 1000));
+        }
+
+        state.stale = stale;
+        if (stale)
+        {
+            state.staleTicks++;
+        }
+    }
+}
+
+QSharedPointer<AVFrame> Builder::Placeholder(int tile)
+{
+    const LayoutRect& rect = m_params.layout.TileRect(tile);
+
+    if (sources[tile].isNull())
+    {
+        return m_placeholders.Get(rect.width, rect.height, PLACEHOLDER_NO_CAMERA);
+    }
+    if (m_sourceStates[tile].stale)
+    {
+        return m_placeholders.Get(rect.width, rect.height, PLACEHOLDER_NO_SIGNAL);
+    }
+    return QSharedPointer<AVFrame>(NULL);
+}
+
+void Builder::ReportStatistics(int64_t nowUs)
+{
+    if (nowUs - m_statsStartUs < STATS_INTERVAL_MSEC * 1000)
+    {
+        return;
+    }
+
+    ERROR_MESSAGE6(ERR_TYPE_MESSAGE, m_ownerName.constData(), "Builder stats: %lld ticks, %lld deadlines missed, tick jitter avg %.2f ms max %.2f ms, build time avg %.2f ms max %.2f ms",
+                   (long long)m_buildTimeStat.Count(),
+                   (long long)m_missedDeadlines,
+                   m_tickJitterStat.Average() / 1000.0,
+                   m_tickJitterStat.Max() / 1000.0,
+                   m_buildTimeStat.Average() / 1000.0,
+                   m_buildTimeStat.Max() / 1000.0);
+
+    if (m_params.skipUnchanged)
+    {
+        ERROR_MESSAGE2(ERR_TYPE_MESSAGE, m_ownerName.constData(), "Builder stats: %lld ticks without changes not encoded (%.1f%%)",
+                       (long long)m_unchangedTicks,
+                       m_buildTimeStat.Count() ? m_unchangedTicks * 100.0 / m_buildTimeStat.Count() : 0.0);
+    }
+
+    for (int i = 0; i < sources.size(); i++)
+    {
+        if (!sources[i].isNull())
+        {
+            FrameBufferCounters counters;
+
+            sources[i]->TakeCounters(&counters);
+            ERROR_MESSAGE5(ERR_TYPE_MESSAGE, m_ownerName.constData(), "Tile %d: %d frames received, %d shown, %d repeated, %d dropped",
+                           i,
+                           counters.published,
+                           counters.shown,
+                           counters.repeated,
+                           counters.dropped);
+
+            SourceState& state = m_sourceStates[i];
+
+            ERROR_MESSAGE5(ERR_TYPE_MESSAGE, m_ownerName.constData(), "Tile %d: frame age avg %.0f ms max %lld ms, %d ticks without signal, %d reconnects",
+                           i,
+                           state.frameAgeStat.Average() / 1000.0,
+                           (long long)(state.frameAgeStat.Max() / 1000),
+                           state.staleTicks,
+                           counters.reconnects);
+            state.frameAgeStat.Reset();
+            state.staleTicks = 0;
+        }
+    }
+
+    if (NULL == pCanvas)
+    {
+        ERROR_MESSAGE4(ERR_TYPE_MESSAGE, m_ownerName.constData(), "Compose: tiles redrawn avg %.2f max %lld per tick, touched avg %.1f KB max %lld KB per tick",
+                       m_tilesRedrawnStat.Average(),
+                       (long long)m_tilesRedrawnStat.Max(),
+                       m_bytesTouchedStat.Average() / 1024.0,
+                       (long long)(m_bytesTouchedStat.Max() / 1024));
+        ERROR_MESSAGE4(ERR_TYPE_MESSAGE, m_ownerName.constData(), "Compose: %d result buffers, %lld tiles carried over (%lld KB copied), %lld times no free buffer",
+                       m_resultBuffers.size(),
+                       (long long)m_tilesCarried,
+                       (long long)(m_bytesCarried / 1024),
+                       (long long)m_buffersBusy);
+        ERROR_MESSAGE5(ERR_TYPE_MESSAGE, m_ownerName.constData(), "Compose: %d threads, %s kernels, compose time avg %.2f ms max %.2f ms, %.0f MB/s",
+                       m_pComposePool->NumThreads(),
+                       PlaneKernelsImplementation(),
+                       m_composeTimeStat.Average() / 1000.0,
+                       m_composeTimeStat.Max() / 1000.0,
+                       m_composeTimeStat.Sum() ? (double)m_bytesTouchedStat.Sum() / (double)m_composeTimeStat.Sum() : 0.0);
+    }
+
+    if (m_params.roiEnabled)
+    {
+        int64_t tiles = FFMAX(1, m_roiTiles[ROI_ACTIVE] + m_roiTiles[ROI_PINNED] + m_roiTiles[ROI_STATIC] + m_roiTiles[ROI_EMPTY]);
+
+        ERROR_MESSAGE5(ERR_TYPE_MESSAGE, m_ownerName.constData(), "ROI: tiles coded fine %.1f%% active %.1f%% pinned, coarse %.1f%% static %.1f%% empty, %lld letterbox regions",
+                       m_roiTiles[ROI_ACTIVE] * 100.0 / tiles,
+                       m_roiTiles[ROI_PINNED] * 100.0 / tiles,
+                       m_roiTiles[ROI_STATIC] * 100.0 / tiles,
+                       m_roiTiles[ROI_EMPTY] * 100.0 / tiles,
+                       (long long)m_roiLetterboxes);
+        memset(m_roiTiles, 0, sizeof(m_roiTiles));
+        m_roiLetterboxes = 0;
+    }
+
+    if (NULL != m_pOverlay)
+    {
+        int64_t ticks = FFMAX(1, m_buildTimeStat.Count());
+        int64_t blendedBytes;
+        int64_t blendUs;
+        int64_t clockUs;
+
+        m_pOverlay->TakeCounters(&blendedBytes, &blendUs, &clockUs);
+        ERROR_MESSAGE3(ERR_TYPE_MESSAGE, m_ownerName.constData(), "Overlay: blended avg %.1f KB per tick, blend time avg %.3f ms per tick, clock time avg %.3f ms per tick",
+                       blendedBytes / 1024.0 / ticks,
+                       blendUs / 1000.0 / ticks,
+                       clockUs / 1000.0 / ticks);
+    }
+
+    m_missedDeadlines = 0;
+    m_unchangedTicks = 0;
+    m_tickJitterStat.Reset();
+    m_buildTimeStat.Reset();
+    m_tilesRedrawnStat.Reset();
+    m_composeTimeStat.Reset();
+    m_bytesTouchedStat.Reset();
+    m_tilesCarried = 0;
+    m_bytesCarried = 0;
+    m_buffersBusy = 0;
+    m_statsStartUs = nowUs;
+}
+
+void Builder::RunComposeJob(int index)
+{
+    const ComposeItem&  item = m_composeItems[index];
+    TileState&          state = m_tileStates[item.tile];
+
+    if (item.replan)
+    {
+        m_params.layout.PlanTile(item.tile, state.pFrame->width, state.pFrame->height, m_pResultFrame->linesize, &state.plan);
+    }
+    if (item.fill)
+    {
+        for (int i = 0; i < state.plan.fills.size(); i++)
+        {
+            const LayoutRect& fill = state.plan.fills[i];
+            FillRect(fill.x, fill.y, fill.width, fill.height);
+        }
+    }
+    DrawFrameOnTarget(state.pFrame.data(), state.plan);
+
+    if (NULL != m_pOverlay)
+    {
+        m_pOverlay->BlendTile(m_pResultFrame, item.tile, state.plan.picture, item.fill);
+    }
+}
+
+void Builder::FillRect(int x, int y, int width, int height)
+{
+    for (int row = 0; row < height; row++)
+    {
+        memset(m_pResultFrame->data[0] + (y + row) * m_pResultFrame->linesize[0] + x, 16, width);
+    }
+    for (int row = 0; row < (height >> 1); row++)
+    {
+        memset(m_pResultFrame->data[1] + ((y >> 1) + row) * m_pResultFrame->linesize[1] + (x >> 1), 128, width >> 1);
+        memset(m_pResultFrame->data[2] + ((y >> 1) + row) * m_pResultFrame->linesize[2] + (x >> 1), 128, width >> 1);
+    }
+}
+
+void Builder::DrawFrameOnTarget(const AVFrame* pFrame, const TilePlan& plan)
+{
+    for (int i = 0; i < plan.blits.size(); i++)
+    {
+        const TilePlan::Blit& blit = plan.blits[i];
+
+        for (int plane = 0; plane < 3; plane++)
+        {
+            int shift = (plane == 0) ? 0 : 1;
+
+            CopyPlane(m_pResultFrame->data[plane] + blit.dstOffset[plane], m_pResultFrame->linesize[plane],
+                      pFrame->data[plane] + (blit.srcY >> shift) * pFrame->linesize[plane] + (blit.srcX >> shift), pFrame->linesize[plane],
+                      blit.width >> shift, blit.height >> shift);
+        }
+    }
 }
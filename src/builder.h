@@ -1,30 +1,53 @@
 #ifndef BUILDER_H
 #define BUILDER_H
 
-#include <QTimer>
 #include <QObject>
 #include <QThread>
 #include <QVector>
+#include <QAtomicInt>
 
 #include "common.h"
+#include "canvas.h"
+#include "composePool.h"
+#include "layout.h"
+#include "overlay.h"
+#include "placeholder.h"
+#include "statistics.h"
 #include "frameBuffer.h"
 #include "videoEncoder.h"
 
 
+enum ComposeMode
+{
+    COMPOSE_MODE_COPY,      // Builder copies scaled frames from frame buffers every tick
+    COMPOSE_MODE_ZEROCOPY   // Streams scale into canvas tiles, builder only publishes canvas
+};
+
 struct BuilderParameters
 {
+    QString name;           /// Mosaic name, used in log messages
     int  outWidth;
     int  outHeight;
-    int  camWidth;
-    int  camHeight;
-    int  borderWidth;
     int  fps;
     int  crf;
-    int  numCamsX;
-    int  numCamsY;
+    EncoderCodec codec;
+    Layout layout;          /// Compiled camera tiles, tile index is camera index
+    ComposeMode composeMode;
+    int  canvasBuffers;     /// Number of canvas buffers in zero-copy mode
+    int  composeThreads;    /// Threads drawing tiles in copy mode. 0 - one per cpu core
+    int  staleTimeoutMs;    /// Source without frames for this long is replaced with placeholder. 0 - never
+    bool skipUnchanged;     /// Ticks where no tile changed are not encoded, output gets variable frame rate
+    int  maxFrameIntervalMs;/// Frame is encoded at least this often even if nothing changed
+    bool roiEnabled;        /// Frames carry per-tile quantiser offsets chosen by tile activity
+    int  roiStaticMs;       /// Tile without new frames for this long is coded coarse
+    int  roiCoarseQp;       /// QP offset of static, empty and letterbox regions
+    int  roiFineQp;         /// QP offset of active and pinned tiles
+    QVector<int> roiPinnedTiles;    /// Tiles always coded fine
+    EncoderParameters encoder;  /// Frame size, fps, crf and codec are taken from the fields above
+    OverlayParameters overlay;
 };
 
-class Builder : public QObject
+class Builder : public QObject, public ComposeJob
 {
     Q_OBJECT
 public:
@@ -32,25 +55,125 @@ public:
     ~Builder();
 
     VideoEncoder*          pEncoder;
+    Canvas*                pCanvas;     /// Zero-copy compose canvas, NULL in copy mode
 
     QVector<QSharedPointer<FrameBuffer> >  sources;
 
 signals:
-    void FrameBuilt(AVFrame* pFrame);
+    void FrameBuilt(QSharedPointer<AVFrame> pFrame);   /// Pts is the tick index
+    void FrameSkipped();                                /// Nothing changed in this tick, no frame is built
 
 public slots:
-    void Start() { m_pProcessingTimer->start(); }
-    void Stop()  { m_pProcessingTimer->stop();  }
-
-private slots:
-    void BuildFrame();
+    void Start();   /// Starts compositor thread
+    void Stop();    /// Stops compositor thread and waits for it
 
 private:
+    class CompositorThread : public QThread
+    {
+    public:
+        CompositorThread(Builder* pBuilder) : QThread(NULL), m_pBuilder(pBuilder) {}
+
+    protected:
+        void run() { m_pBuilder->ComposeLoop(); }
+
+    private:
+        Builder*    m_pBuilder;
+    };
+
+    struct ComposeItem
+    {
+        int     tile;
+        bool    replan;     /// Picture size changed, blit plan is rebuilt
+        bool    fill;       /// Letterbox of the write buffer does not match the picture and is cleared
+        bool    carried;    /// No new frame, tile is redrawn only to bring the write buffer up to date
+    };
+
+    struct SourceState
+    {
+        SourceState() : stale(false), placeholderDrawn(false), outageStartUs(0), ageUs(0), staleTicks(0) {}
+
+        bool        stale;              /// No frames for staleTimeoutMs, placeholder is shown instead
+        bool        placeholderDrawn;   /// Zero-copy mode: placeholder is already in the canvas
+        int64_t     outageStartUs;      /// Time of the last frame before the outage
+        int64_t     ageUs;              /// Age of the newest frame at current tick
+        RunningStat frameAgeStat;       /// Age of the newest frame at tick time, us
+        int         staleTicks;         /// Ticks showing placeholder in current statistics interval
+    };
+
+    struct TileState
+    {
+        TileState() : gen(0) {}
+
+        QSharedPointer<AVFrame> pFrame;     /// Frame currently shown in the tile
+        TilePlan                plan;       /// Blit plan for its size
+        int                     gen;        /// Incremented for each new frame
+    };
+
+    struct ResultBuffer
+    {
+        AVFrame*        pFrame;
+        QAtomicInt      inUse;          /// Set while handed off frame is referenced by encoder
+        QVector<int>    tileGen;        /// Generation of each tile content in this buffer
+        QVector<int>    tileWidth;      /// Size of the picture drawn in each tile
+        QVector<int>    tileHeight;
+    };
+
     BuilderParameters   m_params;
-    AVFrame*            m_pResultFrame;
-    QTimer*             m_pProcessingTimer;
+    QByteArray          m_ownerName;        /// Log message owner, tells mosaics apart
+    QVector<ResultBuffer> m_resultBuffers;  /// Copy mode only. More than one if encoder queues frames
+    int                 m_writeIndex;       /// Result buffer composed in current tick
+    AVFrame*            m_pResultFrame;     /// Frame of the write buffer
+    CompositorThread*   m_pThread;
+    ComposePool*        m_pComposePool;     /// Copy mode only
+    Overlay*            m_pOverlay;         /// NULL if there is nothing to draw over the tiles
+    QVector<ComposeItem> m_composeItems;    /// Tiles to redraw in current tick
+    QAtomicInt          m_stop;
+
+    int64_t             m_statsStartUs;     /// Start of current statistics interval
+    int64_t             m_missedDeadlines;  /// Ticks skipped because of overrun
+    int64_t             m_unchangedTicks;   /// Ticks not encoded because nothing changed
+    int64_t             m_lastBuiltUs;      /// Tick time of the last frame handed to encoder
+    RunningStat         m_tickJitterStat;   /// Wake up time after tick deadline, us
+    RunningStat         m_buildTimeStat;    /// BuildFrame() duration, includes encoding in synchronous mode, us
+    RunningStat         m_tilesRedrawnStat; /// Tiles drawn per tick in copy mode
+    RunningStat         m_bytesTouchedStat; /// Result frame bytes written per tick in copy mode
+    RunningStat         m_composeTimeStat;  /// Tile drawing time per tick in copy mode, us
+    int64_t             m_tilesCarried;     /// Tiles redrawn only to bring the write buffer up to date
+    int64_t             m_bytesCarried;
+    int64_t             m_buffersBusy;      /// No free result buffer, one still held by encoder was reused
+
+    enum RoiClass
+    {
+        ROI_ACTIVE,         // Tile got new frames recently
+        ROI_PINNED,         // Operator wants this tile sharp regardless of activity
+        ROI_STATIC,         // Tile repeats an old frame
+        ROI_EMPTY,          // Placeholder instead of video
+        ROI_CLASSES
+    };
+
+    QVector<bool>       m_roiPinned;        /// Per tile
+    QVector<AVRegionOfInterest> m_regions;  /// Side data of current frame
+    int64_t             m_roiTiles[ROI_CLASSES];    /// Tiles of each class in encoded frames
+    int64_t             m_roiLetterboxes;   /// Letterbox regions in encoded frames
+    const char*         m_pRoiIgnoredBy;    /// Encoder setting dropping regions when it was last checked, NULL if none
+
+    QVector<TileState>  m_tileStates;       /// Copy mode only
+    QVector<SourceState> m_sourceStates;    /// Frame age tracking of each tile source
+    PlaceholderCache    m_placeholders;
+    int64_t             m_startUs;          /// Compositor start, sources without frames are aged from it
 
-    void DrawFrameOnTarget(QSharedPointer<AVFrame> pFrame, int row, int col);
+    void ComposeLoop();
+    void BuildFrame(int64_t tick, int64_t tickUs);
+    bool SkipTick(bool changed, int64_t tickUs);    /// Counts and signals the tick if it needs no frame
+    void AttachRegions(AVFrame* pFrame);            /// Replaces regions of interest side data of the frame
+    void AddRegion(const LayoutRect& rect, int qp);
+    QSharedPointer<AVFrame> HandOffResultFrame();   /// Publishes the write buffer and moves on to the next free one
+    void UpdateSourceStates(int64_t tickUs);
+    QSharedPointer<AVFrame> Placeholder(int tile);  /// NULL if tile shows live video
+    void RunComposeJob(int index);
+    void ReportStatistics(int64_t nowUs);
+    void FillRect(int x, int y, int width, int height); /// Paints black rectangle on result frame
+    void DrawFrameOnTarget(const AVFrame* pFrame, const TilePlan& plan);
 };
 
 #endif // BUILDER_H
@@ -0,0 +1,313 @@
+#include "canvas.h"
+
+#include "statistics.h"
+#include "planeKernels.h"
+
+Canvas::Canvas(int width, int height, int numBuffers) :
+    m_width(width),
+    m_height(height),
+    m_writeIndex(0),
+    m_pOverlay(NULL),
+    m_updates(0),
+    m_statsStartUs(MonotonicTimeUs()),
+    m_published(0),
+    m_tilesCarried(0),
+    m_bytesCarried(0),
+    m_buffersBusy(0)
+{
+    // Published buffer is read by encoder while streams write the next one
+    numBuffers = FFMAX(2, numBuffers);
+    m_buffers.resize(numBuffers);
+
+    for (int i = 0; i < numBuffers; i++)
+    {
+        AVFrame* pFrame = av_frame_alloc();
+
+        pFrame->format = AV_PIX_FMT_YUV420P;
+        pFrame->width = width;
+        pFrame->height = height;
+
+        if (0 > av_frame_get_buffer(pFrame, 32))  // allocates aligned buffer for y,u,v planes
+        {
+            ERROR_MESSAGE0(ERR_TYPE_ERROR, "Canvas", "Failed to alocate frame buffer");
+        }
+        else
+        {
+            // Make canvas black
+            memset(pFrame->data[0], 16,  pFrame->height * pFrame->linesize[0]);
+            memset(pFrame->data[1], 128, (pFrame->height >> 1) * pFrame->linesize[1]);
+            memset(pFrame->data[2], 128, (pFrame->height >> 1) * pFrame->linesize[2]);
+        }
+        m_buffers[i].pFrame = pFrame;
+        m_buffers[i].inUse.store(0);
+    }
+}
+
+Canvas::~Canvas()
+{
+    for (int i = 0; i < m_buffers.size(); i++)
+    {
+        av_frame_free(&m_buffers[i].pFrame);
+    }
+}
+
+int Canvas::AddTile(int x, int y, int width, int height)
+{
+    Tile tile;
+
+    // Chroma planes are subsampled, so tile position and size are kept even
+    tile.x = x & ~1;
+    tile.y = y & ~1;
+    tile.width = FFMIN(width, m_width - tile.x) & ~1;
+    tile.height = FFMIN(height, m_height - tile.y) & ~1;
+    tile.latestGen = 0;
+    tile.latestBuffer = 0;
+    tile.writing.store(0);
+    tile.updateUs.store(0);
+
+    QWriteLocker lock(&m_lock);
+
+    m_tiles.append(tile);
+    for (int i = 0; i < m_buffers.size(); i++)
+    {
+        m_buffers[i].tileGen.append(0);
+        m_buffers[i].tileWidth.append(0);
+        m_buffers[i].tileHeight.append(0);
+    }
+    return m_tiles.size() - 1;
+}
+
+void Canvas::SetOverlay(Overlay* pOverlay)
+{
+    QWriteLocker lock(&m_lock);
+
+    m_pOverlay = pOverlay;
+    if (NULL == m_pOverlay)
+    {
+        return;
+    }
+
+    // Tiles are carried over between buffers with their overlay, so every buffer starts with it
+    for (int i = 0; i < m_buffers.size(); i++)
+    {
+        for (int tile = 0; tile < m_tiles.size(); tile++)
+        {
+            m_pOverlay->BlendTile(m_buffers[i].pFrame, tile, LayoutRect(), true);
+        }
+    }
+}
+
+void Canvas::FillTile(Buffer& buffer, const Tile& tile)
+{
+    AVFrame* pFrame = buffer.pFrame;
+
+    for (int y = 0; y < tile.height; y++)
+    {
+        memset(pFrame->data[0] + (tile.y + y) * pFrame->linesize[0] + tile.x, 16, tile.width);
+    }
+    for (int y = 0; y < (tile.height >> 1); y++)
+    {
+        memset(pFrame->data[1] + ((tile.y >> 1) + y) * pFrame->linesize[1] + (tile.x >> 1), 128, tile.width >> 1);
+        memset(pFrame->data[2] + ((tile.y >> 1) + y) * pFrame->linesize[2] + (tile.x >> 1), 128, tile.width >> 1);
+    }
+}
+
+int Canvas::CopyTile(Buffer& dst, const Buffer& src, const Tile& tile)
+{
+    for (int plane = 0; plane < 3; plane++)
+    {
+        int shift = (plane == 0) ? 0 : 1;
+        int x = tile.x >> shift;
+        int y = tile.y >> shift;
+
+        CopyPlane(dst.pFrame->data[plane] + y * dst.pFrame->linesize[plane] + x, dst.pFrame->linesize[plane],
+                  src.pFrame->data[plane] + y * src.pFrame->linesize[plane] + x, src.pFrame->linesize[plane],
+                  tile.width >> shift, tile.height >> shift);
+    }
+    return tile.width * tile.height * 3 / 2;
+}
+
+bool Canvas::WriteTile(int tile, AVFrame* pInFrame, VideoScaler* pScaler)
+{
+    if ((tile < 0) || (tile >= m_tiles.size()))
+    {
+        return false;
+    }
+
+    // Streams write disjoint tiles, so they only exclude Publish()
+    QReadLocker lock(&m_lock);
+
+    Tile& t = m_tiles[tile];
+
+    // Builder is drawing a placeholder into this tile, the frame is dropped
+    if (!t.writing.testAndSetAcquire(0, 1))
+    {
+        return false;
+    }
+
+    bool written = ScaleIntoTile(tile, pInFrame, pScaler);
+    if (written)
+    {
+        t.updateUs.storeRelease(MonotonicTimeUs());
+    }
+    t.writing.storeRelease(0);
+
+    return written;
+}
+
+bool Canvas::WritePlaceholder(int tile, const AVFrame* pFrame)
+{
+    if ((tile < 0) || (tile >= m_tiles.size()))
+    {
+        return false;
+    }
+
+    QReadLocker lock(&m_lock);
+
+    Tile&   t = m_tiles[tile];
+    Buffer& buffer = m_buffers[m_writeIndex];
+
+    // Stream came back and is writing the tile right now
+    if (!t.writing.testAndSetAcquire(0, 1))
+    {
+        return false;
+    }
+
+    for (int plane = 0; plane < 3; plane++)
+    {
+        int shift = (plane == 0) ? 0 : 1;
+
+        CopyPlane(buffer.pFrame->data[plane] + (t.y >> shift) * buffer.pFrame->linesize[plane] + (t.x >> shift), buffer.pFrame->linesize[plane],
+                  pFrame->data[plane], pFrame->linesize[plane],
+                  FFMIN(t.width, pFrame->width) >> shift, FFMIN(t.height, pFrame->height) >> shift);
+    }
+    buffer.tileWidth[tile] = t.width;
+    buffer.tileHeight[tile] = t.height;
+
+    if (NULL != m_pOverlay)
+    {
+        m_pOverlay->BlendTile(buffer.pFrame, tile, LayoutRect(t.x, t.y, t.width, t.height), true);
+    }
+
+    buffer.tileGen[tile] = ++t.latestGen;
+    t.latestBuffer = m_writeIndex;
+    m_updates.ref();
+    t.writing.storeRelease(0);
+
+    return true;
+}
+
+// Caller holds the read lock and the tile writing flag
+bool Canvas::ScaleIntoTile(int tile, AVFrame* pInFrame, VideoScaler* pScaler)
+{
+    AVFrame     view;
+    int         scaledWidth;
+    int         scaledHeight;
+    Tile&       t = m_tiles[tile];
+    Buffer& buffer = m_buffers[m_writeIndex];
+
+    VideoScaler::fitSize(pInFrame->width, pInFrame->height, t.width, t.height, &scaledWidth, &scaledHeight);
+
+    // Letterbox area contains garbage if picture size changed
+    bool cleared = (buffer.tileWidth[tile] != scaledWidth) || (buffer.tileHeight[tile] != scaledHeight);
+    if (cleared)
+    {
+        FillTile(buffer, t);
+        buffer.tileWidth[tile] = scaledWidth;
+        buffer.tileHeight[tile] = scaledHeight;
+    }
+
+    int posX = t.x + (((t.width - scaledWidth) >> 1) & ~1);
+    int posY = t.y + (((t.height - scaledHeight) >> 1) & ~1);
+
+    // Frame header pointing into the tile of the canvas buffer
+    memset(&view, 0, sizeof(view));
+    view.format = AV_PIX_FMT_YUV420P;
+    view.width = scaledWidth;
+    view.height = scaledHeight;
+    view.data[0] = buffer.pFrame->data[0] + posY * buffer.pFrame->linesize[0] + posX;
+    view.data[1] = buffer.pFrame->data[1] + (posY >> 1) * buffer.pFrame->linesize[1] + (posX >> 1);
+    view.data[2] = buffer.pFrame->data[2] + (posY >> 1) * buffer.pFrame->linesize[2] + (posX >> 1);
+    view.linesize[0] = buffer.pFrame->linesize[0];
+    view.linesize[1] = buffer.pFrame->linesize[1];
+    view.linesize[2] = buffer.pFrame->linesize[2];
+
+    if (!pScaler->scaleFrame(pInFrame, &view))
+    {
+        return false;
+    }
+
+    if (NULL != m_pOverlay)
+    {
+        m_pOverlay->BlendTile(buffer.pFrame, tile, LayoutRect(posX, posY, scaledWidth, scaledHeight), cleared);
+    }
+
+    buffer.tileGen[tile] = ++t.latestGen;
+    t.latestBuffer = m_writeIndex;
+    m_updates.ref();
+
+    return true;
+}
+
+QSharedPointer<AVFrame> Canvas::Publish()
+{
+    QWriteLocker lock(&m_lock);
+
+    Buffer& buffer = m_buffers[m_writeIndex];
+
+    m_updates.store(0);
+
+    // Bring tiles which were not refreshed in this buffer up to date
+    for (int i = 0; i < m_tiles.size(); i++)
+    {
+        const Tile& tile = m_tiles[i];
+
+        if (buffer.tileGen[i] != tile.latestGen)
+        {
+            const Buffer& src = m_buffers[tile.latestBuffer];
+
+            m_bytesCarried += CopyTile(buffer, src, tile);
+            m_tilesCarried++;
+            buffer.tileGen[i] = tile.latestGen;
+            buffer.tileWidth[i] = src.tileWidth[i];
+            buffer.tileHeight[i] = src.tileHeight[i];
+        }
+    }
+
+    // Reference is released by encoder once it has consumed the frame
+    QAtomicInt* pInUse = &buffer.inUse;
+    QSharedPointer<AVFrame> pPublished(buffer.pFrame, [pInUse](AVFrame*){ pInUse->storeRelease(0); });
+
+    buffer.inUse.storeRelease(1);
+
+    // Next free buffer becomes the write buffer. Falling back to a busy one may tear the frame being encoded
+    int next = (m_writeIndex + 1) % m_buffers.size();
+    for (int i = 0; (i < m_buffers.size() - 1) && m_buffers[next].inUse.loadAcquire(); i++)
+    {
+        next = (next + 1) % m_buffers.size();
+    }
+    if (next == m_writeIndex)
+    {
+        next = (m_writeIndex + 1) % m_buffers.size();
+        m_buffersBusy++;
+    }
+    m_writeIndex = next;
+    m_published++;
+
+    int64_t nowUs = MonotonicTimeUs();
+    if (nowUs - m_statsStartUs >= STATS_INTERVAL_MSEC * 1000)
+    {
+        ERROR_MESSAGE4(ERR_TYPE_MESSAGE, "Canvas", "Canvas stats: %lld frames published, %lld tiles carried over (%lld KB copied), %lld times no free buffer",
+                       (long long)m_published,
+                       (long long)m_tilesCarried,
+                       (long long)(m_bytesCarried / 1024),
+                       (long long)m_buffersBusy);
+        m_statsStartUs = nowUs;
+        m_published = 0;
+        m_tilesCarried = 0;
+        m_bytesCarried = 0;
+        m_buffersBusy = 0;
+    }
+
+    return pPublished;
+}
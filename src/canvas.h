@@ -0,0 +1,82 @@
+#ifndef CANVAS_H
+#define CANVAS_H
+
+#include <QVector>
+#include <QReadWriteLock>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+
+#include "common.h"
+#include "videoScaler.h"
+#include "overlay.h"
+
+/*
+ * Multi-buffered output canvas with addressable tiles
+ * Streams scale their frames directly into the tile of the current write buffer (zero-copy compose),
+ * builder publishes the write buffer and moves on to the next one.
+ * Tiles which were not refreshed in the new write buffer are carried over from the buffer holding
+ * their latest content, so only stalled tiles are ever copied.
+ * Buffers still referenced by encoder are skipped, so there must be more buffers than frames the encoder may hold.
+*/
+
+class Canvas
+{
+public:
+    Canvas(int width, int height, int numBuffers);
+    ~Canvas();
+
+    int         AddTile(int x, int y, int width, int height);       /// Returns tile index
+    void        SetOverlay(Overlay* pOverlay);                      /// Overlay tiles must match canvas tiles. Call before streams start
+
+    bool        WriteTile(int tile, AVFrame* pInFrame, VideoScaler* pScaler);   /// Stream side, thread-safe
+    bool        WritePlaceholder(int tile, const AVFrame* pFrame);  /// Builder side. Tile sized picture, does not count as tile update
+    int64_t     TileUpdateUs(int tile) const { return m_tiles[tile].updateUs.loadAcquire(); }  /// Monotonic time of the last WriteTile(), 0 if none
+    bool        HasUpdates() const { return m_updates.loadAcquire() != 0; }     /// Any tile written since last Publish()
+    QSharedPointer<AVFrame> Publish();                              /// Builder side. Buffer is not written again until the last reference is dropped
+
+private:
+    Q_DISABLE_COPY(Canvas)
+
+    struct Tile
+    {
+        int x;
+        int y;
+        int width;
+        int height;
+        int latestGen;          /// Generation of the most recent tile content
+        int latestBuffer;       /// Buffer holding the most recent tile content
+        QAtomicInt writing;     /// Set while the tile is written, stream and builder may both write it
+        QAtomicInteger<qint64> updateUs;
+    };
+
+    struct Buffer
+    {
+        AVFrame*        pFrame;
+        QAtomicInt      inUse;          /// Set while published frame is referenced by encoder
+        QVector<int>    tileGen;        /// Generation of each tile content in this buffer
+        QVector<int>    tileWidth;      /// Size of the scaled picture drawn in each tile
+        QVector<int>    tileHeight;
+    };
+
+    int                 m_width;
+    int                 m_height;
+    QVector<Tile>       m_tiles;
+    QVector<Buffer>     m_buffers;
+    int                 m_writeIndex;   /// Buffer streams are currently writing into
+    Overlay*            m_pOverlay;     /// Blended over each written tile, not owned
+    QReadWriteLock      m_lock;         /// Streams lock for read (disjoint tiles), Publish() locks for write
+    QAtomicInt          m_updates;      /// Tile writes since last Publish()
+
+    // Statistics
+    int64_t             m_statsStartUs;
+    int64_t             m_published;
+    int64_t             m_tilesCarried;
+    int64_t             m_bytesCarried;
+    int64_t             m_buffersBusy;  /// Publish() found no free buffer and reused one still held by encoder
+
+    bool    ScaleIntoTile(int tile, AVFrame* pInFrame, VideoScaler* pScaler);
+    void    FillTile(Buffer& buffer, const Tile& tile);
+    int     CopyTile(Buffer& dst, const Buffer& src, const Tile& tile);
+};
+
+#endif // CANVAS_H
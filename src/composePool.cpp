@@ -0,0 +1,115 @@
+#include "composePool.h"
+
+#include "common.h"
+
+ComposePool::ComposePool(int numThreads) :
+    m_generation(0),
+    m_pendingWorkers(0),
+    m_stop(false),
+    m_pJob(NULL),
+    m_numJobs(0),
+    m_nextJob(0)
+{
+    if (numThreads <= 0)
+    {
+        numThreads = FFMAX(1, QThread::idealThreadCount());
+    }
+
+    // Caller of Run() is one of the threads
+    for (int i = 1; i < numThreads; i++)
+    {
+        Worker* pWorker = new Worker(this);
+
+        m_workers.append(pWorker);
+        pWorker->start();
+    }
+    ERROR_MESSAGE1(ERR_TYPE_MESSAGE, "ComposePool", "Created compose pool with %d threads", numThreads);
+}
+
+ComposePool::~ComposePool()
+{
+    {
+        QMutexLocker lock(&m_mutex);
+        m_stop = true;
+        m_startCondition.wakeAll();
+    }
+    for (int i = 0; i < m_workers.size(); i++)
+    {
+        m_workers[i]->wait();
+        delete m_workers[i];
+    }
+}
+
+void ComposePool::Run(ComposeJob* pJob, int numJobs)
+{
+    if (m_workers.isEmpty() || (numJobs <= 1))
+    {
+        for (int i = 0; i < numJobs; i++)
+        {
+            pJob->RunComposeJob(i);
+        }
+        return;
+    }
+
+    {
+        QMutexLocker lock(&m_mutex);
+        m_pJob = pJob;
+        m_numJobs = numJobs;
+        m_nextJob.storeRelease(0);
+        m_pendingWorkers = m_workers.size();
+        m_generation++;
+        m_startCondition.wakeAll();
+    }
+
+    RunJobs();
+
+    // Every job index is taken, wait until workers have finished the ones they took.
+    // All workers have to check in, so none of them can see job state of the next Run()
+    QMutexLocker lock(&m_mutex);
+    while (m_pendingWorkers > 0)
+    {
+        m_doneCondition.wait(&m_mutex);
+    }
+}
+
+void ComposePool::WorkerLoop()
+{
+    QMutexLocker lock(&m_mutex);
+    int seenGeneration = 0;     // Worker may start after the first Run(), it still has to take part in it
+
+    while (true)
+    {
+        while (!m_stop && (seenGeneration == m_generation))
+        {
+            m_startCondition.wait(&m_mutex);
+        }
+        if (m_stop)
+        {
+            break;
+        }
+        seenGeneration = m_generation;
+
+        lock.unlock();
+        RunJobs();
+        lock.relock();
+
+        if (0 == --m_pendingWorkers)
+        {
+            m_doneCondition.wakeAll();
+        }
+    }
+}
+
+void ComposePool::RunJobs()
+{
+    while (true)
+    {
+        int index = m_nextJob.fetchAndAddOrdered(1);
+
+        if (index >= m_numJobs)
+        {
+            break;
+        }
+        m_pJob->RunComposeJob(index);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef COMPOSEPOOL_H
+#define COMPOSEPOOL_H
+
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QAtomicInt>
+#include <QWaitCondition>
+
+/*
+ * Set of independent jobs executed by ComposePool
+ * Jobs of one Run() may execute concurrently in any order, so they must write disjoint memory
+*/
+class ComposeJob
+{
+public:
+    virtual ~ComposeJob() {}
+    virtual void RunComposeJob(int index) = 0;
+};
+
+/*
+ * Fork-join pool for compositing one output frame
+ * Run() hands job indices out to workers and the calling thread and returns when all are done.
+ * Separate from DecoderPool, so frame composition is never queued behind decode tasks
+*/
+class ComposePool
+{
+public:
+    ComposePool(int numThreads);    /// Total threads including caller. numThreads <= 0 means one per cpu core
+    ~ComposePool();
+
+    void    Run(ComposeJob* pJob, int numJobs);     /// Blocks until all jobs are finished. Not reentrant
+    int     NumThreads() const { return m_workers.size() + 1; }
+
+private:
+    class Worker : public QThread
+    {
+    public:
+        Worker(ComposePool* pPool) : QThread(NULL), m_pPool(pPool) {}
+
+    protected:
+        void run() { m_pPool->WorkerLoop(); }
+
+    private:
+        ComposePool*    m_pPool;
+    };
+
+    QVector<Worker*>    m_workers;
+    QMutex              m_mutex;
+    QWaitCondition      m_startCondition;   /// New generation of jobs or stop
+    QWaitCondition      m_doneCondition;    /// Last worker finished its part
+    int                 m_generation;       /// Guarded by m_mutex
+    int                 m_pendingWorkers;   /// Workers which have not finished current generation, guarded by m_mutex
+    bool                m_stop;             /// Guarded by m_mutex
+    ComposeJob*         m_pJob;
+    int                 m_numJobs;
+    QAtomicInt          m_nextJob;
+
+    void    WorkerLoop();
+    void    RunJobs();
+};
+
+#endif // COMPOSEPOOL_H
@@ -0,0 +1,179 @@
+#include "decoderPool.h"
+
+#include "common.h"
+#include "statistics.h"
+
+DecoderPool::DecoderPool(int numThreads) :
+    m_pendingTasks(0),
+    m_nextAffinity(0),
+    m_stop(0)
+{
+    if (numThreads <= 0)
+    {
+        numThreads = FFMAX(1, QThread::idealThreadCount());
+    }
+
+    for (int i = 0; i < numThreads; i++)
+    {
+        m_queues.append(new WorkerQueue());
+        m_workers.append(new Worker(this, i));
+    }
+    ERROR_MESSAGE1(ERR_TYPE_MESSAGE, "DecoderPool", "Created %d decode workers", numThreads);
+}
+
+DecoderPool::~DecoderPool()
+{
+    ERROR_MESSAGE0(ERR_TYPE_MESSAGE, "DecoderPool", "~DecoderPool() called");
+    Stop();
+    for (int i = 0; i < m_workers.size(); i++)
+    {
+        delete m_workers[i];
+        delete m_queues[i];
+    }
+}
+
+void DecoderPool::Start()
+{
+    m_stop.store(0);
+    for (int i = 0; i < m_workers.size(); i++)
+    {
+        m_workers[i]->start();
+    }
+}
+
+void DecoderPool::Stop()
+{
+    // Stop flag is raised under every queue mutex, so each Submit() either sees it or queues before the clear below
+    for (int i = 0; i < m_queues.size(); i++)
+    {
+        QMutexLocker lock(&m_queues[i]->mutex);
+        m_stop.store(1);
+    }
+    {
+        QMutexLocker lock(&m_sleepMutex);
+        for (int i = 0; i < m_queues.size(); i++)
+        {
+            m_queues[i]->wakeup.wakeAll();
+        }
+    }
+    for (int i = 0; i < m_workers.size(); i++)
+    {
+        m_workers[i]->wait();
+    }
+    for (int i = 0; i < m_queues.size(); i++)
+    {
+        QMutexLocker lock(&m_queues[i]->mutex);
+        m_queues[i]->tasks.clear();
+    }
+    m_pendingTasks.store(0);
+}
+
+int DecoderPool::NextAffinity()
+{
+    return m_nextAffinity.fetchAndAddRelaxed(1) % m_workers.size();
+}
+
+bool DecoderPool::Submit(DecodeTask* pTask, int affinity)
+{
+    int home = affinity % m_queues.size();
+
+    {
+        QMutexLocker lock(&m_queues[home]->mutex);
+
+        // Task queued after Stop() would never run nor be cleared
+        if (m_stop.load())
+        {
+            return false;
+        }
+        m_queues[home]->tasks.append(pTask);
+    }
+    m_pendingTasks.fetchAndAddOrdered(1);
+
+    // Prefer home worker, otherwise wake up anybody idle to steal the task
+    QMutexLocker lock(&m_sleepMutex);
+
+    if (m_queues[home]->sleeping)
+    {
+        m_queues[home]->wakeup.wakeOne();
+        return true;
+    }
+    for (int i = 0; i < m_queues.size(); i++)
+    {
+        if (m_queues[i]->sleeping)
+        {
+            m_queues[i]->wakeup.wakeOne();
+            return true;
+        }
+    }
+    return true;
+}
+
+bool DecoderPool::TakeTask(int index, DecodeTask** ppTask, bool* pStolen)
+{
+    int numQueues = m_queues.size();
+
+    // Own queue first (oldest task), then steal from the tail of other queues
+    for (int i = 0; i < numQueues; i++)
+    {
+        WorkerQueue* pQueue = m_queues[(index + i) % numQueues];
+        QMutexLocker lock(&pQueue->mutex);
+
+        if (!pQueue->tasks.isEmpty())
+        {
+            *ppTask = (0 == i) ? pQueue->tasks.takeFirst() : pQueue->tasks.takeLast();
+            *pStolen = (0 != i);
+            m_pendingTasks.fetchAndAddOrdered(-1);
+            return true;
+        }
+    }
+    return false;
+}
+
+void DecoderPool::WorkerLoop(int index)
+{
+    DecodeTask* pTask;
+    bool        stolen;
+    int64_t     tasksDone = 0;
+    int64_t     tasksStolen = 0;
+    int64_t     statsStartUs = MonotonicTimeUs();
+    int64_t     statsCpuStartUs = ThreadCpuTimeUs();
+
+    while (!m_stop.load())
+    {
+        if (TakeTask(index, &pTask, &stolen))
+        {
+            pTask->RunDecodeTask();
+            tasksDone++;
+            tasksStolen += stolen ? 1 : 0;
+        }
+        else
+        {
+            QMutexLocker lock(&m_sleepMutex);
+
+            // Tasks submitted before the lock was taken are seen here, later ones will wake us up
+            if ((0 == m_pendingTasks.load()) && !m_stop.load())
+            {
+                m_queues[index]->sleeping = true;
+                m_queues[index]->wakeup.wait(&m_sleepMutex, 100);
+                m_queues[index]->sleeping = false;
+            }
+        }
+
+        int64_t nowUs = MonotonicTimeUs();
+
+        if (nowUs - statsStartUs >= STATS_INTERVAL_MSEC * 1000)
+        {
+            int64_t cpuNowUs = ThreadCpuTimeUs();
+
+            ERROR_MESSAGE4(ERR_TYPE_MESSAGE, "DecoderPool", "Worker %d stats: %lld tasks, %lld stolen, busy %.2f%%",
+                           index,
+                           (long long)tasksDone,
+                           (long long)tasksStolen,
+                           100.0 * (double)(cpuNowUs - statsCpuStartUs) / (double)(nowUs - statsStartUs));
+            tasksDone = 0;
+            tasksStolen = 0;
+            statsStartUs = nowUs;
+            statsCpuStartUs = cpuNowUs;
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef DECODERPOOL_H
+#define DECODERPOOL_H
+
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QAtomicInt>
+#include <QWaitCondition>
+
+/*
+ * Work item executed by DecoderPool
+ * The same task object may be submitted again after (or while) it runs
+*/
+class DecodeTask
+{
+public:
+    virtual ~DecodeTask() {}
+    virtual void RunDecodeTask() = 0;
+};
+
+/*
+ * Fixed-size pool of decode workers shared by all streams
+ * Each task is queued to its home worker (affinity), idle workers steal tasks
+ * from busy ones, so decode and scale work of any stream can run on any worker
+*/
+class DecoderPool
+{
+public:
+    DecoderPool(int numThreads);    /// numThreads <= 0 means one worker per cpu core
+    ~DecoderPool();
+
+    void    Start();
+    void    Stop();                 /// Waits for workers to finish. Tasks still queued are discarded, later ones are rejected
+
+    bool    Submit(DecodeTask* pTask, int affinity);    /// Returns false if pool is stopped, task is not queued then
+    int     NextAffinity();         /// Round-robin home worker for a new task owner
+    int     NumThreads() const { return m_workers.size(); }
+
+private:
+    class Worker : public QThread
+    {
+    public:
+        Worker(DecoderPool* pPool, int index) : QThread(NULL), m_pPool(pPool), m_index(index) {}
+
+    protected:
+        void run() { m_pPool->WorkerLoop(m_index); }
+
+    private:
+        DecoderPool*    m_pPool;
+        int             m_index;
+    };
+
+    struct WorkerQueue
+    {
+        WorkerQueue() : sleeping(false) {}
+
+        QMutex              mutex;
+        QList<DecodeTask*>  tasks;
+        QWaitCondition      wakeup;     /// Guarded by DecoderPool::m_sleepMutex
+        bool                sleeping;   /// Guarded by DecoderPool::m_sleepMutex
+    };
+
+    QVector<Worker*>        m_workers;
+    QVector<WorkerQueue*>   m_queues;
+    QMutex                  m_sleepMutex;
+    QAtomicInt              m_pendingTasks;
+    QAtomicInt              m_nextAffinity;
+    QAtomicInt              m_stop;
+
+    void    WorkerLoop(int index);
+    bool    TakeTask(int index, DecodeTask** ppTask, bool* pStolen);
+};
+
+#endif // DECODERPOOL_H
@@ -53,6 +53,14 @@
         pErrHandler->ErrorMessage(T, O, str); \
     } while (0)
 
+#define ERROR_MESSAGE6(T,O,M,P1,P2,P3,P4,P5,P6) \
+    do { \
+        char             str[1024]; \
+        ErrorHandler*    pErrHandler = ErrorHandler::instance(); \
+        snprintf(str, 1024, M, P1, P2, P3, P4, P5, P6); \
+        pErrHandler->ErrorMessage(T, O, str); \
+    } while (0)
+
 #ifdef _DEBUG
 
 #define DEBUG_MESSAGE0(O,M) \
@@ -0,0 +1,109 @@
+#include "font.h"
+
+const uint8_t fontGlyphs[FONT_LAST_CHAR - FONT_FIRST_CHAR + 1][FONT_GLYPH_HEIGHT] =
+{
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // ' '
+    {0x00, 0x00, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00},  // '!'
+    {0x00, 0x00, 0x24, 0x24, 0x24, 0x24, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // '"'
+    {0x00, 0x00, 0x12, 0x12, 0x16, 0x7F, 0x34, 0x24, 0xFE, 0x6C, 0x68, 0x48, 0x00, 0x00, 0x00, 0x00},  // '#'
+    {0x00, 0x00, 0x08, 0x1C, 0x3E, 0x68, 0x68, 0x3C, 0x0E, 0x0A, 0x4A, 0x7C, 0x08, 0x08, 0x00, 0x00},  // '$'
+    {0x00, 0x00, 0x00, 0x70, 0x90, 0xD0, 0x76, 0x38, 0x4E, 0x09, 0x09, 0x0E, 0x00, 0x00, 0x00, 0x00},  // '%'
+    {0x00, 0x00, 0x3C, 0x60, 0x60, 0x20, 0x70, 0x59, 0xC9, 0xC7, 0x46, 0x7F, 0x00, 0x00, 0x00, 0x00},  // '&'
+    {0x00, 0x00, 0x18, 0x18, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // '''
+    {0x00, 0x00, 0x0C, 0x08, 0x18, 0x10, 0x10, 0x10, 0x10, 0x10, 0x18, 0x18, 0x08, 0x0C, 0x00, 0x00},  // '('
+    {0x00, 0x00, 0x30, 0x10, 0x18, 0x08, 0x08, 0x08, 0x08, 0x08, 0x18, 0x18, 0x10, 0x30, 0x00, 0x00},  // ')'
+    {0x00, 0x00, 0x00, 0x42, 0x3C, 0x3C, 0x66, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // '*'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x18, 0xFF, 0x7E, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00},  // '+'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x18, 0x10, 0x10, 0x00, 0x00},  // ','
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // '-'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00},  // '.'
+    {0x00, 0x00, 0x02, 0x06, 0x04, 0x0C, 0x08, 0x18, 0x10, 0x30, 0x20, 0x60, 0x40, 0x00, 0x00, 0x00},  // '/'
+    {0x00, 0x00, 0x3C, 0x66, 0x66, 0x42, 0x5A, 0x5A, 0x42, 0x66, 0x66, 0x3C, 0x00, 0x00, 0x00, 0x00},  // '0'
+    {0x00, 0x00, 0x38, 0x78, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x3E, 0x00, 0x00, 0x00, 0x00},  // '1'
+    {0x00, 0x00, 0x7C, 0x6E, 0x06, 0x06, 0x04, 0x0C, 0x18, 0x30, 0x60, 0x7E, 0x00, 0x00, 0x00, 0x00},  // '2'
+    {0x00, 0x00, 0x7C, 0x6E, 0x06, 0x06, 0x3C, 0x0C, 0x06, 0x02, 0x06, 0x7C, 0x00, 0x00, 0x00, 0x00},  // '3'
+    {0x00, 0x00, 0x0C, 0x0C, 0x1C, 0x34, 0x24, 0x64, 0x4C, 0x7E, 0x04, 0x04, 0x00, 0x00, 0x00, 0x00},  // '4'
+    {0x00, 0x00, 0x7C, 0x7C, 0x60, 0x70, 0x7C, 0x06, 0x06, 0x06, 0x06, 0x7C, 0x00, 0x00, 0x00, 0x00},  // '5'
+    {0x00, 0x00, 0x1C, 0x34, 0x60, 0x48, 0x7E, 0x66, 0x42, 0x42, 0x66, 0x3C, 0x00, 0x00, 0x00, 0x00},  // '6'
+    {0x00, 0x00, 0x7E, 0x7E, 0x06, 0x04, 0x0C, 0x08, 0x18, 0x18, 0x10, 0x30, 0x00, 0x00, 0x00, 0x00},  // '7'
+    {0x00, 0x00, 0x3C, 0x66, 0x66, 0x66, 0x3C, 0x7E, 0x42, 0x42, 0x66, 0x3C, 0x00, 0x00, 0x00, 0x00},  // '8'
+    {0x00, 0x00, 0x3C, 0x66, 0x46, 0x42, 0x46, 0x6E, 0x3A, 0x06, 0x06, 0x7C, 0x00, 0x00, 0x00, 0x00},  // '9'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x18, 0x00, 0x00, 0x00, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00},  // ':'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x18, 0x00, 0x00, 0x00, 0x18, 0x18, 0x10, 0x10, 0x00, 0x00},  // ';'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0x3C, 0xE0, 0x70, 0x1E, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00},  // '<'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x00, 0x7E, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // '='
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0xE0, 0x3C, 0x07, 0x0E, 0x78, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00},  // '>'
+    {0x00, 0x00, 0x3C, 0x66, 0x06, 0x06, 0x0C, 0x18, 0x18, 0x10, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00},  // '?'
+    {0x00, 0x00, 0x00, 0x3E, 0x62, 0x43, 0xDF, 0x93, 0x91, 0x93, 0xDF, 0x40, 0x60, 0x1E, 0x00, 0x00},  // '@'
+    {0x00, 0x00, 0x18, 0x18, 0x3C, 0x3C, 0x24, 0x66, 0x7E, 0x7E, 0x42, 0xC3, 0x00, 0x00, 0x00, 0x00},  // 'A'
+    {0x00, 0x00, 0x7C, 0x7E, 0x62, 0x66, 0x7C, 0x6E, 0x62, 0x62, 0x66, 0x7C, 0x00, 0x00, 0x00, 0x00},  // 'B'
+    {0x00, 0x00, 0x1E, 0x32, 0x60, 0x60, 0x40, 0x40, 0x60, 0x60, 0x22, 0x3E, 0x00, 0x00, 0x00, 0x00},  // 'C'
+    {0x00, 0x00, 0x78, 0x7C, 0x46, 0x42, 0x42, 0x42, 0x42, 0x46, 0x4C, 0x78, 0x00, 0x00, 0x00, 0x00},  // 'D'
+    {0x00, 0x00, 0x7E, 0x7E, 0x60, 0x60, 0x7E, 0x7E, 0x60, 0x60, 0x60, 0x7E, 0x00, 0x00, 0x00, 0x00},  // 'E'
+    {0x00, 0x00, 0x7E, 0x7E, 0x60, 0x60, 0x7E, 0x60, 0x60, 0x60, 0x60, 0x60, 0x00, 0x00, 0x00, 0x00},  // 'F'
+    {0x00, 0x00, 0x1C, 0x36, 0x60, 0x40, 0x40, 0x4E, 0x42, 0x62, 0x62, 0x3E, 0x00, 0x00, 0x00, 0x00},  // 'G'
+    {0x00, 0x00, 0x42, 0x42, 0x42, 0x42, 0x7E, 0x7E, 0x42, 0x42, 0x42, 0x42, 0x00, 0x00, 0x00, 0x00},  // 'H'
+    {0x00, 0x00, 0x7E, 0x7E, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x7E, 0x00, 0x00, 0x00, 0x00},  // 'I'
+    {0x00, 0x00, 0x3C, 0x1C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x4C, 0x7C, 0x00, 0x00, 0x00, 0x00},  // 'J'
+    {0x00, 0x00, 0x43, 0x46, 0x4C, 0x58, 0x70, 0x78, 0x4C, 0x44, 0x46, 0x43, 0x00, 0x00, 0x00, 0x00},  // 'K'
+    {0x00, 0x00, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x60, 0x7F, 0x00, 0x00, 0x00, 0x00},  // 'L'
+    {0x00, 0x00, 0xC3, 0xE7, 0xE7, 0xFF, 0xDB, 0xDB, 0xC3, 0xC3, 0xC3, 0xC3, 0x00, 0x00, 0x00, 0x00},  // 'M'
+    {0x00, 0x00, 0x62, 0x62, 0x72, 0x72, 0x52, 0x5A, 0x4E, 0x4E, 0x46, 0x46, 0x00, 0x00, 0x00, 0x00},  // 'N'
+    {0x00, 0x00, 0x3C, 0x66, 0x66, 0x42, 0x42, 0x42, 0x42, 0x42, 0x66, 0x3C, 0x00, 0x00, 0x00, 0x00},  // 'O'
+    {0x00, 0x00, 0x7C, 0x7E, 0x62, 0x63, 0x66, 0x7E, 0x60, 0x60, 0x60, 0x60, 0x00, 0x00, 0x00, 0x00},  // 'P'
+    {0x00, 0x00, 0x3C, 0x66, 0x66, 0x42, 0x42, 0x42, 0x42, 0x42, 0x66, 0x3C, 0x0C, 0x04, 0x00, 0x00},  // 'Q'
+    {0x00, 0x00, 0x78, 0x7E, 0x46, 0x46, 0x66, 0x7C, 0x44, 0x46, 0x42, 0x43, 0x00, 0x00, 0x00, 0x00},  // 'R'
+    {0x00, 0x00, 0x3C, 0x66, 0x40, 0x60, 0x78, 0x1E, 0x06, 0x02, 0x46, 0x7C, 0x00, 0x00, 0x00, 0x00},  // 'S'
+    {0x00, 0x00, 0xFF, 0xFF, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00},  // 'T'
+    {0x00, 0x00, 0x42, 0x42, 0x42, 0x42, 0x42, 0x42, 0x42, 0x42, 0x66, 0x3C, 0x00, 0x00, 0x00, 0x00},  // 'U'
+    {0x00, 0x00, 0xC3, 0x42, 0x42, 0x66, 0x66, 0x24, 0x3C, 0x3C, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00},  // 'V'
+    {0x00, 0x00, 0x81, 0xC3, 0xC3, 0xDB, 0xDB, 0x5A, 0x7E, 0x66, 0x66, 0x66, 0x00, 0x00, 0x00, 0x00},  // 'W'
+    {0x00, 0x00, 0x43, 0x66, 0x24, 0x3C, 0x18, 0x18, 0x3C, 0x26, 0x66, 0xC3, 0x00, 0x00, 0x00, 0x00},  // 'X'
+    {0x00, 0x00, 0xC3, 0x42, 0x66, 0x3C, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00},  // 'Y'
+    {0x00, 0x00, 0x7F, 0x7E, 0x06, 0x0C, 0x08, 0x18, 0x10, 0x20, 0x60, 0x7F, 0x00, 0x00, 0x00, 0x00},  // 'Z'
+    {0x00, 0x00, 0x1C, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x18, 0x1C, 0x00, 0x00},  // '['
+    {0x00, 0x00, 0x40, 0x60, 0x20, 0x30, 0x30, 0x18, 0x18, 0x08, 0x0C, 0x04, 0x06, 0x00, 0x00, 0x00},  // backslash
+    {0x00, 0x00, 0x38, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x18, 0x38, 0x00, 0x00},  // ']'
+    {0x00, 0x00, 0x18, 0x3C, 0x66, 0x42, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // '^'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x00},  // '_'
+    {0x00, 0x20, 0x10, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},  // '`'
+    {0x00, 0x00, 0x00, 0x00, 0x18, 0x7C, 0x06, 0x3E, 0x76, 0x46, 0x46, 0x7E, 0x00, 0x00, 0x00, 0x00},  // 'a'
+    {0x00, 0x00, 0x60, 0x60, 0x68, 0x7E, 0x66, 0x62, 0x62, 0x62, 0x66, 0x7C, 0x00, 0x00, 0x00, 0x00},  // 'b'
+    {0x00, 0x00, 0x00, 0x00, 0x0C, 0x3E, 0x60, 0x60, 0x60, 0x60, 0x20, 0x3E, 0x00, 0x00, 0x00, 0x00},  // 'c'
+    {0x00, 0x00, 0x06, 0x06, 0x16, 0x7E, 0x66, 0x46, 0x46, 0x46, 0x66, 0x3E, 0x00, 0x00, 0x00, 0x00},  // 'd'
+    {0x00, 0x00, 0x00, 0x00, 0x18, 0x3E, 0x62, 0x62, 0x7E, 0x40, 0x62, 0x3E, 0x00, 0x00, 0x00, 0x00},  // 'e'
+    {0x00, 0x00, 0x0E, 0x18, 0x18, 0x7E, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00},  // 'f'
+    {0x00, 0x00, 0x00, 0x00, 0x10, 0x7E, 0x66, 0x46, 0x46, 0x46, 0x66, 0x3E, 0x06, 0x04, 0x38, 0x00},  // 'g'
+    {0x00, 0x00, 0x60, 0x60, 0x68, 0x7E, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x00, 0x00, 0x00, 0x00},  // 'h'
+    {0x00, 0x00, 0x18, 0x08, 0x00, 0x38, 0x18, 0x18, 0x18, 0x18, 0x18, 0x7E, 0x00, 0x00, 0x00, 0x00},  // 'i'
+    {0x00, 0x00, 0x08, 0x08, 0x00, 0x38, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x18, 0x70, 0x00},  // 'j'
+    {0x00, 0x00, 0x60, 0x60, 0x60, 0x66, 0x6C, 0x78, 0x78, 0x6C, 0x66, 0x63, 0x00, 0x00, 0x00, 0x00},  // 'k'
+    {0x00, 0x00, 0x70, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x18, 0x0E, 0x00, 0x00, 0x00, 0x00},  // 'l'
+    {0x00, 0x00, 0x00, 0x00, 0x14, 0x7E, 0x5A, 0x5A, 0x5A, 0x5A, 0x5A, 0x5A, 0x00, 0x00, 0x00, 0x00},  // 'm'
+    {0x00, 0x00, 0x00, 0x00, 0x08, 0x7E, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x00, 0x00, 0x00, 0x00},  // 'n'
+    {0x00, 0x00, 0x00, 0x00, 0x18, 0x3C, 0x66, 0x42, 0x42, 0x42, 0x66, 0x3C, 0x00, 0x00, 0x00, 0x00},  // 'o'
+    {0x00, 0x00, 0x00, 0x00, 0x08, 0x7E, 0x66, 0x62, 0x62, 0x62, 0x66, 0x7C, 0x60, 0x60, 0x60, 0x00},  // 'p'
+    {0x00, 0x00, 0x00, 0x00, 0x10, 0x3E, 0x66, 0x46, 0x42, 0x46, 0x66, 0x3E, 0x02, 0x02, 0x02, 0x00},  // 'q'
+    {0x00, 0x00, 0x00, 0x00, 0x06, 0x3F, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x00, 0x00, 0x00, 0x00},  // 'r'
+    {0x00, 0x00, 0x00, 0x00, 0x18, 0x3C, 0x60, 0x70, 0x3C, 0x06, 0x06, 0x7C, 0x00, 0x00, 0x00, 0x00},  // 's'
+    {0x00, 0x00, 0x00, 0x10, 0x30, 0x7E, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1E, 0x00, 0x00, 0x00, 0x00},  // 't'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x3E, 0x00, 0x00, 0x00, 0x00},  // 'u'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x42, 0x66, 0x66, 0x24, 0x3C, 0x18, 0x18, 0x00, 0x00, 0x00, 0x00},  // 'v'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x81, 0xC3, 0xDB, 0x5A, 0x7E, 0x66, 0x66, 0x00, 0x00, 0x00, 0x00},  // 'w'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x66, 0x3C, 0x18, 0x18, 0x3C, 0x66, 0x42, 0x00, 0x00, 0x00, 0x00},  // 'x'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x42, 0x66, 0x26, 0x34, 0x3C, 0x18, 0x18, 0x18, 0x30, 0x60, 0x00},  // 'y'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x7E, 0x04, 0x0C, 0x18, 0x30, 0x60, 0x7E, 0x00, 0x00, 0x00, 0x00},  // 'z'
+    {0x00, 0x00, 0x0E, 0x18, 0x18, 0x18, 0x18, 0x30, 0x30, 0x18, 0x18, 0x18, 0x18, 0x0E, 0x00, 0x00},  // '{'
+    {0x00, 0x00, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00},  // '|'
+    {0x00, 0x00, 0x70, 0x18, 0x18, 0x18, 0x18, 0x0C, 0x0C, 0x18, 0x18, 0x18, 0x18, 0x70, 0x00, 0x00},  // '}'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7B, 0x0E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}    // '~'
+};
+
+const uint8_t* FontGlyph(char c)
+{
+    if ((c < FONT_FIRST_CHAR) || (c > FONT_LAST_CHAR))
+    {
+        c = '?';
+    }
+    return fontGlyphs[c - FONT_FIRST_CHAR];
+}
@@ -0,0 +1,20 @@
+#ifndef FONT_H
+#define FONT_H
+
+#include <stdint.h>
+
+#define FONT_GLYPH_WIDTH    8
+#define FONT_GLYPH_HEIGHT   16
+#define FONT_FIRST_CHAR     32      // ' '
+#define FONT_LAST_CHAR      126     // '~'
+
+/*
+ * Built-in 8x16 bitmap font for printable ASCII, one byte per row, MSB is the leftmost pixel
+ * Rasterized from DejaVu Sans Mono (Bitstream Vera license)
+*/
+extern const uint8_t fontGlyphs[FONT_LAST_CHAR - FONT_FIRST_CHAR + 1][FONT_GLYPH_HEIGHT];
+
+// Glyph rows for a character, characters outside of the font are drawn as '?'
+const uint8_t* FontGlyph(char c);
+
+#endif // FONT_H
@@ -1,34 +1,222 @@
 #include "frameBuffer.h"
+#include "statistics.h"
 
-FrameBuffer::FrameBuffer()
+#include <algorithm>
+
+#define FRAME_BUFFER_INDEX_MASK     3           // Slot index bits of m_middle
+#define FRAME_BUFFER_FRESH          4           // Middle slot holds a frame consumer has not seen yet
+#define FRAME_BUFFER_RESYNC_US      1000000     // Pts to clock offset jump treated as timeline discontinuity
+#define FRAME_BUFFER_OFFSET_CREEP_US 4          // Per frame offset increase, follows camera clock running slower than ours
+#define FRAME_BUFFER_DEFAULT_INTERVAL_US 40000  // Frame interval assumed until measured
+
+static inline int64_t Distance(int64_t a, int64_t b)
+{
+    return (a > b) ? a - b : b - a;
+}
+
+FrameBuffer::FrameBuffer(int depth) :
+    m_depth(std::max(depth, 1)),
+    m_middle(1),
+    m_writeIndex(0),
+    m_readIndex(2),
+    m_pQueue(NULL),
+    m_clockOffsetUs(0),
+    m_frameIntervalUs(FRAME_BUFFER_DEFAULT_INTERVAL_US),
+    m_lastPtsUs(AV_NOPTS_VALUE),
+    m_shownPtsUs(AV_NOPTS_VALUE),
+    m_lastFrameUs(0),
+    m_reconnects(0),
+    m_published(0),
+    m_dropped(0),
+    m_shown(0),
+    m_repeated(0)
 {
-    m_buffer.resize(1);
-    m_buffer.setSharable(true);
+    if (m_depth > 1)
+    {
+        // Builder drains the queue every tick, camera may deliver a few frames per tick
+        m_pQueue = new SpscQueue<Entry>(m_depth * 2);
+        m_ring.reserve(m_depth * 2);
+    }
 }
 
 FrameBuffer::~FrameBuffer()
 {
     ERROR_MESSAGE0(ERR_TYPE_MESSAGE, "FrameBuffer", "~FrameBuffer() called");
-    m_buffer.clear();
+    delete m_pQueue;
+}
+
+QSharedPointer<AVFrame> FrameBuffer::GetFrame(int64_t tickUs)
+{
+    return (NULL == m_pQueue) ? GetNewestFrame() : GetTimedFrame(tickUs);
+}
+
+QSharedPointer<AVFrame> FrameBuffer::GetNewestFrame()
+{
+    if (m_middle.loadAcquire() & FRAME_BUFFER_FRESH)
+    {
+        // Take published slot, give back the one consumer has finished with
+        int previous = m_middle.fetchAndStoreOrdered(m_readIndex);
+        m_readIndex = previous & FRAME_BUFFER_INDEX_MASK;
+        m_shown++;
+    }
+    else if (!m_slots[m_readIndex].isNull())
+    {
+        m_repeated++;
+    }
+
+    return m_slots[m_readIndex];
+}
+
+QSharedPointer<AVFrame> FrameBuffer::GetTimedFrame(int64_t tickUs)
+{
+    Entry   entry;
+
+    while (m_pQueue->Pop(entry))
+    {
+        AddToRing(entry);
+    }
+
+    if (!m_ring.isEmpty())
+    {
+        int64_t targetPtsUs = tickUs - m_clockOffsetUs - (m_depth - 1) * m_frameIntervalUs;
+        int     best = 0;
+
+        // Ring is ordered by pts, so distance to target decreases up to the best frame
+        while ((best + 1 < m_ring.size()) &&
+               (Distance(m_ring[best + 1].ptsUs, targetPtsUs) <= Distance(m_ring[best].ptsUs, targetPtsUs)))
+        {
+            best++;
+        }
+
+        // Current frame is still the best match if even the oldest ring frame is further away
+        bool keepShown = (m_shownPtsUs != AV_NOPTS_VALUE) &&
+                         (Distance(m_shownPtsUs, targetPtsUs) < Distance(m_ring[best].ptsUs, targetPtsUs));
+        if (!keepShown)
+        {
+            // Frames older than the selected one would never be closer to later ticks
+            m_dropped.fetchAndAddRelaxed(best);
+
+            m_pShownFrame = m_ring[best].pFrame;
+            m_shownPtsUs = m_ring[best].ptsUs;
+            m_ring.remove(0, best + 1);
+            m_shown++;
+
+            return m_pShownFrame;
+        }
+    }
+
+    if (!m_pShownFrame.isNull())
+    {
+        m_repeated++;
+    }
+    return m_pShownFrame;
 }
 
-QSharedPointer<AVFrame> FrameBuffer::GetFrame()
+void FrameBuffer::AddToRing(Entry& entry)
 {
-    // Lock this section
-    QMutexLocker lock(&m_mutex);
-    return m_buffer.empty() ? nullptr : m_buffer.front();
+    int64_t offsetUs = entry.arrivalUs - entry.ptsUs;
+
+    if ((AV_NOPTS_VALUE == m_lastPtsUs) || (Distance(offsetUs, m_clockOffsetUs) > FRAME_BUFFER_RESYNC_US))
+    {
+        // First frame or stream restarted with new timeline: queued frames can't be compared anymore
+        m_dropped.fetchAndAddRelaxed(m_ring.size());
+        m_ring.clear();
+        m_clockOffsetUs = offsetUs;
+        m_shownPtsUs = AV_NOPTS_VALUE;
+    }
+    else
+    {
+        // Least delayed frame defines the mapping, network and decoding delays only add to it
+        m_clockOffsetUs = std::min(offsetUs, m_clockOffsetUs + FRAME_BUFFER_OFFSET_CREEP_US);
+
+        int64_t deltaUs = entry.ptsUs - m_lastPtsUs;
+        if ((deltaUs > 0) && (deltaUs < FRAME_BUFFER_RESYNC_US))
+        {
+            m_frameIntervalUs += (deltaUs - m_frameIntervalUs) / 8;
+        }
+    }
+    m_lastPtsUs = entry.ptsUs;
+
+    // Too late, newer frame is already on screen
+    if ((m_shownPtsUs != AV_NOPTS_VALUE) && (entry.ptsUs <= m_shownPtsUs))
+    {
+        m_dropped.fetchAndAddRelaxed(1);
+        return;
+    }
+
+    int pos = m_ring.size();
+    while ((pos > 0) && (m_ring[pos - 1].ptsUs > entry.ptsUs))
+    {
+        pos--;
+    }
+    m_ring.insert(pos, entry);
+
+    // Builder is behind (e.g. stalled), keep only the newest frames
+    if (m_ring.size() > m_depth * 2)
+    {
+        int excess = m_ring.size() - m_depth * 2;
+
+        m_dropped.fetchAndAddRelaxed(excess);
+        m_ring.remove(0, excess);
+    }
 }
 
 void FrameBuffer::AddFrame(QSharedPointer<AVFrame> pNewFrame)
 {
-    // Lock this section
-    QMutexLocker lock(&m_mutex);
-    m_buffer.clear();
-    m_buffer.append(pNewFrame);
+    int64_t nowUs = MonotonicTimeUs();
+
+    m_published.fetchAndAddRelaxed(1);
+    m_lastFrameUs.storeRelease(nowUs);
+
+    if (NULL != m_pQueue)
+    {
+        Entry entry;
+
+        entry.pFrame = pNewFrame;
+        entry.arrivalUs = nowUs;
+        entry.ptsUs = pNewFrame->best_effort_timestamp;
+        if (AV_NOPTS_VALUE == entry.ptsUs)
+        {
+            entry.ptsUs = entry.arrivalUs;
+        }
+
+        if (!m_pQueue->Push(entry))
+        {
+            // Builder has not drained the queue for a while
+            m_dropped.fetchAndAddRelaxed(1);
+        }
+        return;
+    }
+
+    m_slots[m_writeIndex] = pNewFrame;
+
+    // Publish written slot and take the previous middle one for the next write
+    int previous = m_middle.fetchAndStoreOrdered(m_writeIndex | FRAME_BUFFER_FRESH);
+    m_writeIndex = previous & FRAME_BUFFER_INDEX_MASK;
+
+    // Give the unseen or already shown frame back to its pool right away
+    m_slots[m_writeIndex].clear();
+
+    if (previous & FRAME_BUFFER_FRESH)
+    {
+        m_dropped.fetchAndAddRelaxed(1);
+    }
 }
 
 void FrameBuffer::Reset()
 {
-    // Lock this section
-    QMutexLocker lock(&m_mutex);
+    // Last picture stays on screen until builder notices frame age, jitter buffer resyncs on the new timeline by itself
+    m_reconnects.fetchAndAddRelaxed(1);
+}
+
+void FrameBuffer::TakeCounters(FrameBufferCounters* pCounters)
+{
+    pCounters->published = m_published.fetchAndStoreRelaxed(0);
+    pCounters->dropped = m_dropped.fetchAndStoreRelaxed(0);
+    pCounters->reconnects = m_reconnects.fetchAndStoreRelaxed(0);
+    pCounters->shown = m_shown;
+    pCounters->repeated = m_repeated;
+
+    m_shown = 0;
+    m_repeated = 0;
 }
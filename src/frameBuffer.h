@@ -1,28 +1,93 @@
 #ifndef FRAMEBUFFER_H
 #define FRAMEBUFFER_H
 
-#include <QMutex>
+#include <QAtomicInt>
+#include <QAtomicInteger>
 #include <QObject>
 #include <QVector>
 
 #include "common.h"
+#include "spscQueue.h"
+
+/*
+ * Frame mailbox between one stream (producer) and builder (consumer)
+ * AddFrame() is called directly from the decoding thread, so frames never go through the main event loop
+ *
+ * Depth 1: lock-free triple buffer, consumer always gets the newest frame.
+ * Producer fills its private slot and swaps it with the shared middle one,
+ * consumer swaps its private slot with the middle one only when a fresh frame was published.
+ *
+ * Depth > 1: jitter buffer. Frames go through SPSC queue into consumer private ring,
+ * consumer picks the frame whose pts is closest to the composite tick.
+ * Camera pts are mapped onto the monotonic clock by the smallest seen (arrival - pts) offset
+ * and played out (depth - 1) frame intervals late, so arrival jitter is absorbed by the ring
+*/
+
+struct FrameBufferCounters
+{
+    int     published;      /// Frames added by stream
+    int     shown;          /// Frames returned by GetFrame() for the first time
+    int     repeated;       /// GetFrame() calls returning the same frame again
+    int     dropped;        /// Frames which were never returned by GetFrame()
+    int     reconnects;     /// Stream reconnects
+};
 
 class FrameBuffer : public QObject
 {
     Q_OBJECT
 public:
-    FrameBuffer();
+    FrameBuffer(int depth = 1);
     ~FrameBuffer();
 
-    QSharedPointer<AVFrame>  GetFrame();
+    QSharedPointer<AVFrame>  GetFrame(int64_t tickUs);  /// Consumer side. Frame to show at monotonic time tickUs, NULL until the first one
+
+    void  TakeCounters(FrameBufferCounters* pCounters); /// Consumer side. Counters accumulated since previous call
+    int64_t LastFrameUs() const { return m_lastFrameUs.loadAcquire(); }  /// Monotonic time of the last AddFrame(), 0 if none
 
 public slots:
-    void  AddFrame(QSharedPointer<AVFrame> pNewFrame);
-    void  Reset();
+    void  AddFrame(QSharedPointer<AVFrame> pNewFrame);  /// Producer side, called from the decoding thread
+    void  Reset();      /// Stream reconnected to its source
 
 private:
-    QMutex       m_mutex;
-    QVector<QSharedPointer<AVFrame> >  m_buffer;  /// Buffer with frame shared pointers
+    struct Entry
+    {
+        Entry() : arrivalUs(0), ptsUs(0) {}
+
+        QSharedPointer<AVFrame> pFrame;
+        int64_t                 arrivalUs;  /// Monotonic time of AddFrame()
+        int64_t                 ptsUs;      /// Presentation time, AV_TIME_BASE units
+    };
+
+    QSharedPointer<AVFrame>  GetNewestFrame();
+    QSharedPointer<AVFrame>  GetTimedFrame(int64_t tickUs);
+    void                     AddToRing(Entry& entry);
+
+    const int   m_depth;
+
+    // Triple buffer (depth 1)
+    QSharedPointer<AVFrame>  m_slots[3];    /// Frame slots, each owned by producer, consumer or middle
+    char        m_pad0[64];                 /// Keep shared index away from private ones
+    QAtomicInt  m_middle;                   /// Middle slot index and fresh flag
+    char        m_pad1[64];
+    int         m_writeIndex;               /// Producer private slot
+    int         m_readIndex;                /// Consumer private slot
+
+    // Jitter buffer (depth > 1)
+    SpscQueue<Entry>*   m_pQueue;           /// Stream -> builder hand-off
+    QVector<Entry>      m_ring;             /// Consumer private, ordered by pts
+    int64_t             m_clockOffsetUs;    /// Monotonic time minus pts of the least delayed frame
+    int64_t             m_frameIntervalUs;  /// Smoothed pts interval
+    int64_t             m_lastPtsUs;        /// Pts of the last frame taken from queue
+    int64_t             m_shownPtsUs;       /// Pts of the frame returned by previous GetFrame()
+    QSharedPointer<AVFrame> m_pShownFrame;  /// Frame returned by previous GetFrame()
+
+    // Counters
+    QAtomicInteger<qint64> m_lastFrameUs;
+    QAtomicInt  m_reconnects;
+    QAtomicInt  m_published;
+    QAtomicInt  m_dropped;
+    int         m_shown;
+    int         m_repeated;
 };
 
 #endif // FRAMEBUFFER_H
@@ -0,0 +1,94 @@
+#include "framePool.h"
+
+#define FRAME_POOL_ALIGN    32  // Line alignment of pooled frames
+#define FRAME_POOL_PADDING  64  // Extra bytes at the end of buffer for SIMD overreads
+
+FramePool::FramePool() :
+    hits(0),
+    misses(0),
+    m_pPool(NULL),
+    m_width(0),
+    m_height(0),
+    m_bufferSize(0),
+    m_buffersAllocated(0),
+    m_bufferAllocated(false)
+{
+    m_linesize[0] = m_linesize[1] = m_linesize[2] = 0;
+}
+
+FramePool::~FramePool()
+{
+    // Buffers still referenced elsewhere keep the pool alive until they are freed
+    av_buffer_pool_uninit(&m_pPool);
+}
+
+AVBufferRef* FramePool::AllocBuffer(void* opaque, int size)
+{
+    FramePool* pFramePool = reinterpret_cast<FramePool*>(opaque);
+
+    pFramePool->m_bufferAllocated = true;
+    pFramePool->m_buffersAllocated++;
+
+    return av_buffer_alloc(size);
+}
+
+AVFrame* FramePool::GetFrame(int width, int height)
+{
+    if ((width != m_width) || (height != m_height) || (NULL == m_pPool))
+    {
+        av_buffer_pool_uninit(&m_pPool);
+
+        m_linesize[0] = FFALIGN(width, FRAME_POOL_ALIGN);
+        m_linesize[1] = FFALIGN(width >> 1, FRAME_POOL_ALIGN);
+        m_linesize[2] = m_linesize[1];
+        m_bufferSize = m_linesize[0] * height + 2 * m_linesize[1] * (height >> 1) + FRAME_POOL_PADDING;
+        m_buffersAllocated = 0;
+        m_width = width;
+        m_height = height;
+
+        m_pPool = av_buffer_pool_init2(m_bufferSize, this, &FramePool::AllocBuffer, NULL);
+        if (NULL == m_pPool)
+        {
+            ERROR_MESSAGE2(ERR_TYPE_ERROR, "FramePool", "Failed to create %dx%d frame pool", width, height);
+            return NULL;
+        }
+    }
+
+    AVFrame*    pFrame = av_frame_alloc();
+
+    if (NULL == pFrame)
+    {
+        return NULL;
+    }
+
+    m_bufferAllocated = false;
+    pFrame->buf[0] = av_buffer_pool_get(m_pPool);
+    if (NULL == pFrame->buf[0])
+    {
+        ERROR_MESSAGE0(ERR_TYPE_ERROR, "FramePool", "Failed to get buffer from pool");
+        av_frame_free(&pFrame);
+        return NULL;
+    }
+
+    if (m_bufferAllocated)
+    {
+        misses.fetchAndAddRelaxed(1);
+    }
+    else
+    {
+        hits.fetchAndAddRelaxed(1);
+    }
+
+    pFrame->format = AV_PIX_FMT_YUV420P;
+    pFrame->width = width;
+    pFrame->height = height;
+
+    pFrame->data[0] = pFrame->buf[0]->data;
+    pFrame->data[1] = pFrame->data[0] + m_linesize[0] * height;
+    pFrame->data[2] = pFrame->data[1] + m_linesize[1] * (height >> 1);
+    pFrame->linesize[0] = m_linesize[0];
+    pFrame->linesize[1] = m_linesize[1];
+    pFrame->linesize[2] = m_linesize[2];
+
+    return pFrame;
+}
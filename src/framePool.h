@@ -0,0 +1,42 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <QAtomicInt>
+
+#include "common.h"
+
+/*
+ * Pool of YUV420P frame buffers keyed on frame size
+ * Built on AVBufferPool: buffer returns to the pool when the last reference to the frame is dropped,
+ * pool of the previous size is released after all its frames are returned
+*/
+
+class FramePool
+{
+public:
+    FramePool();
+    ~FramePool();
+
+    AVFrame*    GetFrame(int width, int height);    /// New frame with pooled buffer. NULL on failure. Not thread-safe
+
+    int64_t     PooledBytes() const { return (int64_t)m_buffersAllocated * m_bufferSize; }
+
+    // Counters, may be read and reset from other threads
+    QAtomicInt  hits;               /// Buffers reused from the pool
+    QAtomicInt  misses;             /// Buffers allocated because pool was empty
+
+private:
+    Q_DISABLE_COPY(FramePool)
+
+    AVBufferPool*   m_pPool;
+    int             m_width;        /// Frame size of current pool
+    int             m_height;
+    int             m_linesize[3];
+    int             m_bufferSize;
+    int             m_buffersAllocated;
+    bool            m_bufferAllocated;  /// Set by AllocBuffer() during last av_buffer_pool_get()
+
+    static AVBufferRef* AllocBuffer(void* opaque, int size);
+};
+
+#endif // FRAMEPOOL_H
@@ -1,15 +1,17 @@
 
+#include <QCoreApplication>
 #include <QJsonArray>
 #include <QJsonObject>
+#include <QUrl>
 
 #include "kvadrator.h"
+#include "boxScaler.h"
 
 
 Kvadrator::Kvadrator() :
     QObject(NULL),
-    pOutput1(NULL),
-    pOutput2(NULL),
-    pBuilder(NULL),
+    pDecoderPool(NULL),
+    pConnectPool(NULL),
     m_initialized(false)
 {
 
@@ -30,93 +32,182 @@ bool Kvadrator::Initialize()
         return false;
     }
 
-    // 1. Create builder
-    pBuilder = new Builder(m_params.builder);
+    ERROR_MESSAGE1(ERR_TYPE_MESSAGE, "Kvadrator", "Integer ratio scaler uses %s kernels", BoxScaleImplementation());
 
-    // 2. Create Output2
-    pOutput1 = new Output(m_params.outputUrl1, m_params.builder.fps);
-    pOutput2 = new Output(m_params.outputUrl2, m_params.builder.fps);
-
-    // 3. Connect them
     qRegisterMetaType< QSharedPointer<AVPacket > >("QSharedPointer<AVPacket >");
-    QObject::connect(pBuilder->pEncoder, SIGNAL(NewParameters(AVCodecParameters*)), pOutput1, SLOT(Open(AVCodecParameters*)));
-    QObject::connect(pBuilder->pEncoder, SIGNAL(PacketReady(QSharedPointer<AVPacket>)), pOutput1, SLOT(WritePacket(QSharedPointer<AVPacket>)));
-    QObject::connect(pOutput1, SIGNAL(Broken()), this, SLOT(StopAll()));
-
-    QObject::connect(pBuilder->pEncoder, SIGNAL(NewParameters(AVCodecParameters*)), pOutput2, SLOT(Open(AVCodecParameters*)));
-    QObject::connect(pBuilder->pEncoder, SIGNAL(PacketReady(QSharedPointer<AVPacket>)), pOutput2, SLOT(WritePacket(QSharedPointer<AVPacket>)));
-    QObject::connect(pOutput2, SIGNAL(Broken()), this, SLOT(StopAll()));
+    qRegisterMetaType< QSharedPointer<AVFrame > >("QSharedPointer<AVFrame >");
 
-    // 4. Initialize encoder (should be performed only after signals are connected)
-    pBuilder->pEncoder->Initialize();
+    // 1. Create shared decoder pool for pipelined streams
+    if (m_params.stream.packetQueueDepth > 0)
+    {
+        pDecoderPool = new DecoderPool(m_params.decoderThreads);
+    }
+    if (CAPTURE_MODE_TIMER == m_params.stream.captureMode)
+    {
+        pConnectPool = new QThreadPool();
+    }
 
-    // 5. Create streams and buffers
-    streams.resize(m_params.numCamsX * m_params.numCamsY);
-    streamThreads.resize(m_params.numCamsX * m_params.numCamsY);
-    frameBufferPtrs.resize(m_params.numCamsX * m_params.numCamsY);
+    // 2. Create one stream per camera shown in any mosaic, so each camera is pulled and decoded once
+    int numCams = m_params.camDescriptors.size();
+    int numStreams = 0;
 
-    qRegisterMetaType< QSharedPointer<AVFrame > >("QSharedPointer<AVFrame >");
+    streams.fill(NULL, numCams);
 
-    for (int i = 0; i < m_params.numCamsX * m_params.numCamsY; i++)
+    for (int cam = 0; cam < numCams; cam++)
     {
-        if (m_params.camDescriptors[i].isPresent)
+        bool used = false;
+
+        for (int m = 0; m < m_params.mosaics.size(); m++)
         {
-            QThread* thread = new QThread();
-            Stream*  stream = new Stream(m_params.camDescriptors[i].name,
-                                         m_params.camDescriptors[i].streamUrl,
-                                         m_params.builder.camWidth,
-                                         m_params.builder.camHeight);
-            // Connect thread slots
-            QObject::connect(thread, SIGNAL(started()),  stream, SLOT(StartCapture()));
-            QObject::connect(thread, SIGNAL(finished()), stream, SLOT(deleteLater()));
-            QObject::connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
-
-            // Move each stream to its own thread
-            stream->moveToThread(thread);
-
-            frameBufferPtrs[i] = QSharedPointer<FrameBuffer>(new FrameBuffer());
-
-            QObject::connect(stream, SIGNAL(FrameReady(QSharedPointer<AVFrame>)), frameBufferPtrs[i].data(), SLOT(AddFrame(QSharedPointer<AVFrame>)));
-            QObject::connect(stream, SIGNAL(Reinit()), frameBufferPtrs[i].data(), SLOT(Reset()));
-
-            streams[i] = stream;
-            streamThreads[i] = thread;
+            used = used || m_params.mosaics[m].tileCameras.contains(cam);
         }
-        else
+
+        if (m_params.camDescriptors[cam].isPresent && used)
         {
-            streams[i] = NULL;
-            streamThreads[i] = NULL;
-            frameBufferPtrs[i] = QSharedPointer<FrameBuffer>(NULL);
+            streams[cam] = new Stream(m_params.camDescriptors[cam].name,
+                                      m_params.camDescriptors[cam].streamUrl,
+                                      m_params.stream,
+                                      pDecoderPool,
+                                      pConnectPool);
+            numStreams++;
         }
     }
 
-    // Copy frame buffers to Builder's sources
-    pBuilder->sources = frameBufferPtrs;
+    // 3. Distribute streams over capture threads. Timer mode reads never block, so a few threads serve all cameras.
+    //    Inputs are opened on connect pool, its threads exist only while some camera is (re)connecting
+    int numThreads = numStreams;
+
+    if (CAPTURE_MODE_TIMER == m_params.stream.captureMode)
+    {
+        numThreads = (m_params.captureThreads > 0) ? m_params.captureThreads : QThread::idealThreadCount();
+        numThreads = FFMAX(1, FFMIN(numThreads, numStreams));
+
+        pConnectPool->setMaxThreadCount(FFMAX(1, numStreams));
+    }
+
+    for (int i = 0; i < numThreads; i++)
+    {
+        captureThreads.append(new QThread());
+    }
+
+    for (int cam = 0, i = 0; cam < numCams; cam++)
+    {
+        if (NULL != streams[cam])
+        {
+            QThread* thread = captureThreads[i++ % numThreads];
+
+            QObject::connect(thread, SIGNAL(started()), streams[cam], SLOT(StartCapture()));
+            streams[cam]->moveToThread(thread);
+        }
+    }
+    ERROR_MESSAGE2(ERR_TYPE_MESSAGE, "Kvadrator", "%d streams captured by %d threads", numStreams, numThreads);
+
+    // 4. Create mosaics
+    for (int m = 0; m < m_params.mosaics.size(); m++)
+    {
+        const MosaicDesc&   desc = m_params.mosaics[m];
+        Mosaic              mosaic;
+
+        // Builder
+        mosaic.pBuilder = new Builder(desc.builder);
+
+        // Outputs, connected to the encoder
+        for (int i = 0; i < desc.outputUrls.size(); i++)
+        {
+            Output* pOutput = new Output(desc.outputUrls[i], desc.builder.fps);
+
+            QObject::connect(mosaic.pBuilder->pEncoder, SIGNAL(NewParameters(AVCodecParameters*)), pOutput, SLOT(Open(AVCodecParameters*)));
+            QObject::connect(mosaic.pBuilder->pEncoder, SIGNAL(PacketReady(QSharedPointer<AVPacket>)), pOutput, SLOT(WritePacket(QSharedPointer<AVPacket>)));
+            QObject::connect(pOutput, SIGNAL(Broken()), this, SLOT(StopAll()));
+            mosaic.outputs.append(pOutput);
+        }
+
+        // Initialize encoder (should be performed only after signals are connected)
+        mosaic.pBuilder->pEncoder->Initialize();
+
+        // Frame buffer per tile, fed by the shared camera stream
+        const Layout&   layout = desc.builder.layout;
+        QVector<QSharedPointer<FrameBuffer> > sources(layout.NumTiles());
+
+        for (int tile = 0; tile < layout.NumTiles(); tile++)
+        {
+            int cam = desc.tileCameras[tile];
+
+            if ((cam < 0) || (NULL == streams[cam]))
+            {
+                continue;
+            }
+
+            const LayoutRect&   rect = layout.TileRect(tile);
+            Stream*             stream = streams[cam];
+
+            sources[tile] = QSharedPointer<FrameBuffer>(new FrameBuffer(m_params.jitterBufferDepth));
+            frameBufferPtrs.append(sources[tile]);
+
+            // Frames are published from the decoding thread directly, without the main event loop
+            if (NULL != mosaic.pBuilder->pCanvas)
+            {
+                stream->AddCanvasTile(mosaic.pBuilder->pCanvas, tile, rect.width, rect.height);
+            }
+            else
+            {
+                stream->AddFrameBuffer(sources[tile].data(), rect.width, rect.height);
+            }
+            QObject::connect(stream, SIGNAL(Reinit()), sources[tile].data(), SLOT(Reset()));
+        }
+
+        mosaic.pBuilder->sources = sources;
+        mosaics.append(mosaic);
+    }
 
     return true;
 }
 
 void Kvadrator::Deinitialize()
 {
-    delete pBuilder;
-    delete pOutput1;
-    delete pOutput2;
+    // Capture threads are finished by now, streams are deleted here rather than on their threads
+    for (int i = 0; i < streams.size(); i++)
+    {
+        delete streams[i];
+    }
+    for (int i = 0; i < captureThreads.size(); i++)
+    {
+        delete captureThreads[i];
+    }
+    delete pConnectPool;
+    pConnectPool = NULL;
 
+    for (int m = 0; m < mosaics.size(); m++)
+    {
+        delete mosaics[m].pBuilder;
+        for (int i = 0; i < mosaics[m].outputs.size(); i++)
+        {
+            delete mosaics[m].outputs[i];
+        }
+    }
+    delete pDecoderPool;
+    pDecoderPool = NULL;
+
+    mosaics.clear();
     streams.clear();
     frameBufferPtrs.clear();
-    streamThreads.clear();
+    captureThreads.clear();
 }
 
 void Kvadrator::Start()
 {
-    for (int i = 0; i < streams.size(); i++)
+    if (NULL != pDecoderPool)
     {
-        if (NULL != streamThreads[i])
-        {
-            streamThreads[i]->start();
-        }
+        pDecoderPool->Start();
+    }
+    for (int i = 0; i < captureThreads.size(); i++)
+    {
+        captureThreads[i]->start();
+    }
+    for (int m = 0; m < mosaics.size(); m++)
+    {
+        mosaics[m].pBuilder->Start();
     }
-    pBuilder->Start();
 }
 
 void Kvadrator::StopAll()
@@ -125,18 +216,40 @@ void Kvadrator::StopAll()
     {
         if (NULL != streams[i])
         {
+            // Blocking capture loop does not process events, so stop flag is raised directly
+            streams[i]->RequestStop();
             QMetaObject::invokeMethod(streams[i], "StopCapture", Qt::QueuedConnection);
         }
+    }
+
+    // Capture threads are joined first, so nothing is submitted to the pools below any more.
+    // Stop flag interrupts blocking reads and inputs being opened
+    for (int i = 0; i < captureThreads.size(); i++)
+    {
+        captureThreads[i]->quit();
+        captureThreads[i]->wait();
+    }
+    if (NULL != pConnectPool)
+    {
+        pConnectPool->waitForDone();
+    }
+
+    // Decode tasks must be finished before streams are deleted
+    if (NULL != pDecoderPool)
+    {
+        pDecoderPool->Stop();
+    }
 
-        if (NULL != streamThreads[i])
+    for (int m = 0; m < mosaics.size(); m++)
+    {
+        mosaics[m].pBuilder->Stop();
+        for (int i = 0; i < mosaics[m].outputs.size(); i++)
         {
-            streamThreads[i]->quit();
-            streamThreads[i]->wait(1000);
+            // Packets are queued to outputs from encoding threads, the last ones are written before the trailer
+            QCoreApplication::sendPostedEvents(mosaics[m].outputs[i]);
+            mosaics[m].outputs[i]->Close();
         }
     }
-    pBuilder->Stop();
-    pOutput1->Close();
-    pOutput2->Close();
     emit Stopped();
 }
 
@@ -147,24 +260,30 @@ bool Kvadrator::ParseParams(QJsonDocument paramsJsonDoc)
     QJsonObject jsonObject = paramsJsonDoc.object();
 
     params.port = jsonObject["port"].toInt();
-    params.outputUrl1 = jsonObject["outputUrl1"].toString();
-    params.outputUrl2 = jsonObject["outputUrl2"].toString();
-    params.numCamsX = jsonObject["numCamsX"].toInt();
-    params.numCamsY = jsonObject["numCamsY"].toInt();
-    params.builder.numCamsX = params.numCamsX;
-    params.builder.numCamsY = params.numCamsY;
-
-    params.builder.outWidth = jsonObject["outputWidth"].toInt();
-    params.builder.outHeight = jsonObject["outputHeight"].toInt();
-    params.builder.crf = jsonObject["outputCrf"].toInt();
-    params.builder.fps = jsonObject["outputFps"].toInt();
-    params.builder.borderWidth = jsonObject["borderWidth"].toInt();
-
-    // Calculate real scaled size for each cam
-//    params.builder.camWidth = (params.builder.outWidth - (params.builder.borderWidth * (params.numCamsX + 1))) / params.numCamsX;
-//    params.builder.camHeight = (params.builder.outHeight - (params.builder.borderWidth * (params.numCamsY + 1))) / params.numCamsY;
-    params.builder.camWidth = params.builder.outWidth / params.numCamsX;
-    params.builder.camHeight = params.builder.outHeight / params.numCamsY;
+
+    params.stream.captureMode = (jsonObject["captureMode"].toString() == "blocking") ? CAPTURE_MODE_BLOCKING : CAPTURE_MODE_TIMER;
+    params.stream.packetQueueDepth = jsonObject["packetQueueDepth"].toInt(0);
+    params.decoderThreads = jsonObject["decoderThreads"].toInt(0);
+    params.captureThreads = jsonObject["captureThreads"].toInt(0);
+    params.jitterBufferDepth = jsonObject["jitterBufferDepth"].toInt(1);
+
+    QString decodePolicy = jsonObject["decodePolicy"].toString("auto");
+    if (decodePolicy == "full")
+    {
+        params.stream.decodePolicy = DECODE_POLICY_FULL;
+    }
+    else if (decodePolicy == "nonref")
+    {
+        params.stream.decodePolicy = DECODE_POLICY_NONREF;
+    }
+    else if (decodePolicy == "keyframe")
+    {
+        params.stream.decodePolicy = DECODE_POLICY_KEYFRAME;
+    }
+    else
+    {
+        params.stream.decodePolicy = DECODE_POLICY_AUTO;
+    }
 
     QJsonArray jsonArray = jsonObject["camList"].toArray();
 
@@ -177,14 +296,190 @@ bool Kvadrator::ParseParams(QJsonDocument paramsJsonDoc)
         params.camDescriptors.append(desc);
     }
 
-    if (params.camDescriptors.size() != (params.numCamsX * params.numCamsY))
+    // Named mosaics take their settings from the top level object unless they override them,
+    // without "mosaics" the top level object describes the only one
+    QJsonArray jsonMosaics = jsonObject["mosaics"].toArray();
+
+    if (jsonMosaics.isEmpty())
     {
-        ERROR_MESSAGE0(ERR_TYPE_ERROR, "Kvadrator", "Error. camList array size not equal to numCamsX*numCamsY");
-        return false;
+        jsonMosaics.append(QJsonObject());
     }
+
+    // Mosaic without own output urls inherits the top level ones, two mosaics must never share an output
+    QVector<QString> usedOutputs;
+
+    foreach (const QJsonValue & value, jsonMosaics) {
+        QJsonObject jsonMosaic = jsonObject;
+        QJsonObject overrides = value.toObject();
+        MosaicDesc  mosaic;
+
+        for (QJsonObject::const_iterator it = overrides.constBegin(); it != overrides.constEnd(); ++it)
+        {
+            jsonMosaic.insert(it.key(), it.value());
+        }
+        if (!ParseMosaic(jsonMosaic, params.camDescriptors, &mosaic))
+        {
+            return false;
+        }
+
+        for (int i = 0; i < mosaic.outputUrls.size(); i++)
+        {
+            const QString& url = mosaic.outputUrls[i];
+
+            // WebSocket outputs listen on all interfaces, so only their port has to be unique
+            QString key = url.startsWith("ws") ? QString("ws port ") + QString::number(QUrl(url).port()) : url;
+
+            if (url.isEmpty())
+            {
+                continue;
+            }
+            if (usedOutputs.contains(key))
+            {
+                ERROR_MESSAGE2(ERR_TYPE_ERROR, "Kvadrator", "Mosaic %s: output %s is already used by another mosaic, set its own outputUrls",
+                               mosaic.builder.name.toUtf8().constData(), url.toUtf8().constData());
+                return false;
+            }
+            usedOutputs.append(key);
+        }
+
+        // Decode policy has to serve the fastest mosaic
+        params.stream.outputFps = FFMAX(params.stream.outputFps, mosaic.builder.fps);
+        params.mosaics.append(mosaic);
+    }
+
     m_params = params;
     m_params.parsed = true;
 
     return true;
 }
 
+bool Kvadrator::ParseMosaic(const QJsonObject& jsonObject, const QVector<CamDesc>& cameras, MosaicDesc* pMosaic)
+{
+    BuilderParameters& builder = pMosaic->builder;
+
+    builder.name = jsonObject["name"].toString("main");
+    builder.outWidth = jsonObject["outputWidth"].toInt();
+    builder.outHeight = jsonObject["outputHeight"].toInt();
+    builder.crf = jsonObject["outputCrf"].toInt();
+
+    QString codec = jsonObject["outputCodec"].toString("h264");
+    builder.codec = (codec == "hevc") ? ENCODER_CODEC_HEVC : (codec == "av1") ? ENCODER_CODEC_AV1 : ENCODER_CODEC_H264;
+    builder.fps = jsonObject["outputFps"].toInt();
+    builder.overlay.borderWidth = jsonObject["borderWidth"].toInt();
+    builder.overlay.showNames = jsonObject["showNames"].toBool(false);
+    builder.overlay.showClock = jsonObject["showClock"].toBool(false);
+    builder.composeMode = (jsonObject["composeMode"].toString() == "zerocopy") ? COMPOSE_MODE_ZEROCOPY : COMPOSE_MODE_COPY;
+    builder.canvasBuffers = jsonObject["canvasBuffers"].toInt(2);
+    builder.composeThreads = jsonObject["composeThreads"].toInt(1);
+    builder.staleTimeoutMs = jsonObject["staleTimeoutMs"].toInt(3000);
+    builder.skipUnchanged = jsonObject["skipUnchangedFrames"].toBool(false);
+    builder.maxFrameIntervalMs = jsonObject["maxFrameIntervalMs"].toInt(1000);
+    builder.roiEnabled = jsonObject["roiQuantisation"].toBool(false);
+    builder.roiStaticMs = jsonObject["roiStaticMs"].toInt(1000);
+    builder.roiCoarseQp = jsonObject["roiCoarseQp"].toInt(6);
+    builder.roiFineQp = jsonObject["roiFineQp"].toInt(-2);
+    foreach (const QJsonValue & value, jsonObject["roiPinnedTiles"].toArray()) {
+        builder.roiPinnedTiles.append(value.toInt(-1));
+    }
+    builder.encoder.queueDepth = jsonObject["encoderQueueDepth"].toInt(0);
+    builder.encoder.queuePolicy = (jsonObject["encoderQueuePolicy"].toString() == "repeat") ? ENCODER_QUEUE_REPEAT : ENCODER_QUEUE_DROP_OLDEST;
+    builder.encoder.threads = jsonObject["encoderThreads"].toInt(0);
+    builder.encoder.slicedThreads = jsonObject["encoderSlicedThreads"].toBool(true);
+    builder.encoder.lookahead = jsonObject["encoderLookahead"].toInt(-1);
+    builder.encoder.preset = PresetGovernor::PresetIndex(jsonObject["encoderPreset"].toString("veryfast"));
+    builder.encoder.slowestPreset = PresetGovernor::PresetIndex(jsonObject["encoderSlowestPreset"].toString("medium"));
+    builder.encoder.adaptivePreset = jsonObject["encoderAdaptivePreset"].toBool(false);
+    builder.encoder.intraRefresh = jsonObject["encoderIntraRefresh"].toBool(false);
+    if ((0 > builder.encoder.preset) || (0 > builder.encoder.slowestPreset))
+    {
+        ERROR_MESSAGE1(ERR_TYPE_WARNING, "Kvadrator", "Mosaic %s: unknown encoder preset, using veryfast",
+                       builder.name.toUtf8().constData());
+        builder.encoder.preset = PresetGovernor::PresetIndex("veryfast");
+        builder.encoder.slowestPreset = FFMAX(builder.encoder.slowestPreset, builder.encoder.preset);
+    }
+
+    if (jsonObject.contains("outputUrls"))
+    {
+        foreach (const QJsonValue & value, jsonObject["outputUrls"].toArray()) {
+            pMosaic->outputUrls.append(value.toString());
+        }
+    }
+    else
+    {
+        pMosaic->outputUrls.append(jsonObject["outputUrl1"].toString());
+        pMosaic->outputUrls.append(jsonObject["outputUrl2"].toString());
+    }
+
+    // Explicit tile list or uniform numCamsX*numCamsY grid
+    if (jsonObject.contains("layout"))
+    {
+        if (!Layout::FromJson(jsonObject["layout"].toArray(), builder.outWidth, builder.outHeight, &builder.layout))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        builder.layout = Layout::Grid(builder.outWidth, builder.outHeight, jsonObject["numCamsX"].toInt(), jsonObject["numCamsY"].toInt());
+    }
+
+    if (!builder.layout.Compile())
+    {
+        return false;
+    }
+
+    // Streams write canvas tiles concurrently, overlapping tiles need composition in z order
+    if ((COMPOSE_MODE_ZEROCOPY == builder.composeMode) && builder.layout.HasOverlaps())
+    {
+        ERROR_MESSAGE1(ERR_TYPE_WARNING, "Kvadrator", "Mosaic %s: layout has overlapping tiles, zerocopy compose mode is replaced with copy",
+                       builder.name.toUtf8().constData());
+        builder.composeMode = COMPOSE_MODE_COPY;
+    }
+
+    // Camera of each tile: by name from "cameras" list, otherwise tile index is camera index
+    if (jsonObject.contains("cameras"))
+    {
+        foreach (const QJsonValue & value, jsonObject["cameras"].toArray()) {
+            QString name = value.toString();
+            int     cam = -1;
+
+            for (int i = 0; (i < cameras.size()) && !name.isEmpty(); i++)
+            {
+                if (cameras[i].name == name)
+                {
+                    cam = i;
+                    break;
+                }
+            }
+            if (!name.isEmpty() && (cam < 0))
+            {
+                ERROR_MESSAGE2(ERR_TYPE_ERROR, "Kvadrator", "Mosaic %s: camera %s is not in camList",
+                               builder.name.toUtf8().constData(), name.toUtf8().constData());
+                return false;
+            }
+            pMosaic->tileCameras.append(cam);
+        }
+    }
+    else
+    {
+        for (int i = 0; i < cameras.size(); i++)
+        {
+            pMosaic->tileCameras.append(i);
+        }
+    }
+
+    if (pMosaic->tileCameras.size() != builder.layout.NumTiles())
+    {
+        ERROR_MESSAGE1(ERR_TYPE_ERROR, "Kvadrator", "Error. Mosaic %s: number of tile cameras not equal to number of layout tiles",
+                       builder.name.toUtf8().constData());
+        return false;
+    }
+
+    for (int tile = 0; tile < pMosaic->tileCameras.size(); tile++)
+    {
+        int cam = pMosaic->tileCameras[tile];
+        builder.overlay.names.append((cam < 0) ? QString() : cameras[cam].name);
+    }
+
+    return true;
+}
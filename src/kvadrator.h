@@ -4,6 +4,7 @@
 #include <QObject>
 #include <QVector>
 #include <QJsonDocument>
+#include <QJsonObject>
 
 #include "stream.h"
 #include "output.h"
@@ -24,6 +25,14 @@ public:
         QString streamUrl;
     };
 
+    // One composed output: camera tiles layout, its own builder, encoder and outputs
+    struct MosaicDesc
+    {
+        QVector<QString>    outputUrls;
+        QVector<int>        tileCameras;        /// camDescriptors index shown in each layout tile, -1 - empty tile
+        BuilderParameters   builder;
+    };
+
     struct Parameters
     {
         Parameters() { parsed = false; }
@@ -31,24 +40,29 @@ public:
         bool                parsed;
 
         int                 port;
-        QString             outputUrl1;
-        QString             outputUrl2;
-
-        int                 numCamsX;
-        int                 numCamsY;
+        int                 decoderThreads;     /// Decoder pool size. 0 - one worker per cpu core
+        int                 captureThreads;     /// Threads shared by timer mode streams. 0 - one per cpu core. Blocking mode uses one per stream
+        int                 jitterBufferDepth;  /// Frames kept per camera for pts based selection. 1 - newest frame only
 
         QVector<CamDesc>    camDescriptors;
+        QVector<MosaicDesc> mosaics;
 
-        BuilderParameters   builder;
+        StreamParameters    stream;
     };
 
-    Output*     pOutput1;
-    Output*     pOutput2;
-    Builder*    pBuilder;
+    struct Mosaic
+    {
+        Builder*            pBuilder;
+        QVector<Output*>    outputs;
+    };
 
-    QVector<Stream*>                        streams;
-    QVector<QSharedPointer<FrameBuffer> >   frameBufferPtrs;
-    QVector<QThread* >                      streamThreads;
+    DecoderPool* pDecoderPool;
+    QThreadPool* pConnectPool;  /// Opens inputs of timer mode streams
+
+    QVector<Mosaic>                         mosaics;
+    QVector<Stream*>                        streams;            /// One per camera, shared by all mosaics
+    QVector<QSharedPointer<FrameBuffer> >   frameBufferPtrs;    /// Frame buffers of all mosaic tiles
+    QVector<QThread* >                      captureThreads;     /// Each serves one or more streams
 
     void    Start();
     bool    Initialize();
@@ -63,6 +77,8 @@ public slots:
     void    StopAll();
 
 private:
+    bool        ParseMosaic(const QJsonObject& jsonMosaic, const QVector<CamDesc>& cameras, MosaicDesc* pMosaic);
+
     bool        m_initialized;
     Parameters  m_params;
 };
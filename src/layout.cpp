@@ -0,0 +1,204 @@
+#include "layout.h"
+
+#include <QJsonObject>
+
+#include "common.h"
+
+LayoutRect LayoutRect::Intersected(const LayoutRect& other) const
+{
+    int left = FFMAX(x, other.x);
+    int top = FFMAX(y, other.y);
+    int right = FFMIN(x + width, other.x + other.width);
+    int bottom = FFMIN(y + height, other.y + other.height);
+
+    return LayoutRect(left, top, FFMAX(0, right - left), FFMAX(0, bottom - top));
+}
+
+// Appends parts of a not covered by b (up to 4 rectangles)
+static void SubtractRect(const LayoutRect& a, const LayoutRect& b, QVector<LayoutRect>* pOut)
+{
+    LayoutRect i = a.Intersected(b);
+
+    if (i.IsEmpty())
+    {
+        pOut->append(a);
+        return;
+    }
+    if (i.y > a.y)
+    {
+        pOut->append(LayoutRect(a.x, a.y, a.width, i.y - a.y));
+    }
+    if (i.y + i.height < a.y + a.height)
+    {
+        pOut->append(LayoutRect(a.x, i.y + i.height, a.width, a.y + a.height - i.y - i.height));
+    }
+    if (i.x > a.x)
+    {
+        pOut->append(LayoutRect(a.x, i.y, i.x - a.x, i.height));
+    }
+    if (i.x + i.width < a.x + a.width)
+    {
+        pOut->append(LayoutRect(i.x + i.width, i.y, a.x + a.width - i.x - i.width, i.height));
+    }
+}
+
+Layout::Layout() :
+    m_width(0),
+    m_height(0),
+    m_hasOverlaps(false)
+{
+
+}
+
+Layout Layout::Grid(int outWidth, int outHeight, int numX, int numY)
+{
+    Layout  layout;
+    int     cellWidth = (numX > 0) ? outWidth / numX : 0;
+    int     cellHeight = (numY > 0) ? outHeight / numY : 0;
+
+    layout.m_width = outWidth;
+    layout.m_height = outHeight;
+
+    for (int y = 0; y < numY; y++)
+    {
+        for (int x = 0; x < numX; x++)
+        {
+            layout.AddTile(x * cellWidth, y * cellHeight, cellWidth, cellHeight, 0);
+        }
+    }
+    return layout;
+}
+
+bool Layout::FromJson(const QJsonArray& jsonTiles, int outWidth, int outHeight, Layout* pLayout)
+{
+    Layout  layout;
+
+    layout.m_width = outWidth;
+    layout.m_height = outHeight;
+
+    foreach (const QJsonValue & value, jsonTiles) {
+        QJsonObject obj = value.toObject();
+
+        if (!obj.contains("x") || !obj.contains("y") || !obj.contains("width") || !obj.contains("height"))
+        {
+            ERROR_MESSAGE1(ERR_TYPE_ERROR, "Layout", "Layout tile %d must have x, y, width and height", layout.NumTiles());
+            return false;
+        }
+        layout.AddTile(obj["x"].toInt(), obj["y"].toInt(), obj["width"].toInt(), obj["height"].toInt(), obj["z"].toInt(0));
+    }
+
+    *pLayout = layout;
+    return true;
+}
+
+void Layout::AddTile(int x, int y, int width, int height, int z)
+{
+    Tile tile;
+
+    // Chroma planes are subsampled, so tile position and size are kept even and inside the output
+    tile.rect.x = FFMAX(0, x) & ~1;
+    tile.rect.y = FFMAX(0, y) & ~1;
+    tile.rect.width = FFMIN(x + width, m_width) - tile.rect.x;
+    tile.rect.height = FFMIN(y + height, m_height) - tile.rect.y;
+    tile.rect.width &= ~1;
+    tile.rect.height &= ~1;
+    tile.z = z;
+
+    m_tiles.append(tile);
+}
+
+bool Layout::Compile()
+{
+    m_hasOverlaps = false;
+
+    for (int t = 0; t < m_tiles.size(); t++)
+    {
+        Tile& tile = m_tiles[t];
+
+        if ((tile.rect.width < LAYOUT_MIN_TILE_SIZE) || (tile.rect.height < LAYOUT_MIN_TILE_SIZE))
+        {
+            ERROR_MESSAGE5(ERR_TYPE_ERROR, "Layout", "Tile %d (%d,%d %dx%d) is too small or outside of the output",
+                           t, tile.rect.x, tile.rect.y, tile.rect.width, tile.rect.height);
+            return false;
+        }
+
+        tile.visible.clear();
+        tile.visible.append(tile.rect);
+
+        // Tile with higher z, or the same z and later in the list, is drawn on top
+        for (int u = 0; u < m_tiles.size(); u++)
+        {
+            const Tile& upper = m_tiles[u];
+
+            if ((u == t) || (upper.z < tile.z) || ((upper.z == tile.z) && (u < t)) ||
+                tile.rect.Intersected(upper.rect).IsEmpty())
+            {
+                continue;
+            }
+
+            QVector<LayoutRect> remaining;
+            for (int i = 0; i < tile.visible.size(); i++)
+            {
+                SubtractRect(tile.visible[i], upper.rect, &remaining);
+            }
+            tile.visible = remaining;
+            m_hasOverlaps = true;
+        }
+
+        if (tile.visible.isEmpty())
+        {
+            ERROR_MESSAGE1(ERR_TYPE_WARNING, "Layout", "Tile %d is completely covered by other tiles", t);
+        }
+    }
+    return true;
+}
+
+void Layout::PlanTile(int tile, int pictureWidth, int pictureHeight, const int linesize[3], TilePlan* pPlan) const
+{
+    const Tile& t = m_tiles[tile];
+
+    // Picture is centered, position is kept even like everything else
+    LayoutRect picture(t.rect.x + (((t.rect.width - pictureWidth) >> 1) & ~1),
+                       t.rect.y + (((t.rect.height - pictureHeight) >> 1) & ~1),
+                       pictureWidth,
+                       pictureHeight);
+    picture = picture.Intersected(t.rect);
+
+    pPlan->pictureWidth = pictureWidth;
+    pPlan->pictureHeight = pictureHeight;
+    pPlan->picture = picture;
+    pPlan->blits.clear();
+    pPlan->fills.clear();
+    pPlan->blitBytes = 0;
+    pPlan->fillBytes = 0;
+
+    for (int i = 0; i < t.visible.size(); i++)
+    {
+        const LayoutRect&   visible = t.visible[i];
+        LayoutRect          part = visible.Intersected(picture);
+
+        if (!part.IsEmpty())
+        {
+            TilePlan::Blit blit;
+
+            blit.srcX = part.x - picture.x;
+            blit.srcY = part.y - picture.y;
+            blit.width = part.width;
+            blit.height = part.height;
+            blit.dstOffset[0] = part.y * linesize[0] + part.x;
+            blit.dstOffset[1] = (part.y >> 1) * linesize[1] + (part.x >> 1);
+            blit.dstOffset[2] = (part.y >> 1) * linesize[2] + (part.x >> 1);
+
+            pPlan->blits.append(blit);
+            pPlan->blitBytes += part.Area() * 3 / 2;
+        }
+
+        QVector<LayoutRect> letterbox;
+        SubtractRect(visible, picture, &letterbox);
+        for (int j = 0; j < letterbox.size(); j++)
+        {
+            pPlan->fills.append(letterbox[j]);
+            pPlan->fillBytes += letterbox[j].Area() * 3 / 2;
+        }
+    }
+}
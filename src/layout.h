@@ -0,0 +1,91 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <QVector>
+#include <QJsonArray>
+
+#define LAYOUT_MIN_TILE_SIZE    16  // Smaller tiles are rejected
+
+struct LayoutRect
+{
+    LayoutRect() : x(0), y(0), width(0), height(0) {}
+    LayoutRect(int x, int y, int width, int height) : x(x), y(y), width(width), height(height) {}
+
+    bool        IsEmpty() const { return (width <= 0) || (height <= 0); }
+    bool        operator==(const LayoutRect& other) const { return (x == other.x) && (y == other.y) && (width == other.width) && (height == other.height); }
+    int         Area() const { return width * height; }
+    LayoutRect  Intersected(const LayoutRect& other) const;
+
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+/*
+ * Blit plan of one tile for a given picture size
+ * Rectangles are clipped to the visible part of the tile, offsets are precomputed for the target frame,
+ * so drawing a frame into the tile is just a list of strided copies
+*/
+struct TilePlan
+{
+    struct Blit
+    {
+        int srcX;           /// Position in the picture
+        int srcY;
+        int width;
+        int height;
+        int dstOffset[3];   /// Byte offset of the destination in each plane of target frame
+    };
+
+    int                 pictureWidth;   /// Picture size this plan is built for
+    int                 pictureHeight;
+    LayoutRect          picture;        /// Picture area in target frame (clipped to tile)
+    QVector<Blit>       blits;          /// Picture parts
+    QVector<LayoutRect> fills;          /// Visible letterbox area around the picture
+    int                 blitBytes;      /// Bytes written by blits (all planes)
+    int                 fillBytes;      /// Bytes written by fills (all planes)
+};
+
+/*
+ * Mosaic layout: camera tile rectangles with z-order
+ * Compile() splits each tile into rectangles not covered by tiles above it,
+ * so every output pixel belongs to at most one tile, and tiles can be redrawn independently and in parallel.
+ * All rectangles are kept even, so tiles never share chroma samples
+*/
+class Layout
+{
+public:
+    Layout();
+
+    static Layout Grid(int outWidth, int outHeight, int numX, int numY);
+    static bool   FromJson(const QJsonArray& jsonTiles, int outWidth, int outHeight, Layout* pLayout);
+
+    void    AddTile(int x, int y, int width, int height, int z);
+    bool    Compile();
+
+    int                 Width() const { return m_width; }
+    int                 Height() const { return m_height; }
+    int                 NumTiles() const { return m_tiles.size(); }
+    const LayoutRect&   TileRect(int tile) const { return m_tiles[tile].rect; }
+    const QVector<LayoutRect>& VisibleRects(int tile) const { return m_tiles[tile].visible; }
+    bool                HasOverlaps() const { return m_hasOverlaps; }
+
+    // Builds blit plan for a picture drawn centered in the tile. linesize is the one of the target frame
+    void    PlanTile(int tile, int pictureWidth, int pictureHeight, const int linesize[3], TilePlan* pPlan) const;
+
+private:
+    struct Tile
+    {
+        LayoutRect          rect;
+        int                 z;
+        QVector<LayoutRect> visible;    /// Parts not covered by upper tiles
+    };
+
+    int             m_width;
+    int             m_height;
+    QVector<Tile>   m_tiles;
+    bool            m_hasOverlaps;
+};
+
+#endif // LAYOUT_H
@@ -7,10 +7,11 @@ Output::Output(QString outputURL, int fps) :
     m_firstDts(AV_NOPTS_VALUE),
     m_outputInitialized(false),
     m_numErrorsInRow(0),
-    m_pH264bsf(NULL),
     m_pFormatCtx(NULL),
     m_pVideoStream(NULL),
-    m_pAVIOCtx(NULL)
+    m_pAVIOCtx(NULL),
+    m_statsStartUs(MonotonicTimeUs()),
+    m_bytesWritten(0)
 {
     m_pEncoderParams = avcodec_parameters_alloc();
 
@@ -138,6 +139,13 @@ void Output::Open(AVCodecParameters* pCodecParams)
     }
     else if (m_outputUrl.startsWith("rtmp"))
     {
+        // Plain FLV has no codec ids for HEVC and AV1
+        if (AV_CODEC_ID_H264 != pCodecParams->codec_id)
+        {
+            ERROR_MESSAGE1(ERR_TYPE_ERROR, "Output", "RTMP output %s carries H.264 only, choose h264 output codec for this mosaic",
+                           m_outputUrl.toUtf8().constData());
+            return;
+        }
         avformat_alloc_output_context2(&m_pFormatCtx, NULL, "flv", m_outputUrl.toUtf8().constData());
     }
     else if (m_outputUrl.startsWith("ws"))
@@ -189,6 +197,12 @@ void Output::Open(AVCodecParameters* pCodecParams)
 
         // Set encoding parameters
         avcodec_parameters_copy(m_pVideoStream->codecpar, pCodecParams);
+
+        // Browsers expect HEVC tagged as hvc1 in MSE
+        if (AV_CODEC_ID_HEVC == pCodecParams->codec_id)
+        {
+            m_pVideoStream->codecpar->codec_tag = MKTAG('h', 'v', 'c', '1');
+        }
     }
     else
     {
@@ -225,62 +239,54 @@ void Output::Open(AVCodecParameters* pCodecParams)
 }
 
 
-static void FillSPSPPS(AVCodecParameters* pCodecContext, unsigned char* pCodedFrame, int frameLength)
+bool Output::FillExtradata(const AVPacket* pPacket)
 {
-    int i;
-    int spsPpsDatalength = 0;
-    int spsPpsStart = -1;
-    int spsPpsEnd = -1;
+    AVCodecParameters* pCodecParams = m_pVideoStream->codecpar;
 
-    if (frameLength < 4)    // Frame is too short
+    if (NULL != pCodecParams->extradata)   // parameter sets already filled
     {
-        return;
+        return true;
     }
 
-    if (NULL != pCodecContext->extradata)   // sps and pps already filled
+    // Encoder writes parameter sets in-band, extract_extradata knows where they are for H.264, HEVC and AV1
+    const AVBitStreamFilter*    pFilter = av_bsf_get_by_name("extract_extradata");
+    AVBSFContext*               pBsf = NULL;
+
+    if ((NULL == pFilter) || (0 > av_bsf_alloc(pFilter, &pBsf)))
     {
-        return;
+        ERROR_MESSAGE0(ERR_TYPE_ERROR, "Output", "extract_extradata bitstream filter is not available");
+        return false;
     }
 
-    // Find sps pps headers and mark their position
-    for(i = 0; i < frameLength - 3; i++)
+    avcodec_parameters_copy(pBsf->par_in, pCodecParams);
+    pBsf->time_base_in = AV_TIME_BASE_Q;
+
+    AVPacket* pPacketCopy = av_packet_clone(pPacket);
+
+    if ((0 <= av_bsf_init(pBsf)) && (NULL != pPacketCopy) && (0 <= av_bsf_send_packet(pBsf, pPacketCopy)))
     {
-        if ( (pCodedFrame[i + 0] == 0x0) &&
-             (pCodedFrame[i + 1] == 0x0) &&
-             (pCodedFrame[i + 2] == 0x1)
-           )
+        while (0 == av_bsf_receive_packet(pBsf, pPacketCopy))
         {
-            // NAL header found
+            int         size = 0;
+            uint8_t*    pData = av_packet_get_side_data(pPacketCopy, AV_PKT_DATA_NEW_EXTRADATA, &size);
 
-            if (pCodedFrame[i + 3] == 0x67) // SPS nal
+            if ((NULL != pData) && (size > 0) && (NULL == pCodecParams->extradata))
             {
-                spsPpsStart = i;
-            }
-            else
-            {
-                if (pCodedFrame[i + 3] != 0x68) // PPS should be also included
+                pCodecParams->extradata = (uint8_t *)av_mallocz(size + AV_INPUT_BUFFER_PADDING_SIZE);
+                if (NULL != pCodecParams->extradata)
                 {
-                    spsPpsEnd = i;
+                    memcpy(pCodecParams->extradata, pData, size);
+                    pCodecParams->extradata_size = size;
                 }
             }
-
-            if ( spsPpsStart >= 0 && spsPpsEnd > 0)
-            {
-                break;  // Sps and pps found and can be copied to extradata
-            }
+            av_packet_unref(pPacketCopy);
         }
     }
 
-    spsPpsDatalength = (spsPpsEnd - spsPpsStart);
+    av_packet_free(&pPacketCopy);
+    av_bsf_free(&pBsf);
 
-    if ( (spsPpsEnd <= 0) || (spsPpsDatalength < 8))  // Invalid sps pps sequence size
-    {
-        return;
-    }
-
-    pCodecContext->extradata = (unsigned char *)malloc(spsPpsDatalength);
-    pCodecContext->extradata_size = spsPpsDatalength;
-    memcpy(pCodecContext->extradata, &pCodedFrame[spsPpsStart], spsPpsDatalength);
+    return NULL != pCodecParams->extradata;
 }
 
 void Output::WritePacket(QSharedPointer<AVPacket> pInPacket)
@@ -305,7 +311,10 @@ void Output::WritePacket(QSharedPointer<AVPacket> pInPacket)
         m_firstDts = pInPacket->dts;
 
         // Write format header to file
-        FillSPSPPS(m_pVideoStream->codecpar, pInPacket->data, pInPacket->size);
+        if (!FillExtradata(pInPacket.data()))
+        {
+            ERROR_MESSAGE0(ERR_TYPE_WARNING, "Output", "No parameter sets found in the first keyframe");
+        }
 
         AVDictionary* opts(0);
 
@@ -327,7 +336,13 @@ void Output::WritePacket(QSharedPointer<AVPacket> pInPacket)
     pPacket->dts -= m_firstDts;
     pPacket->pts -= m_firstDts;
     av_packet_rescale_ts(pPacket, AV_TIME_BASE_Q, m_pVideoStream->time_base);
+    m_bytesWritten += pPacket->size;
+
+    int64_t startUs = MonotonicTimeUs();
     int res = av_interleaved_write_frame(m_pFormatCtx, pPacket); // this call should also unref passed avpacket
+    int64_t nowUs = MonotonicTimeUs();
+
+    m_writeTimeStat.Add(nowUs - startUs);
     av_packet_free(&pPacket);
     if (res < 0)
     {
@@ -345,6 +360,19 @@ void Output::WritePacket(QSharedPointer<AVPacket> pInPacket)
         m_numErrorsInRow = 0;
     }
 
+    if (nowUs - m_statsStartUs >= STATS_INTERVAL_MSEC * 1000)
+    {
+        ERROR_MESSAGE5(ERR_TYPE_MESSAGE, "Output", "Output %s stats: %lld packets, %.1f kbit/s, write time avg %.2f ms max %.2f ms",
+                       m_outputUrl.toUtf8().constData(),
+                       (long long)m_writeTimeStat.Count(),
+                       m_bytesWritten * 8 / 1000.0 / ((nowUs - m_statsStartUs) / 1000000.0),
+                       m_writeTimeStat.Average() / 1000.0,
+                       m_writeTimeStat.Max() / 1000.0);
+        m_writeTimeStat.Reset();
+        m_bytesWritten = 0;
+        m_statsStartUs = nowUs;
+    }
+
     DEBUG_MESSAGE0("Output", "WritePacket() finished");
 }
 
@@ -6,6 +6,7 @@
 #include <QtWebSockets>
 
 #include "common.h"
+#include "statistics.h"
 
 #define  DEFAULT_AVIO_BUFSIZE    (1024*1024*16)    // 16m buffer should be enough for 1 gop fragment
 
@@ -39,12 +40,18 @@ private:
     bool                m_outputInitialized;    /// indicates, if output format initialized correctly
     int                 m_numErrorsInRow;
 
-    AVBSFContext*       m_pH264bsf;
     AVFormatContext*    m_pFormatCtx;
     AVStream*           m_pVideoStream;
     AVCodecParameters*  m_pEncoderParams;
     AVIOContext*        m_pAVIOCtx;
     uint8_t*            m_pAvioCtxBuffer;
+
+    // Statistics
+    int64_t             m_statsStartUs;
+    RunningStat         m_writeTimeStat;        /// av_interleaved_write_frame() time, grows when big packets block on the socket
+    int64_t             m_bytesWritten;
+
+    bool    FillExtradata(const AVPacket* pPacket);     /// Copies parameter sets of the keyframe into stream extradata
 };
 
 #endif // OUTPUT_H
@@ -0,0 +1,393 @@
+#include "overlay.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "font.h"
+#include "planeKernels.h"
+#include "statistics.h"
+
+#define OVERLAY_BLACK_Y         16      // Limited range black
+#define OVERLAY_WHITE_Y         235     // Limited range white
+#define OVERLAY_BORDER_Y        128     // Gray tile borders
+#define OVERLAY_LABEL_ALPHA     128     // Semi-transparent label background
+#define OVERLAY_NEUTRAL_UV      128     // All overlay colors are gray
+#define OVERLAY_MARGIN          4       // Distance of labels from tile edges, in font pixels
+#define OVERLAY_PADDING         2       // Label box around text, in font pixels
+#define OVERLAY_CLOCK_FORMAT    "%Y-%m-%d %H:%M:%S"
+#define OVERLAY_CLOCK_LENGTH    19
+#define OVERLAY_CLOCK_CHARS     "0123456789-: "
+
+/*
+ * Full frame luma + alpha raster the static overlay is drawn into, writes are clipped to the current tile
+*/
+struct Raster
+{
+    uint8_t*    pY;
+    uint8_t*    pA;
+    int         stride;
+    LayoutRect  clip;
+};
+
+static void PaintRect(Raster& raster, const LayoutRect& rect, uint8_t value, uint8_t alpha)
+{
+    LayoutRect r = rect.Intersected(raster.clip);
+
+    for (int y = r.y; y < r.y + r.height; y++)
+    {
+        memset(raster.pY + y * raster.stride + r.x, value, r.width);
+        memset(raster.pA + y * raster.stride + r.x, alpha, r.width);
+    }
+}
+
+// Paints text with top-left corner of the first glyph at (x, y), glyphs get a one font pixel black outline
+static void PaintText(Raster& raster, int x, int y, const QByteArray& text, int scale)
+{
+    // Text bitmap at font resolution with outline border: 0 - empty, 1 - outline, 2 - glyph
+    int                 width = text.size() * FONT_GLYPH_WIDTH + 2;
+    int                 height = FONT_GLYPH_HEIGHT + 2;
+    QVector<uint8_t>    bitmap(width * height, 0);
+
+    for (int i = 0; i < text.size(); i++)
+    {
+        const uint8_t* pGlyph = FontGlyph(text[i]);
+
+        for (int gy = 0; gy < FONT_GLYPH_HEIGHT; gy++)
+        {
+            for (int gx = 0; gx < FONT_GLYPH_WIDTH; gx++)
+            {
+                if (!(pGlyph[gy] & (0x80 >> gx)))
+                    continue;
+
+                int bx = 1 + i * FONT_GLYPH_WIDTH + gx;
+                int by = 1 + gy;
+
+                for (int dy = -1; dy <= 1; dy++)
+                {
+                    for (int dx = -1; dx <= 1; dx++)
+                    {
+                        uint8_t& pixel = bitmap[(by + dy) * width + bx + dx];
+                        pixel = FFMAX(pixel, (uint8_t)1);
+                    }
+                }
+                bitmap[by * width + bx] = 2;
+            }
+        }
+    }
+
+    for (int by = 0; by < height; by++)
+    {
+        for (int bx = 0; bx < width; bx++)
+        {
+            uint8_t pixel = bitmap[by * width + bx];
+
+            if (pixel)
+            {
+                PaintRect(raster, LayoutRect(x + (bx - 1) * scale, y + (by - 1) * scale, scale, scale),
+                          (pixel == 2) ? OVERLAY_WHITE_Y : OVERLAY_BLACK_Y, 255);
+            }
+        }
+    }
+}
+
+Overlay::Overlay(const Layout& layout, const OverlayParameters& params) :
+    m_spanCount(0),
+    m_textScale(FFMAX(1, layout.Height() / 540)),
+    m_cellWidth(0),
+    m_cellHeight(0),
+    m_clockTime(0),
+    m_blendedBytes(0),
+    m_blendUs(0),
+    m_clockUs(0)
+{
+    int                 stride = layout.Width();
+    QVector<uint8_t>    rasterY(stride * layout.Height(), 0);
+    QVector<uint8_t>    rasterA(stride * layout.Height(), 0);
+    int                 margin = OVERLAY_MARGIN * m_textScale;
+    int                 padding = OVERLAY_PADDING * m_textScale;
+
+    m_tiles.resize(layout.NumTiles());
+
+    for (int tile = 0; tile < layout.NumTiles(); tile++)
+    {
+        const LayoutRect&   rect = layout.TileRect(tile);
+        Raster              raster = { rasterY.data(), rasterA.data(), stride, rect };
+        int                 border = FFMIN(params.borderWidth, FFMIN(rect.width, rect.height) / 2);
+
+        PaintRect(raster, rect, 0, 0);
+
+        if (border > 0)
+        {
+            PaintRect(raster, LayoutRect(rect.x, rect.y, rect.width, border), OVERLAY_BORDER_Y, 255);
+            PaintRect(raster, LayoutRect(rect.x, rect.y + rect.height - border, rect.width, border), OVERLAY_BORDER_Y, 255);
+            PaintRect(raster, LayoutRect(rect.x, rect.y, border, rect.height), OVERLAY_BORDER_Y, 255);
+            PaintRect(raster, LayoutRect(rect.x + rect.width - border, rect.y, border, rect.height), OVERLAY_BORDER_Y, 255);
+        }
+
+        if (params.showNames && (tile < params.names.size()))
+        {
+            QByteArray  text = params.names[tile].toLatin1();
+            int         maxChars = (rect.width - 2 * border - 2 * margin - 2 * padding) / (FONT_GLYPH_WIDTH * m_textScale);
+            int         boxHeight = FONT_GLYPH_HEIGHT * m_textScale + 2 * padding;
+
+            if (text.size() > maxChars)
+            {
+                text.truncate(FFMAX(0, maxChars));
+            }
+            if (!text.isEmpty() && (rect.height >= boxHeight + 2 * (border + margin)))
+            {
+                LayoutRect box(rect.x + border + margin, rect.y + rect.height - border - margin - boxHeight,
+                               text.size() * FONT_GLYPH_WIDTH * m_textScale + 2 * padding, boxHeight);
+
+                PaintRect(raster, box, OVERLAY_BLACK_Y, OVERLAY_LABEL_ALPHA);
+                PaintText(raster, box.x + padding, box.y + padding, text, m_textScale);
+            }
+        }
+
+        BuildTileSpans(tile, layout.VisibleRects(tile), rasterY.data(), rasterA.data(), stride);
+    }
+
+    if (params.showClock)
+    {
+        BuildClockAtlas(layout.Width());
+    }
+
+    ERROR_MESSAGE3(ERR_TYPE_MESSAGE, "Overlay", "Overlay: %d spans (%d bytes) cached, %s kernels",
+                   m_spanCount, m_values.size(), PlaneKernelsImplementation());
+}
+
+// Collects runs of non-transparent mask pixels in the visible part of the tile
+void Overlay::BuildTileSpans(int tile, const QVector<LayoutRect>& visible, const uint8_t* pRasterY, const uint8_t* pRasterA, int stride)
+{
+    QVector<Span>& spans = m_tiles[tile].spans;
+
+    for (int i = 0; i < visible.size(); i++)
+    {
+        const LayoutRect& v = visible[i];
+
+        // Luma
+        for (int y = v.y; y < v.y + v.height; y++)
+        {
+            const uint8_t*  pA = pRasterA + y * stride;
+            int             x = v.x;
+
+            while (x < v.x + v.width)
+            {
+                if (!pA[x])
+                {
+                    x++;
+                    continue;
+                }
+
+                Span span = { 0, x, y, 0, m_values.size() };
+
+                for (; (x < v.x + v.width) && pA[x]; x++)
+                {
+                    m_values.append(pRasterY[y * stride + x]);
+                    m_alphas.append(pA[x]);
+                }
+                span.length = x - span.x;
+                spans.append(span);
+            }
+        }
+
+        // Chroma: 2x2 averaged alpha towards neutral gray, the same data is shared by U and V spans
+        for (int cy = v.y / 2; cy < (v.y + v.height) / 2; cy++)
+        {
+            const uint8_t*  pA0 = pRasterA + 2 * cy * stride;
+            const uint8_t*  pA1 = pA0 + stride;
+            int             cx = v.x / 2;
+
+            while (cx < (v.x + v.width) / 2)
+            {
+                int alpha = (pA0[2 * cx] + pA0[2 * cx + 1] + pA1[2 * cx] + pA1[2 * cx + 1] + 2) / 4;
+
+                if (!alpha)
+                {
+                    cx++;
+                    continue;
+                }
+
+                Span span = { 1, cx, cy, 0, m_values.size() };
+
+                for (; cx < (v.x + v.width) / 2; cx++)
+                {
+                    alpha = (pA0[2 * cx] + pA0[2 * cx + 1] + pA1[2 * cx] + pA1[2 * cx + 1] + 2) / 4;
+                    if (!alpha)
+                        break;
+
+                    m_values.append(OVERLAY_NEUTRAL_UV);
+                    m_alphas.append((uint8_t)alpha);
+                }
+                span.length = cx - span.x;
+                spans.append(span);
+                span.plane = 2;
+                spans.append(span);
+            }
+        }
+    }
+
+    m_spanCount += spans.size();
+}
+
+// Renders luma cells of clock characters and places the clock box in the top right corner
+void Overlay::BuildClockAtlas(int outWidth)
+{
+    const char* chars = OVERLAY_CLOCK_CHARS;
+    int         numChars = strlen(chars);
+    int         margin = OVERLAY_MARGIN * m_textScale;
+    int         padding = OVERLAY_PADDING * m_textScale;
+    QByteArray  text(chars);
+
+    m_cellWidth = FONT_GLYPH_WIDTH * m_textScale;
+    m_cellHeight = FONT_GLYPH_HEIGHT * m_textScale;
+
+    LayoutRect clock(0, 0, OVERLAY_CLOCK_LENGTH * m_cellWidth + 2 * padding, m_cellHeight + 2 * padding);
+
+    clock.x = (outWidth - clock.width - margin) & ~1;
+    clock.y = margin & ~1;
+    clock.width = (clock.width + 1) & ~1;
+    clock.height = (clock.height + 1) & ~1;
+    if (clock.x < 0)
+    {
+        ERROR_MESSAGE0(ERR_TYPE_WARNING, "Overlay", "Output is too narrow for the clock, clock is disabled");
+        return;
+    }
+
+    QVector<uint8_t>    alpha(numChars * m_cellWidth * m_cellHeight);
+    Raster              raster = { NULL, alpha.data(), numChars * m_cellWidth, LayoutRect(0, 0, numChars * m_cellWidth, m_cellHeight) };
+
+    // Glyphs are drawn on the opaque box, so the outline is just box color
+    m_atlas.fill(OVERLAY_BLACK_Y, alpha.size());
+    raster.pY = m_atlas.data();
+    PaintText(raster, 0, 0, text, m_textScale);
+
+    m_clockRect = clock;
+}
+
+void Overlay::ClipSpans(const QVector<Span>& spans, const LayoutRect& picture, QVector<Span>* pOut)
+{
+    pOut->clear();
+
+    for (int i = 0; i < spans.size(); i++)
+    {
+        Span        span = spans[i];
+        LayoutRect  clip = picture;
+
+        if (span.plane)
+        {
+            clip = LayoutRect(picture.x / 2, picture.y / 2, picture.width / 2, picture.height / 2);
+        }
+        if ((span.y < clip.y) || (span.y >= clip.y + clip.height))
+            continue;
+
+        int left = FFMAX(span.x, clip.x);
+        int right = FFMIN(span.x + span.length, clip.x + clip.width);
+
+        if (left >= right)
+            continue;
+
+        span.dataOffset += left - span.x;
+        span.x = left;
+        span.length = right - left;
+        pOut->append(span);
+    }
+}
+
+void Overlay::BlendTile(AVFrame* pFrame, int tile, const LayoutRect& picture, bool wholeTile)
+{
+    TileSpans&              tileSpans = m_tiles[tile];
+    const QVector<Span>*    pSpans = &tileSpans.spans;
+    int64_t                 startUs = MonotonicTimeUs();
+    int64_t                 bytes = 0;
+
+    if (tileSpans.spans.isEmpty())
+        return;
+
+    if (!wholeTile)
+    {
+        // Tile is owned by a single compose thread, so its cache needs no locking
+        if (!(tileSpans.picture == picture))
+        {
+            ClipSpans(tileSpans.spans, picture, &tileSpans.pictureSpans);
+            tileSpans.picture = picture;
+        }
+        pSpans = &tileSpans.pictureSpans;
+    }
+
+    for (int i = 0; i < pSpans->size(); i++)
+    {
+        const Span& span = (*pSpans)[i];
+
+        BlendRow(pFrame->data[span.plane] + span.y * pFrame->linesize[span.plane] + span.x,
+                 m_values.constData() + span.dataOffset, m_alphas.constData() + span.dataOffset, span.length);
+        bytes += span.length;
+    }
+
+    m_blendedBytes.fetchAndAddRelaxed(bytes);
+    m_blendUs.fetchAndAddRelaxed(MonotonicTimeUs() - startUs);
+}
+
+void Overlay::DrawClock(AVFrame* pFrame)
+{
+    if (m_clockRect.IsEmpty())
+        return;
+
+    int64_t     startUs = MonotonicTimeUs();
+    time_t      now = time(NULL);
+    struct tm   local;
+    char        text[OVERLAY_CLOCK_LENGTH + 1];
+    const char* chars = OVERLAY_CLOCK_CHARS;
+    int         atlasStride = strlen(chars) * m_cellWidth;
+    int         padding = OVERLAY_PADDING * m_textScale;
+
+    localtime_r(&now, &local);
+    if (strftime(text, sizeof(text), OVERLAY_CLOCK_FORMAT, &local) != OVERLAY_CLOCK_LENGTH)
+        return;
+    m_clockTime = now;
+
+    // Opaque box
+    for (int y = m_clockRect.y; y < m_clockRect.y + m_clockRect.height; y++)
+    {
+        memset(pFrame->data[0] + y * pFrame->linesize[0] + m_clockRect.x, OVERLAY_BLACK_Y, m_clockRect.width);
+    }
+    for (int plane = 1; plane < 3; plane++)
+    {
+        for (int y = m_clockRect.y / 2; y < (m_clockRect.y + m_clockRect.height) / 2; y++)
+        {
+            memset(pFrame->data[plane] + y * pFrame->linesize[plane] + m_clockRect.x / 2, OVERLAY_NEUTRAL_UV, m_clockRect.width / 2);
+        }
+    }
+
+    // Glyph cells
+    for (int i = 0; i < OVERLAY_CLOCK_LENGTH; i++)
+    {
+        const char* pChar = strchr(chars, text[i]);
+
+        if (!pChar || (text[i] == ' '))
+            continue;
+
+        const uint8_t*  pCell = m_atlas.constData() + (pChar - chars) * m_cellWidth;
+        uint8_t*        pDst = pFrame->data[0] + (m_clockRect.y + padding) * pFrame->linesize[0] + m_clockRect.x + padding + i * m_cellWidth;
+
+        for (int y = 0; y < m_cellHeight; y++)
+        {
+            memcpy(pDst + y * pFrame->linesize[0], pCell + y * atlasStride, m_cellWidth);
+        }
+    }
+
+    m_clockUs += MonotonicTimeUs() - startUs;
+}
+
+bool Overlay::ClockChanged() const
+{
+    return !m_clockRect.IsEmpty() && (time(NULL) != m_clockTime);
+}
+
+void Overlay::TakeCounters(int64_t* pBlendedBytes, int64_t* pBlendUs, int64_t* pClockUs)
+{
+    *pBlendedBytes = m_blendedBytes.fetchAndStoreRelaxed(0);
+    *pBlendUs = m_blendUs.fetchAndStoreRelaxed(0);
+    *pClockUs = m_clockUs;
+    m_clockUs = 0;
+}
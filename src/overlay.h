@@ -0,0 +1,81 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <QVector>
+#include <QString>
+#include <QAtomicInteger>
+
+#include "common.h"
+#include "layout.h"
+
+struct OverlayParameters
+{
+    OverlayParameters() : borderWidth(0), showNames(false), showClock(false) {}
+
+    int                 borderWidth;    /// Tile border in pixels, 0 - no borders
+    bool                showNames;      /// Camera name label in each tile
+    bool                showClock;      /// Wall clock in the top right corner
+    QVector<QString>    names;          /// Label of each layout tile
+};
+
+/*
+ * Overlay drawn over the mosaic
+ * Static elements (tile borders, camera names) are rasterized once per layout into a YUV+alpha mask,
+ * kept as per-tile spans of non-transparent pixels. A tile's mask is blended right after the tile
+ * got new content, so it is never blended twice over the same picture.
+ * The clock is drawn from a pre-rendered glyph atlas onto an opaque box every tick.
+*/
+class Overlay
+{
+public:
+    Overlay(const Layout& layout, const OverlayParameters& params);
+
+    bool    IsEmpty() const { return m_spanCount == 0 && m_clockRect.IsEmpty(); }
+
+    // Blends static mask of the tile: whole tile after it was cleared, otherwise only the freshly drawn picture area.
+    // Calls for different tiles may run concurrently
+    void    BlendTile(AVFrame* pFrame, int tile, const LayoutRect& picture, bool wholeTile);
+    void    DrawClock(AVFrame* pFrame);
+    bool    ClockChanged() const;   /// Clock text differs from the one drawn last
+
+    void    TakeCounters(int64_t* pBlendedBytes, int64_t* pBlendUs, int64_t* pClockUs);
+
+private:
+    struct Span
+    {
+        int plane;          /// 0 - Y, 1 - U, 2 - V
+        int x;              /// Position in plane
+        int y;
+        int length;
+        int dataOffset;     /// Index of span pixels in m_values and m_alphas
+    };
+
+    struct TileSpans
+    {
+        QVector<Span>   spans;          /// Whole visible tile
+        LayoutRect      picture;        /// Picture area pictureSpans are clipped to
+        QVector<Span>   pictureSpans;
+    };
+
+    QVector<TileSpans>  m_tiles;
+    QVector<uint8_t>    m_values;       /// Mask pixel values of all spans
+    QVector<uint8_t>    m_alphas;       /// Mask alpha of all spans
+    int                 m_spanCount;
+
+    int                 m_textScale;    /// Font pixel size in output pixels
+    QVector<uint8_t>    m_atlas;        /// Luma of clock glyphs on box background, one cell per OVERLAY_CLOCK_CHARS
+    int                 m_cellWidth;
+    int                 m_cellHeight;
+    LayoutRect          m_clockRect;    /// Opaque clock box, empty if clock is off
+    time_t              m_clockTime;    /// Wall clock second drawn last
+
+    QAtomicInteger<qint64>  m_blendedBytes;
+    QAtomicInteger<qint64>  m_blendUs;
+    int64_t                 m_clockUs;
+
+    void    BuildTileSpans(int tile, const QVector<LayoutRect>& visible, const uint8_t* pRasterY, const uint8_t* pRasterA, int stride);
+    void    BuildClockAtlas(int outWidth);
+    static void ClipSpans(const QVector<Span>& spans, const LayoutRect& picture, QVector<Span>* pOut);
+};
+
+#endif // OVERLAY_H
@@ -0,0 +1,80 @@
+#include "packetQueue.h"
+
+PacketQueue::PacketQueue(int depth) :
+    maxDepth(0),
+    droppedPackets(0),
+    m_queue(depth),
+    m_dropUntilKeyframe(false)
+{
+
+}
+
+PacketQueue::~PacketQueue()
+{
+    Flush();
+}
+
+bool PacketQueue::Push(AVPacket* pPacket, int64_t readUs)
+{
+    Entry entry;
+
+    // Previous overflow - wait for the keyframe to resume
+    if (m_dropUntilKeyframe && !(pPacket->flags & AV_PKT_FLAG_KEY))
+    {
+        droppedPackets++;
+        av_packet_free(&pPacket);
+        return false;
+    }
+
+    entry.pPacket = pPacket;
+    entry.readUs = readUs;
+
+    if (!m_queue.Push(entry))
+    {
+        if (!m_dropUntilKeyframe)
+        {
+            ERROR_MESSAGE1(ERR_TYPE_WARNING, "PacketQueue", "Queue overflow (%d packets), dropping until next keyframe", m_queue.Capacity());
+        }
+        m_dropUntilKeyframe = true;
+        droppedPackets++;
+        av_packet_free(&pPacket);
+        return false;
+    }
+
+    m_dropUntilKeyframe = false;
+    maxDepth = FFMAX(maxDepth, m_queue.Size());
+
+    return true;
+}
+
+bool PacketQueue::Pop(AVPacket** ppPacket, int64_t* pReadUs)
+{
+    Entry entry;
+
+    if (!m_queue.Pop(entry))
+    {
+        return false;
+    }
+
+    *ppPacket = entry.pPacket;
+    *pReadUs = entry.readUs;
+
+    return true;
+}
+
+int PacketQueue::Flush()
+{
+    Entry   entry;
+    int     flushed = 0;
+
+    while (m_queue.Pop(entry))
+    {
+        av_packet_free(&entry.pPacket);
+        flushed++;
+    }
+
+    // Decoder is reset after flush, so continue with a keyframe only
+    m_dropUntilKeyframe = true;
+
+    return flushed;
+}
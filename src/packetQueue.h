@@ -0,0 +1,45 @@
+#ifndef PACKETQUEUE_H
+#define PACKETQUEUE_H
+
+#include "common.h"
+#include "spscQueue.h"
+
+/*
+ * Bounded packet queue between demux and decode stages of a stream
+ * On overflow all incoming packets are dropped until the next keyframe,
+ * so decoder never receives a broken reference chain
+*/
+
+class PacketQueue
+{
+public:
+    PacketQueue(int depth);
+    ~PacketQueue();
+
+    bool    Push(AVPacket* pPacket, int64_t readUs);    /// Producer side. Takes packet ownership, returns false if packet was dropped
+    bool    Pop(AVPacket** ppPacket, int64_t* pReadUs); /// Consumer side. Caller becomes packet owner
+    int     Flush();                                    /// Frees all queued packets, returns their number. Must not run concurrently with Pop()
+
+    int     Depth() const { return m_queue.Size(); }
+    int     Capacity() const { return m_queue.Capacity(); }
+
+    // Producer side counters
+    int     maxDepth;           /// Max depth seen since last ResetCounters()
+    int64_t droppedPackets;     /// Packets dropped since last ResetCounters()
+
+    void    ResetCounters() { maxDepth = 0; droppedPackets = 0; }
+
+private:
+    struct Entry
+    {
+        Entry() : pPacket(NULL), readUs(0) {}
+
+        AVPacket*   pPacket;
+        int64_t     readUs;     /// Time when packet was read from input
+    };
+
+    SpscQueue<Entry>    m_queue;
+    bool                m_dropUntilKeyframe;
+};
+
+#endif // PACKETQUEUE_H
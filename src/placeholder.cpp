@@ -0,0 +1,112 @@
+#include "placeholder.h"
+
+#include <string.h>
+
+#include "font.h"
+
+#define PLACEHOLDER_BACKGROUND_Y    32      // Dark gray, distinguishable from black letterbox
+#define PLACEHOLDER_TEXT_Y          180
+#define PLACEHOLDER_MAX_LINES       2
+
+static const char* placeholderText[][PLACEHOLDER_MAX_LINES] =
+{
+    { "NO CAMERA", "" },                    // PLACEHOLDER_NO_CAMERA
+    { "NO SIGNAL", "reconnecting..." }      // PLACEHOLDER_NO_SIGNAL
+};
+
+// Draws text line with top-left corner at (x, y), every font pixel becomes scale x scale block
+static void DrawText(AVFrame* pFrame, int x, int y, const char* text, int length, int scale)
+{
+    for (int i = 0; i < length; i++)
+    {
+        const uint8_t* pGlyph = FontGlyph(text[i]);
+
+        for (int gy = 0; gy < FONT_GLYPH_HEIGHT * scale; gy++)
+        {
+            uint8_t* pRow = pFrame->data[0] + (y + gy) * pFrame->linesize[0] + x + i * FONT_GLYPH_WIDTH * scale;
+
+            for (int gx = 0; gx < FONT_GLYPH_WIDTH * scale; gx++)
+            {
+                if (pGlyph[gy / scale] & (0x80 >> (gx / scale)))
+                {
+                    pRow[gx] = PLACEHOLDER_TEXT_Y;
+                }
+            }
+        }
+    }
+}
+
+QSharedPointer<AVFrame> PlaceholderCache::Get(int width, int height, PlaceholderKind kind)
+{
+    for (int i = 0; i < m_entries.size(); i++)
+    {
+        const Entry& entry = m_entries[i];
+
+        if ((entry.width == width) && (entry.height == height) && (entry.kind == kind))
+        {
+            return entry.pFrame;
+        }
+    }
+
+    Entry entry;
+
+    entry.width = width;
+    entry.height = height;
+    entry.kind = kind;
+    entry.pFrame = Render(width, height, kind);
+    if (!entry.pFrame.isNull())
+    {
+        m_entries.append(entry);
+    }
+    return entry.pFrame;
+}
+
+QSharedPointer<AVFrame> PlaceholderCache::Render(int width, int height, PlaceholderKind kind)
+{
+    AVFrame* pFrame = av_frame_alloc();
+
+    pFrame->format = AV_PIX_FMT_YUV420P;
+    pFrame->width = width;
+    pFrame->height = height;
+    pFrame->color_range = AVCOL_RANGE_MPEG;
+
+    if (0 > av_frame_get_buffer(pFrame, 32))
+    {
+        ERROR_MESSAGE0(ERR_TYPE_ERROR, "PlaceholderCache", "Failed to alocate frame buffer");
+        av_frame_free(&pFrame);
+        return QSharedPointer<AVFrame>(NULL);
+    }
+
+    QSharedPointer<AVFrame> pResult(pFrame, [] (AVFrame *ptr) {av_frame_free(&ptr);});
+
+    memset(pFrame->data[0], PLACEHOLDER_BACKGROUND_Y, height * pFrame->linesize[0]);
+    memset(pFrame->data[1], 128, ((height + 1) >> 1) * pFrame->linesize[1]);
+    memset(pFrame->data[2], 128, ((height + 1) >> 1) * pFrame->linesize[2]);
+
+    // Text size follows tile height, but the longest line has to fit into the tile
+    const char* const*  lines = placeholderText[kind];
+    int                 numLines = strlen(lines[1]) ? 2 : 1;
+    int                 maxLength = FFMAX(strlen(lines[0]), strlen(lines[1]));
+    int                 scale = FFMAX(1, height / 180);
+
+    while ((scale > 1) && (maxLength * FONT_GLYPH_WIDTH * scale > width))
+    {
+        scale--;
+    }
+
+    int lineHeight = (FONT_GLYPH_HEIGHT + FONT_GLYPH_HEIGHT / 4) * scale;
+    int y = (height - numLines * lineHeight) / 2;
+
+    if (y < 0)
+    {
+        return pResult;
+    }
+
+    for (int line = 0; line < numLines; line++, y += lineHeight)
+    {
+        int length = FFMIN((int)strlen(lines[line]), width / (FONT_GLYPH_WIDTH * scale));
+
+        DrawText(pFrame, (width - length * FONT_GLYPH_WIDTH * scale) / 2, y, lines[line], length, scale);
+    }
+    return pResult;
+}
@@ -0,0 +1,39 @@
+#ifndef PLACEHOLDER_H
+#define PLACEHOLDER_H
+
+#include <QVector>
+
+#include "common.h"
+
+enum PlaceholderKind
+{
+    PLACEHOLDER_NO_CAMERA,  // Tile has no camera configured
+    PLACEHOLDER_NO_SIGNAL   // Camera stopped delivering frames
+};
+
+/*
+ * Pictures shown in tiles without live video
+ * Each one is rendered once per tile size and kind, then composed like a regular frame,
+ * so an outage costs a single tile redraw instead of per-tick drawing.
+ * Not thread-safe, used by compositor thread only
+*/
+class PlaceholderCache
+{
+public:
+    QSharedPointer<AVFrame> Get(int width, int height, PlaceholderKind kind);
+
+private:
+    struct Entry
+    {
+        int                     width;
+        int                     height;
+        PlaceholderKind         kind;
+        QSharedPointer<AVFrame> pFrame;
+    };
+
+    QVector<Entry>  m_entries;
+
+    static QSharedPointer<AVFrame> Render(int width, int height, PlaceholderKind kind);
+};
+
+#endif // PLACEHOLDER_H
@@ -0,0 +1,261 @@
+#include "planeKernels.h"
+
+#include <string.h>
+
+extern "C" {
+#include <libavutil/cpu.h>
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PLANE_KERNELS_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PLANE_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+#define COPY_PLANE_MIN_SIMD_WIDTH   64  // Narrower rows are copied with memcpy
+
+typedef void (*BlendRowFunc)(uint8_t* pDst, const uint8_t* pSrc, const uint8_t* pAlpha, int width);
+typedef void (*CopyPlaneFunc)(uint8_t* pDst, int dstStride, const uint8_t* pSrc, int srcStride, int width, int height);
+
+static void CopyPlaneC(uint8_t* pDst, int dstStride, const uint8_t* pSrc, int srcStride, int width, int height)
+{
+    for (int y = 0; y < height; y++)
+    {
+        memcpy(pDst + y * dstStride, pSrc + y * srcStride, width);
+    }
+}
+
+static void BlendRowC(uint8_t* pDst, const uint8_t* pSrc, const uint8_t* pAlpha, int width)
+{
+    for (int x = 0; x < width; x++)
+    {
+        int a = pAlpha[x] + (pAlpha[x] >> 7);
+        pDst[x] = (uint8_t)((pSrc[x] * a + pDst[x] * (256 - a)) >> 8);
+    }
+}
+
+#ifdef PLANE_KERNELS_X86
+
+// 8 pixels in 16-bit lanes. Products fit into 16 bits: src * a + dst * (256 - a) <= 255 * 256
+static inline __m128i BlendLanesSSE2(__m128i dst, __m128i src, __m128i alpha)
+{
+    __m128i a = _mm_add_epi16(alpha, _mm_srli_epi16(alpha, 7));
+    __m128i sum = _mm_add_epi16(_mm_mullo_epi16(src, a), _mm_mullo_epi16(dst, _mm_sub_epi16(_mm_set1_epi16(256), a)));
+    return _mm_srli_epi16(sum, 8);
+}
+
+static void BlendRowSSE2(uint8_t* pDst, const uint8_t* pSrc, const uint8_t* pAlpha, int width)
+{
+    const __m128i   zero = _mm_setzero_si128();
+    int             x = 0;
+
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i dst = _mm_loadu_si128((const __m128i*)(pDst + x));
+        __m128i src = _mm_loadu_si128((const __m128i*)(pSrc + x));
+        __m128i alpha = _mm_loadu_si128((const __m128i*)(pAlpha + x));
+
+        __m128i lo = BlendLanesSSE2(_mm_unpacklo_epi8(dst, zero), _mm_unpacklo_epi8(src, zero), _mm_unpacklo_epi8(alpha, zero));
+        __m128i hi = BlendLanesSSE2(_mm_unpackhi_epi8(dst, zero), _mm_unpackhi_epi8(src, zero), _mm_unpackhi_epi8(alpha, zero));
+        _mm_storeu_si128((__m128i*)(pDst + x), _mm_packus_epi16(lo, hi));
+    }
+    BlendRowC(pDst + x, pSrc + x, pAlpha + x, width - x);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i BlendLanesAVX2(__m256i dst, __m256i src, __m256i alpha)
+{
+    __m256i a = _mm256_add_epi16(alpha, _mm256_srli_epi16(alpha, 7));
+    __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(src, a), _mm256_mullo_epi16(dst, _mm256_sub_epi16(_mm256_set1_epi16(256), a)));
+    return _mm256_srli_epi16(sum, 8);
+}
+
+__attribute__((target("avx2")))
+static void BlendRowAVX2(uint8_t* pDst, const uint8_t* pSrc, const uint8_t* pAlpha, int width)
+{
+    const __m256i   zero = _mm256_setzero_si256();
+    int             x = 0;
+
+    // Unpack and pack work within 128-bit lanes, so pixel order is preserved
+    for (; x + 32 <= width; x += 32)
+    {
+        __m256i dst = _mm256_loadu_si256((const __m256i*)(pDst + x));
+        __m256i src = _mm256_loadu_si256((const __m256i*)(pSrc + x));
+        __m256i alpha = _mm256_loadu_si256((const __m256i*)(pAlpha + x));
+
+        __m256i lo = BlendLanesAVX2(_mm256_unpacklo_epi8(dst, zero), _mm256_unpacklo_epi8(src, zero), _mm256_unpacklo_epi8(alpha, zero));
+        __m256i hi = BlendLanesAVX2(_mm256_unpackhi_epi8(dst, zero), _mm256_unpackhi_epi8(src, zero), _mm256_unpackhi_epi8(alpha, zero));
+        _mm256_storeu_si256((__m256i*)(pDst + x), _mm256_packus_epi16(lo, hi));
+    }
+    BlendRowSSE2(pDst + x, pSrc + x, pAlpha + x, width - x);
+}
+
+// Bytes to copy before pDst gets aligned to the vector size
+static inline int AlignHead(const uint8_t* pDst, int alignment)
+{
+    return (int)((alignment - ((uintptr_t)pDst & (alignment - 1))) & (alignment - 1));
+}
+
+static void CopyPlaneSSE2(uint8_t* pDst, int dstStride, const uint8_t* pSrc, int srcStride, int width, int height)
+{
+    if (width < COPY_PLANE_MIN_SIMD_WIDTH)
+    {
+        CopyPlaneC(pDst, dstStride, pSrc, srcStride, width, height);
+        return;
+    }
+
+    for (int y = 0; y < height; y++)
+    {
+        uint8_t*        pDstRow = pDst + y * dstStride;
+        const uint8_t*  pSrcRow = pSrc + y * srcStride;
+        int             x = AlignHead(pDstRow, 16);
+
+        // Scaled pictures have arbitrary offsets, so only stores are aligned
+        memcpy(pDstRow, pSrcRow, x);
+        for (; x + 32 <= width; x += 32)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i*)(pSrcRow + x));
+            __m128i b = _mm_loadu_si128((const __m128i*)(pSrcRow + x + 16));
+            _mm_store_si128((__m128i*)(pDstRow + x), a);
+            _mm_store_si128((__m128i*)(pDstRow + x + 16), b);
+        }
+        memcpy(pDstRow + x, pSrcRow + x, width - x);
+    }
+}
+
+__attribute__((target("avx2")))
+static void CopyPlaneAVX2(uint8_t* pDst, int dstStride, const uint8_t* pSrc, int srcStride, int width, int height)
+{
+    if (width < COPY_PLANE_MIN_SIMD_WIDTH)
+    {
+        CopyPlaneC(pDst, dstStride, pSrc, srcStride, width, height);
+        return;
+    }
+
+    for (int y = 0; y < height; y++)
+    {
+        uint8_t*        pDstRow = pDst + y * dstStride;
+        const uint8_t*  pSrcRow = pSrc + y * srcStride;
+        int             x = AlignHead(pDstRow, 32);
+
+        memcpy(pDstRow, pSrcRow, x);
+        for (; x + 64 <= width; x += 64)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i*)(pSrcRow + x));
+            __m256i b = _mm256_loadu_si256((const __m256i*)(pSrcRow + x + 32));
+            _mm256_store_si256((__m256i*)(pDstRow + x), a);
+            _mm256_store_si256((__m256i*)(pDstRow + x + 32), b);
+        }
+        memcpy(pDstRow + x, pSrcRow + x, width - x);
+    }
+}
+
+#endif // PLANE_KERNELS_X86
+
+#ifdef PLANE_KERNELS_NEON
+
+static void BlendRowNEON(uint8_t* pDst, const uint8_t* pSrc, const uint8_t* pAlpha, int width)
+{
+    int x = 0;
+
+    for (; x + 8 <= width; x += 8)
+    {
+        uint16x8_t alpha = vmovl_u8(vld1_u8(pAlpha + x));
+        uint16x8_t a = vaddq_u16(alpha, vshrq_n_u16(alpha, 7));
+        uint16x8_t sum = vmulq_u16(vmovl_u8(vld1_u8(pSrc + x)), a);
+
+        sum = vmlaq_u16(sum, vmovl_u8(vld1_u8(pDst + x)), vsubq_u16(vdupq_n_u16(256), a));
+        vst1_u8(pDst + x, vshrn_n_u16(sum, 8));
+    }
+    BlendRowC(pDst + x, pSrc + x, pAlpha + x, width - x);
+}
+
+static void CopyPlaneNEON(uint8_t* pDst, int dstStride, const uint8_t* pSrc, int srcStride, int width, int height)
+{
+    if (width < COPY_PLANE_MIN_SIMD_WIDTH)
+    {
+        CopyPlaneC(pDst, dstStride, pSrc, srcStride, width, height);
+        return;
+    }
+
+    for (int y = 0; y < height; y++)
+    {
+        uint8_t*        pDstRow = pDst + y * dstStride;
+        const uint8_t*  pSrcRow = pSrc + y * srcStride;
+        int             x = 0;
+
+        for (; x + 32 <= width; x += 32)
+        {
+            uint8x16_t a = vld1q_u8(pSrcRow + x);
+            uint8x16_t b = vld1q_u8(pSrcRow + x + 16);
+            vst1q_u8(pDstRow + x, a);
+            vst1q_u8(pDstRow + x + 16, b);
+        }
+        memcpy(pDstRow + x, pSrcRow + x, width - x);
+    }
+}
+
+#endif // PLANE_KERNELS_NEON
+
+struct PlaneKernels
+{
+    PlaneKernels()
+    {
+        int flags = av_get_cpu_flags();
+
+        name = "c";
+        blendRow = &BlendRowC;
+        copyPlane = &CopyPlaneC;
+
+#ifdef PLANE_KERNELS_X86
+        if (flags & AV_CPU_FLAG_AVX2)
+        {
+            name = "avx2";
+            blendRow = &BlendRowAVX2;
+            copyPlane = &CopyPlaneAVX2;
+        }
+        else if (flags & AV_CPU_FLAG_SSE2)
+        {
+            name = "sse2";
+            blendRow = &BlendRowSSE2;
+            copyPlane = &CopyPlaneSSE2;
+        }
+#endif
+#ifdef PLANE_KERNELS_NEON
+        if (flags & AV_CPU_FLAG_NEON)
+        {
+            name = "neon";
+            blendRow = &BlendRowNEON;
+            copyPlane = &CopyPlaneNEON;
+        }
+#endif
+        (void)flags;
+    }
+
+    const char*     name;
+    BlendRowFunc    blendRow;
+    CopyPlaneFunc   copyPlane;
+};
+
+static const PlaneKernels& Kernels()
+{
+    static PlaneKernels kernels;    // Selected once, on first use
+    return kernels;
+}
+
+void BlendRow(uint8_t* pDst, const uint8_t* pSrc, const uint8_t* pAlpha, int width)
+{
+    Kernels().blendRow(pDst, pSrc, pAlpha, width);
+}
+
+void CopyPlane(uint8_t* pDst, int dstStride, const uint8_t* pSrc, int srcStride, int width, int height)
+{
+    Kernels().copyPlane(pDst, dstStride, pSrc, srcStride, width, height);
+}
+
+const char* PlaneKernelsImplementation()
+{
+    return Kernels().name;
+}
@@ -0,0 +1,19 @@
+#ifndef PLANEKERNELS_H
+#define PLANEKERNELS_H
+
+#include <stdint.h>
+
+/*
+ * Row kernels for compositing 8-bit picture planes
+ * AVX2, SSE2, NEON or plain C variants are selected at runtime from cpu features
+*/
+
+// dst = (src * a + dst * (256 - a)) >> 8, where a = alpha + (alpha >> 7), so alpha 255 gives src exactly
+void        BlendRow(uint8_t* pDst, const uint8_t* pSrc, const uint8_t* pAlpha, int width);
+
+// Copies width x height bytes between strided planes
+void        CopyPlane(uint8_t* pDst, int dstStride, const uint8_t* pSrc, int srcStride, int width, int height);
+
+const char* PlaneKernelsImplementation();   /// Name of selected kernels
+
+#endif // PLANEKERNELS_H
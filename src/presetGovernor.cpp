@@ -0,0 +1,120 @@
+#include "presetGovernor.h"
+
+#define GOVERNOR_OVERLOAD_PERCENT   85  // GOP average above this share of the budget steps to a faster preset
+#define GOVERNOR_LATE_PERCENT       10  // So does this share of frames encoded over budget
+#define GOVERNOR_LIGHT_PERCENT      45  // GOP average below this share of the budget counts as lightly loaded
+#define GOVERNOR_LIGHT_GOPS         3   // Lightly loaded GOPs in a row before a slower preset is tried
+#define GOVERNOR_HOLD_GOPS          10  // GOPs after stepping faster during which no slower preset is tried
+
+static const char* s_presets[] = {"ultrafast", "superfast", "veryfast", "faster", "fast", "medium"};
+static const int   s_numPresets = sizeof(s_presets) / sizeof(s_presets[0]);
+
+PresetGovernor::PresetGovernor(int fps, int preset, int slowestPreset) :
+    m_budgetUs(1000000 / FFMAX(1, fps)),
+    m_preset(preset),
+    m_slowestPreset(slowestPreset),
+    m_lightGops(0),
+    m_holdGops(0),
+    m_gopFrames(0),
+    m_gopEncodeUs(0),
+    m_gopLateFrames(0),
+    m_stepsFaster(0),
+    m_stepsSlower(0)
+{
+    m_slowestPreset = av_clip(m_slowestPreset, 0, s_numPresets - 1);
+    m_preset = av_clip(m_preset, 0, m_slowestPreset);
+    memset(m_histogram, 0, sizeof(m_histogram));
+}
+
+int PresetGovernor::PresetIndex(const QString& name)
+{
+    for (int i = 0; i < s_numPresets; i++)
+    {
+        if (name == s_presets[i])
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char* PresetGovernor::PresetName(int preset)
+{
+    return s_presets[av_clip(preset, 0, s_numPresets - 1)];
+}
+
+void PresetGovernor::AddFrame(int64_t encodeUs)
+{
+    static const int s_bucketPercent[GOVERNOR_HISTOGRAM_BUCKETS - 1] = {25, 50, 75, 100, 150};
+
+    int bucket = 0;
+    while ((bucket < GOVERNOR_HISTOGRAM_BUCKETS - 1) && (encodeUs * 100 >= m_budgetUs * s_bucketPercent[bucket]))
+    {
+        bucket++;
+    }
+    m_histogram[bucket]++;
+
+    m_gopFrames++;
+    m_gopEncodeUs += encodeUs;
+    if (encodeUs > m_budgetUs)
+    {
+        m_gopLateFrames++;
+    }
+}
+
+bool PresetGovernor::EndGop()
+{
+    if (0 == m_gopFrames)
+    {
+        return false;
+    }
+
+    int64_t averageUs = m_gopEncodeUs / m_gopFrames;
+    bool    overloaded = (averageUs * 100 > m_budgetUs * GOVERNOR_OVERLOAD_PERCENT) ||
+                         (m_gopLateFrames * 100 > m_gopFrames * GOVERNOR_LATE_PERCENT);
+    bool    light = (averageUs * 100 < m_budgetUs * GOVERNOR_LIGHT_PERCENT) && (0 == m_gopLateFrames);
+    int     preset = m_preset;
+
+    m_gopFrames = 0;
+    m_gopEncodeUs = 0;
+    m_gopLateFrames = 0;
+    m_holdGops = FFMAX(0, m_holdGops - 1);
+
+    if (overloaded)
+    {
+        m_lightGops = 0;
+        if (m_preset > 0)
+        {
+            m_preset--;
+            m_holdGops = GOVERNOR_HOLD_GOPS;
+            m_stepsFaster++;
+        }
+    }
+    else if (light)
+    {
+        m_lightGops++;
+        if ((m_lightGops >= GOVERNOR_LIGHT_GOPS) && (0 == m_holdGops) && (m_preset < m_slowestPreset))
+        {
+            m_preset++;
+            m_lightGops = 0;
+            m_stepsSlower++;
+        }
+    }
+    else
+    {
+        m_lightGops = 0;
+    }
+
+    return preset != m_preset;
+}
+
+void PresetGovernor::TakeCounters(int64_t* pHistogram, int* pStepsFaster, int* pStepsSlower)
+{
+    memcpy(pHistogram, m_histogram, sizeof(m_histogram));
+    *pStepsFaster = m_stepsFaster;
+    *pStepsSlower = m_stepsSlower;
+
+    memset(m_histogram, 0, sizeof(m_histogram));
+    m_stepsFaster = 0;
+    m_stepsSlower = 0;
+}
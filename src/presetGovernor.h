@@ -0,0 +1,47 @@
+#ifndef PRESETGOVERNOR_H
+#define PRESETGOVERNOR_H
+
+#include <QVector>
+
+#include "common.h"
+
+#define GOVERNOR_HISTOGRAM_BUCKETS 6    // Encode time as fraction of frame budget: <25%, <50%, <75%, <100%, <150%, more
+
+/*
+ * Picks x264 preset from measured encode time
+ * Each GOP is judged against the 1/fps budget: an overloaded GOP steps to a faster preset at once,
+ * a slower preset is tried only after several lightly loaded GOPs in a row and never right after
+ * stepping down, so the encoder does not oscillate between two neighbouring presets.
+ * Not thread-safe, used by the thread encoding frames
+*/
+class PresetGovernor
+{
+public:
+    PresetGovernor(int fps, int preset, int slowestPreset);
+
+    static int          PresetIndex(const QString& name);   /// Index in the preset ladder, -1 if unknown
+    static const char*  PresetName(int preset);
+
+    int         Preset() const { return m_preset; }
+    void        AddFrame(int64_t encodeUs);     /// Encode time of one frame
+    bool        EndGop();                       /// Judges the finished GOP. Returns true if preset should change
+
+    /// Counters since last call. pHistogram has GOVERNOR_HISTOGRAM_BUCKETS entries
+    void        TakeCounters(int64_t* pHistogram, int* pStepsFaster, int* pStepsSlower);
+
+private:
+    int64_t             m_budgetUs;             /// Time per frame at output fps
+    int                 m_preset;
+    int                 m_slowestPreset;
+    int                 m_lightGops;            /// Lightly loaded GOPs in a row
+    int                 m_holdGops;             /// GOPs left before a slower preset may be tried again
+    int64_t             m_gopFrames;
+    int64_t             m_gopEncodeUs;
+    int64_t             m_gopLateFrames;        /// Frames over budget in current GOP
+
+    int64_t             m_histogram[GOVERNOR_HISTOGRAM_BUCKETS];
+    int                 m_stepsFaster;
+    int                 m_stepsSlower;
+};
+
+#endif // PRESETGOVERNOR_H
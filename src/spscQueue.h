@@ -0,0 +1,77 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <QAtomicInt>
+
+/*
+ * Bounded lock-free single-producer/single-consumer ring
+ * Push() must be called from one thread only, Pop() from one (other) thread only
+ * Slots are reset to T() after Pop(), so the queue does not keep references to popped items
+*/
+
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(int capacity) :
+        m_size(capacity + 1),
+        m_pBuffer(new T[capacity + 1]),
+        m_head(0),
+        m_tail(0)
+    {
+
+    }
+
+    ~SpscQueue()
+    {
+        delete[] m_pBuffer;
+    }
+
+    bool Push(const T& item)    /// Producer side. Returns false if queue is full
+    {
+        int tail = m_tail.load();
+        int next = (tail + 1) % m_size;
+
+        if (next == m_head.loadAcquire())
+        {
+            return false;
+        }
+        m_pBuffer[tail] = item;
+        m_tail.storeRelease(next);
+        return true;
+    }
+
+    bool Pop(T& item)           /// Consumer side. Returns false if queue is empty
+    {
+        int head = m_head.load();
+
+        if (head == m_tail.loadAcquire())
+        {
+            return false;
+        }
+        item = m_pBuffer[head];
+        m_pBuffer[head] = T();
+        m_head.storeRelease((head + 1) % m_size);
+        return true;
+    }
+
+    int  Size() const           /// Approximate number of queued items (exact when called by producer or consumer)
+    {
+        int size = m_tail.loadAcquire() - m_head.loadAcquire();
+        return (size < 0) ? size + m_size : size;
+    }
+
+    int  Capacity() const { return m_size - 1; }
+
+private:
+    Q_DISABLE_COPY(SpscQueue)
+
+    const int   m_size;             /// Number of slots (one slot is always kept empty)
+    T*          m_pBuffer;
+    char        m_pad0[64];         /// Keep head and tail on separate cache lines
+    QAtomicInt  m_head;             /// Next slot to read, written by consumer
+    char        m_pad1[64];
+    QAtomicInt  m_tail;             /// Next slot to write, written by producer
+};
+
+#endif // SPSCQUEUE_H
@@ -0,0 +1,73 @@
+#include "statistics.h"
+
+#include <time.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+int64_t MonotonicTimeUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int64_t ThreadCpuTimeUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void SleepUntilUs(int64_t monotonicUs)
+{
+    struct timespec ts;
+    ts.tv_sec = monotonicUs / 1000000;
+    ts.tv_nsec = (monotonicUs % 1000000) * 1000;
+
+    // Absolute deadline: restarting after a signal does not extend the sleep
+    while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+    {
+    }
+}
+
+int64_t ResidentSetSizeKb()
+{
+    long long   totalPages = 0;
+    long long   residentPages = 0;
+    FILE*       pFile = fopen("/proc/self/statm", "r");
+
+    if (NULL == pFile)
+    {
+        return 0;
+    }
+    if (2 != fscanf(pFile, "%lld %lld", &totalPages, &residentPages))
+    {
+        residentPages = 0;
+    }
+    fclose(pFile);
+
+    return (int64_t)residentPages * sysconf(_SC_PAGESIZE) / 1024;
+}
+
+void RunningStat::Add(int64_t value)
+{
+    if (0 == m_count || value < m_min)
+    {
+        m_min = value;
+    }
+    if (0 == m_count || value > m_max)
+    {
+        m_max = value;
+    }
+    m_sum += value;
+    m_count++;
+}
+
+void RunningStat::Reset()
+{
+    m_count = 0;
+    m_sum = 0;
+    m_min = 0;
+    m_max = 0;
+}
@@ -0,0 +1,39 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <stdint.h>
+
+#define STATS_INTERVAL_MSEC 10000   // How often pipeline components dump their statistics
+
+/*
+ * Helpers for collecting runtime performance statistics
+ * All values are accumulated by the owner thread and periodically dumped to the log
+*/
+
+int64_t MonotonicTimeUs();  /// CLOCK_MONOTONIC time in microseconds
+int64_t ThreadCpuTimeUs();  /// CPU time consumed by the calling thread in microseconds
+int64_t ResidentSetSizeKb();/// Resident memory of the process in kilobytes
+void    SleepUntilUs(int64_t monotonicUs);  /// Sleeps until absolute CLOCK_MONOTONIC time in microseconds
+
+class RunningStat
+{
+public:
+    RunningStat() { Reset(); }
+
+    void    Add(int64_t value);
+    void    Reset();
+
+    int64_t Count() const { return m_count; }
+    int64_t Min() const { return m_count ? m_min : 0; }
+    int64_t Max() const { return m_count ? m_max : 0; }
+    int64_t Sum() const { return m_sum; }
+    double  Average() const { return m_count ? (double)m_sum / (double)m_count : 0.0; }
+
+private:
+    int64_t m_count;
+    int64_t m_sum;
+    int64_t m_min;
+    int64_t m_max;
+};
+
+#endif // STATISTICS_H
@@ -4,33 +4,104 @@
 #include <QUrl>
 #include <QDateTime>
 
-Stream::Stream(QString name, QString inputUrl, int targetWidth, int targetHeight) :
+static const char* DecodePolicyNames[] = {"auto", "full", "nonref", "keyframe"};
+
+Stream::Stream(QString name, QString inputUrl, StreamParameters params, DecoderPool* pDecoderPool, QThreadPool* pConnectPool) :
     QObject(NULL),
     lastFrameReadMs(0),
     m_name(name),
     m_inputUrl(inputUrl),
+    m_params(params),
     m_pCaptureTimer(NULL),
-    m_targetWidth(targetWidth),
-    m_targetHeight(targetHeight),
+    m_pConnectPool(pConnectPool),
+    m_reconnecting(false),
     m_pInputContext(NULL),
     m_pCodecContext(NULL),
     m_pFrame(NULL),
+    m_decodePolicy(DECODE_POLICY_FULL),
     m_errorsInRow(0),
-    m_stop(false)
+    m_decodeErrorsInRow(0),
+    m_stop(0),
+    m_pDecoderPool(pDecoderPool),
+    m_decoderAffinity(0),
+    m_pPacketQueue(NULL),
+    m_packetsPending(0),
+    m_statsStartUs(0),
+    m_captureCpuUs(0),
+    m_emptyPolls(0),
+    m_framesEmitted(0),
+    m_packetsDecoded(0),
+    m_decodeCpuUs(0)
 {
-
+    if ((m_params.packetQueueDepth > 0) && (NULL != m_pDecoderPool))
+    {
+        m_pPacketQueue = new PacketQueue(m_params.packetQueueDepth);
+        m_decoderAffinity = m_pDecoderPool->NextAffinity();
+    }
 }
 
 Stream::~Stream()
 {
     ERROR_MESSAGE0(ERR_TYPE_MESSAGE, "Stream", "~Stream() called");
+    RequestStop();
     Deinitialize();
+    delete m_pCaptureTimer;
+    delete m_pPacketQueue;
+
+    for (int i = 0; i < m_sinks.size(); i++)
+    {
+        delete m_sinks[i].pScaler;
+        delete m_sinks[i].pFramePool;
+    }
+}
+
+void Stream::AddFrameBuffer(FrameBuffer* pBuffer, int targetWidth, int targetHeight)
+{
+    for (int i = 0; i < m_sinks.size(); i++)
+    {
+        Sink& sink = m_sinks[i];
+
+        if ((NULL == sink.pCanvas) && (sink.targetWidth == targetWidth) && (sink.targetHeight == targetHeight))
+        {
+            sink.frameBuffers.append(pBuffer);
+            return;
+        }
+    }
+
+    Sink sink;
+
+    sink.targetWidth = targetWidth;
+    sink.targetHeight = targetHeight;
+    sink.pCanvas = NULL;
+    sink.canvasTile = -1;
+    sink.frameBuffers.append(pBuffer);
+    sink.pScaler = new VideoScaler();
+    sink.pFramePool = new FramePool();
+    m_sinks.append(sink);
+}
+
+void Stream::AddCanvasTile(Canvas* pCanvas, int tile, int targetWidth, int targetHeight)
+{
+    Sink sink;
+
+    sink.targetWidth = targetWidth;
+    sink.targetHeight = targetHeight;
+    sink.pCanvas = pCanvas;
+    sink.canvasTile = tile;
+    sink.pScaler = new VideoScaler();
+    sink.pFramePool = NULL;
+    m_sinks.append(sink);
 }
 
 int AvReadFrameCallback(void *opaque)
 {
-    int64_t lastReadMs = ((Stream*)opaque)->lastFrameReadMs;
-    if ((lastReadMs > 0) && (READ_TIMEOUT_MSEC < (QDateTime::currentMSecsSinceEpoch() - lastReadMs)))
+    // Stop request should break blocking av_read_frame() immediately
+    if (((Stream*)opaque)->StopRequested())
+    {
+        return 1;
+    }
+
+    if (((Stream*)opaque)->ReadTimedOut())
     {
         ERROR_MESSAGE1(ERR_TYPE_ERROR, "Stream", "%d sec timeout hit", READ_TIMEOUT_MSEC/1000);
         return 1;
@@ -55,7 +126,10 @@ bool Stream::Initialize()
     m_pInputContext = avformat_alloc_context();
     m_pInputContext->interrupt_callback.opaque = (void*)this;
     m_pInputContext->interrupt_callback.callback = &AvReadFrameCallback;
-    m_pInputContext->flags |= AVFMT_FLAG_NONBLOCK;
+    if (CAPTURE_MODE_TIMER == m_params.captureMode)
+    {
+        m_pInputContext->flags |= AVFMT_FLAG_NONBLOCK;
+    }
     lastFrameReadMs = QDateTime::currentMSecsSinceEpoch();
 
     res = avformat_open_input(&m_pInputContext, m_inputUrl.toLatin1().data(), NULL, NULL);
@@ -87,185 +161,548 @@ bool Stream::Initialize()
 
     pCodec = avcodec_find_decoder(m_pInputContext->streams[m_videoStreamIndex]->codecpar->codec_id);
 
-    // Create codec context
-    m_pCodecContext = avcodec_alloc_context3(pCodec);
-    if (NULL == m_pCodecContext)
+    // Required for flv format output (to avoid "avc1/0x31637661 incompatible with output codec id 28")
+    m_pInputContext->streams[m_videoStreamIndex]->codecpar->codec_tag = 0;
+
     {
-        ERROR_MESSAGE0(ERR_TYPE_ERROR, "Stream", "Unable to allocate decoder context");
-        return false;
-    }
+        // Decoder may be used by decode stage thread
+        QMutexLocker lock(&m_decoderMutex);
 
-    // Copy input codec parameters
-    avcodec_parameters_to_context(m_pCodecContext, m_pInputContext->streams[m_videoStreamIndex]->codecpar);
+        // Create codec context
+        m_pCodecContext = avcodec_alloc_context3(pCodec);
+        if (NULL == m_pCodecContext)
+        {
+            ERROR_MESSAGE0(ERR_TYPE_ERROR, "Stream", "Unable to allocate decoder context");
+            return false;
+        }
 
-    // This field need to be set for cathing errors while decoding
-    m_pCodecContext->err_recognition = AV_EF_EXPLODE;
+        // Copy input codec parameters
+        avcodec_parameters_to_context(m_pCodecContext, m_pInputContext->streams[m_videoStreamIndex]->codecpar);
 
-    res = avcodec_open2(m_pCodecContext, pCodec, NULL);
-    if (res < 0)
-    {
-        ERROR_MESSAGE0(ERR_TYPE_ERROR, "Stream", "Failed to open video decoder");
-        return false;
-    }
+        // This field need to be set for cathing errors while decoding
+        m_pCodecContext->err_recognition = AV_EF_EXPLODE;
 
-    // Required for flv format output (to avoid "avc1/0x31637661 incompatible with output codec id 28")
-    m_pInputContext->streams[m_videoStreamIndex]->codecpar->codec_tag = 0;
+        // Frames which compositor would never show are not decoded at all
+        m_decodePolicy = SelectDecodePolicy(m_pInputContext->streams[m_videoStreamIndex]);
+        switch (m_decodePolicy)
+        {
+            case DECODE_POLICY_NONREF:   m_pCodecContext->skip_frame = AVDISCARD_NONREF; break;
+            case DECODE_POLICY_KEYFRAME: m_pCodecContext->skip_frame = AVDISCARD_NONKEY; break;
+            default:                     m_pCodecContext->skip_frame = AVDISCARD_DEFAULT; break;
+        }
 
-    m_pFrame = av_frame_alloc();
-    if(m_pFrame == NULL)
-    {
-        ERROR_MESSAGE0(ERR_TYPE_ERROR, "Stream", "Failed to allocate AVFrame");
-        return false;
-    }
+        res = avcodec_open2(m_pCodecContext, pCodec, NULL);
+        if (res < 0)
+        {
+            ERROR_MESSAGE0(ERR_TYPE_ERROR, "Stream", "Failed to open video decoder");
+            avcodec_free_context(&m_pCodecContext);
+            return false;
+        }
 
-    // Frame capturing performed on capture timers' timeout event
-    // This made to prevent event loop blocking with while(1)
-    // This timer should be created here, because InitCapture function
-    // Is called after Stream object moved to it's separate thread
-    m_pCaptureTimer = new QTimer;
-    m_pCaptureTimer->setTimerType(Qt::PreciseTimer);
+        m_pFrame = av_frame_alloc();
+        if(m_pFrame == NULL)
+        {
+            ERROR_MESSAGE0(ERR_TYPE_ERROR, "Stream", "Failed to allocate AVFrame");
+            return false;
+        }
 
-    double fps = 60.0;//FFMIN(100.0, FFMAX(5.0, av_q2d(m_pInputContext->streams[m_videoStreamIndex]->avg_frame_rate)));
-    m_pCaptureTimer->setInterval(990.0 / fps); // Make interval a bit lower than real value
-    QObject::connect(m_pCaptureTimer, SIGNAL(timeout()), this, SLOT(CaptureNewFrame()));
+        m_timeBase = m_pInputContext->streams[m_videoStreamIndex]->time_base;
+        m_decodeErrorsInRow.store(0);
+    }
 
-    m_stop = false;
+    // Read timeout runs from connection time, so a camera that never sends a packet is reconnected too
     m_errorsInRow = 0;
-    lastFrameReadMs = 0;
+    lastFrameReadMs = QDateTime::currentMSecsSinceEpoch();
 
     return true;
 }
 
 void Stream::Deinitialize()
 {
+    {
+        QMutexLocker lock(&m_decoderMutex);
+
+        // Packets of the previous connection can not be decoded with new decoder
+        if (NULL != m_pPacketQueue)
+        {
+            m_packetsPending.fetchAndAddOrdered(-m_pPacketQueue->Flush());
+        }
+
+        if(NULL != m_pFrame)
+        {
+            av_frame_free(&m_pFrame);
+        }
+
+        if(NULL != m_pCodecContext)
+        {
+            avcodec_close(m_pCodecContext);
+            avcodec_free_context(&m_pCodecContext);
+        }
+    }
+
+    if(NULL != m_pInputContext)
+    {
+        avformat_close_input(&m_pInputContext);
+    }
+}
+
+void Stream::StartCapture()
+{
+    m_statsStartUs = MonotonicTimeUs();
+
+    if (CAPTURE_MODE_BLOCKING == m_params.captureMode)
+    {
+        ConnectBlocking();
+
+        // Each call blocks inside av_read_frame() until the next packet arrives.
+        // Stop and read timeout are handled by AvReadFrameCallback interrupting the read.
+        while (!StopRequested())
+        {
+            CaptureNewFrame();
+        }
+    }
+    else
+    {
+        // Frame capturing performed on capture timers' timeout event
+        // This made to prevent event loop blocking with while(1)
+        // This timer should be created here, because StartCapture function
+        // Is called after Stream object moved to its capture thread
+        m_pCaptureTimer = new QTimer;
+        m_pCaptureTimer->setTimerType(Qt::PreciseTimer);
+
+        double fps = 60.0;//FFMIN(100.0, FFMAX(5.0, av_q2d(m_pInputContext->streams[m_videoStreamIndex]->avg_frame_rate)));
+        m_pCaptureTimer->setInterval(990.0 / fps); // Make interval a bit lower than real value
+        QObject::connect(m_pCaptureTimer, SIGNAL(timeout()), this, SLOT(CaptureNewFrame()));
+
+        Connect();
+    }
+}
+
+void Stream::StopCapture()
+{
+    RequestStop();
     if (NULL != m_pCaptureTimer)
     {
         m_pCaptureTimer->stop();
         delete m_pCaptureTimer;
         m_pCaptureTimer = NULL;
     }
+}
+
+void Stream::ConnectBlocking()
+{
+    while (!Initialize() && !StopRequested())
+    {
+        ERROR_MESSAGE1(ERR_TYPE_MESSAGE, "Stream", "Stream %s reinitializing...", m_name.toUtf8().constData());
+
+        // Dead camera is not hammered, stop request is still served within a tenth of a second
+        for (int waitedMs = 0; (waitedMs < CONNECT_RETRY_MSEC) && !StopRequested(); waitedMs += 100)
+        {
+            QThread::msleep(100);
+        }
+    }
+}
+
+void Stream::ConnectTask::run()
+{
+    bool ok = m_pStream->Initialize();
+
+    QMetaObject::invokeMethod(m_pStream, "Connected", Qt::QueuedConnection, Q_ARG(bool, ok));
+}
 
-    if(NULL != m_pFrame)
+void Stream::Connect()
+{
+    if (StopRequested())
     {
-        av_frame_free(&m_pFrame);
+        return;
     }
 
-    if(NULL != m_pCodecContext)
+    // Opening may block up to READ_TIMEOUT_MSEC, capture timer is stopped meanwhile, so input is not touched here
+    m_pConnectPool->start(new ConnectTask(this));
+}
+
+void Stream::Connected(bool ok)
+{
+    if (StopRequested() || (NULL == m_pCaptureTimer))
     {
-        avcodec_close(m_pCodecContext);
-        avcodec_free_context(&m_pCodecContext);
+        return;
     }
 
-    if(NULL != m_pInputContext)
+    if (!ok)
     {
-        avformat_close_input(&m_pInputContext);
+        ERROR_MESSAGE1(ERR_TYPE_MESSAGE, "Stream", "Stream %s reinitializing...", m_name.toUtf8().constData());
+        QTimer::singleShot(CONNECT_RETRY_MSEC, this, SLOT(Connect()));
+        return;
     }
+
+    if (m_reconnecting)
+    {
+        m_reconnecting = false;
+        emit Reinit();
+    }
+    m_pCaptureTimer->start();
 }
 
 void Stream::CaptureNewFrame()
 {
-    int             readRes = -1;
-    int             sendRes = -1;
-    int             decodeRes = -1;
+    int64_t cpuStartUs = ThreadCpuTimeUs();
 
+    ReadPacket();
+
+    m_captureCpuUs += ThreadCpuTimeUs() - cpuStartUs;
+    ReportStatistics();
+}
+
+void Stream::ReadPacket()
+{
+    int             readRes = -1;
     AVPacket        packet;
 
-    while (!m_stop && (readRes = av_read_frame(m_pInputContext, &packet)) >= 0) // while we have available frames in stream
+    while (!StopRequested() && (readRes = av_read_frame(m_pInputContext, &packet)) >= 0) // while we have available frames in stream
     {
         if (packet.stream_index == m_videoStreamIndex)  // We need only video frames to be decoded
         {
-            // Decode frame
-            sendRes = avcodec_send_packet(m_pCodecContext, &packet);
-            decodeRes = avcodec_receive_frame(m_pCodecContext, m_pFrame);
-
-            if (sendRes || decodeRes)
-            {
-                char err1[255] = {0};
-                char err2[255] = {0};
-                av_make_error_string(err1, 255, sendRes);
-                av_make_error_string(err2, 255, decodeRes);
-                ERROR_MESSAGE2(ERR_TYPE_MESSAGE, "RTSPCapture",
-                               "Error decoding video frame avcodec_send_packet(): %s\tavcodec_receive_frame(): %s",
-                               err1, err2);
-            }
-            // Exit reading while
-            av_packet_unref(&packet);
+            int64_t readDoneUs = MonotonicTimeUs();
 
             // Set last successful read time
             lastFrameReadMs = QDateTime::currentMSecsSinceEpoch();
 
+            if (NULL != m_pPacketQueue)
+            {
+                // Hand packet over to decode stage
+                AVPacket* pPacket = av_packet_alloc();
+                av_packet_move_ref(pPacket, &packet);
+
+                // Schedule decode task if it is not scheduled or running already.
+                // Stopped pool rejects it, queued packets are then freed by Deinitialize()
+                if (m_pPacketQueue->Push(pPacket, readDoneUs) && (0 == m_packetsPending.fetchAndAddOrdered(1)))
+                {
+                    m_pDecoderPool->Submit(this, m_decoderAffinity);
+                }
+            }
+            else
+            {
+                QMutexLocker lock(&m_decoderMutex);
+                DecodePacket(&packet, readDoneUs);
+                av_packet_unref(&packet);
+            }
+            // Exit reading while
             break;
         }
         av_packet_unref(&packet);
     }
 
-    // Add all decoded frames to frame buffer
-    if ((readRes == 0) && (decodeRes == 0))
+    // Non-blocking reads never reach the interrupt callback, so silence is checked here as well
+    bool timedOut = (readRes < 0) && !StopRequested() && ReadTimedOut();
+
+    // Nothing to read yet in non-blocking mode - this is not an error
+    if ((readRes == AVERROR(EAGAIN)) && !timedOut)
+    {
+        m_emptyPolls++;
+        return;
+    }
+
+    if (readRes == 0)
     {
         m_errorsInRow = 0;
+    }
+    else if (StopRequested())
+    {
+        // Read was interrupted by stop request
+        return;
+    }
+    else
+    {
+        char err[255];
+        av_make_error_string(err, 255, readRes);
+        ERROR_MESSAGE2(ERR_TYPE_ERROR, "Stream", "Stream %s   read: %s", m_name.toUtf8().constData(), err);
+        m_errorsInRow++;
+    }
 
-        if (m_pFrame->format != AV_PIX_FMT_YUV420P && m_pFrame->format != AV_PIX_FMT_YUVJ420P)
+    if (((m_errorsInRow > 300) || (m_decodeErrorsInRow.load() > 300) || timedOut) && !StopRequested())
+    {
+        if (timedOut)
         {
-            ERROR_MESSAGE1(ERR_TYPE_DISPOSABLE, "Stream", "Stream %s unsupported frame format", m_name.toUtf8().constData());
-            return;
+            ERROR_MESSAGE2(ERR_TYPE_CRITICAL, "Stream", "Stream %s no packets for %d sec", m_name.toUtf8().constData(), READ_TIMEOUT_MSEC / 1000);
+        }
+        else
+        {
+            ERROR_MESSAGE1(ERR_TYPE_CRITICAL, "Stream", "Stream %s 300 errors in a row", m_name.toUtf8().constData());
         }
 
-        AVRational inTimeBase = m_pInputContext->streams[m_videoStreamIndex]->time_base;
+        if (CAPTURE_MODE_BLOCKING == m_params.captureMode)
+        {
+            // Try to reonnect to the stream
+            ConnectBlocking();
+            emit Reinit();
+        }
+        else
+        {
+            // Reconnect on connect pool, other streams of this capture thread are not held up
+            m_pCaptureTimer->stop();
+            m_reconnecting = true;
+            Connect();
+        }
+    }
+}
 
-        m_pFrame->pkt_dts = av_rescale_q(m_pFrame->pkt_dts, inTimeBase, AV_TIME_BASE_Q);
-        m_pFrame->best_effort_timestamp = av_rescale_q(m_pFrame->best_effort_timestamp, inTimeBase, AV_TIME_BASE_Q);
+void Stream::RunDecodeTask()
+{
+    AVPacket*   pPacket;
+    int64_t     readUs;
+    int         processed = 0;
 
-        emit FrameReady(ScaleFrame(m_pFrame));
+    // Limited batch keeps decode workers fair between streams
+    while (!StopRequested() && (processed < DECODE_TASK_BATCH))
+    {
+        QMutexLocker lock(&m_decoderMutex);
+
+        if (!m_pPacketQueue->Pop(&pPacket, &readUs))
+        {
+            break;
+        }
+        if (NULL != m_pCodecContext)
+        {
+            DecodePacket(pPacket, readUs);
+        }
+        av_packet_free(&pPacket);
+        processed++;
+    }
+
+    // Packets pushed meanwhile keep the counter above zero - continue with them later
+    if ((processed > 0) && (m_packetsPending.fetchAndAddOrdered(-processed) > processed) && !StopRequested())
+    {
+        m_pDecoderPool->Submit(this, m_decoderAffinity);
+    }
+}
+
+DecodePolicy Stream::SelectDecodePolicy(AVStream* pStream)
+{
+    DecodePolicy    policy = m_params.decodePolicy;
+    AVRational      frameRate = (pStream->avg_frame_rate.num > 0) ? pStream->avg_frame_rate : pStream->r_frame_rate;
+    double          inputFps = (frameRate.den > 0) ? av_q2d(frameRate) : 0.0;
+
+    // Largest tile showing this camera decides what has to be decoded
+    int             maxTileArea = 0;
+
+    for (int i = 0; i < m_sinks.size(); i++)
+    {
+        maxTileArea = FFMAX(maxTileArea, m_sinks[i].targetWidth * m_sinks[i].targetHeight);
+    }
+
+    if (DECODE_POLICY_AUTO == policy)
+    {
+        if (maxTileArea <= KEYFRAME_ONLY_MAX_TILE_AREA)
+        {
+            policy = DECODE_POLICY_KEYFRAME;
+        }
+        else if ((m_params.outputFps > 0) && (inputFps > m_params.outputFps * DECIMATION_FPS_RATIO))
+        {
+            policy = DECODE_POLICY_NONREF;
+        }
+        else
+        {
+            policy = DECODE_POLICY_FULL;
+        }
+    }
+
+    ERROR_MESSAGE5(ERR_TYPE_MESSAGE, "Stream", "Stream %s decode policy %s (input %.2f fps, output %d fps, tile %d px)",
+                   m_name.toUtf8().constData(),
+                   DecodePolicyNames[policy],
+                   inputFps,
+                   m_params.outputFps,
+                   maxTileArea);
+
+    return policy;
+}
+
+void Stream::DecodePacket(AVPacket* pPacket, int64_t readUs)
+{
+    int     sendRes;
+    int     decodeRes = 0;
+    int64_t cpuStartUs = ThreadCpuTimeUs();
+
+    sendRes = avcodec_send_packet(m_pCodecContext, pPacket);
+
+    // One packet may produce zero or more frames
+    while (!sendRes && !(decodeRes = avcodec_receive_frame(m_pCodecContext, m_pFrame)))
+    {
+        m_pFrame->pkt_dts = av_rescale_q(m_pFrame->pkt_dts, m_timeBase, AV_TIME_BASE_Q);
+        m_pFrame->best_effort_timestamp = av_rescale_q(m_pFrame->best_effort_timestamp, m_timeBase, AV_TIME_BASE_Q);
+
+        bool delivered = false;
+
+        // Frame is decoded once for all mosaics showing this camera
+        for (int i = 0; i < m_sinks.size(); i++)
+        {
+            delivered = DeliverFrame(m_sinks[i], m_pFrame) || delivered;
+        }
+
+        if (delivered)
+        {
+            QMutexLocker lock(&m_statsMutex);
+            m_latencyStat.Add(MonotonicTimeUs() - readUs);
+            m_framesEmitted++;
+        }
 
         // Free decoded frame data
         av_frame_unref(m_pFrame);
     }
-    else
+
+    if (sendRes || (decodeRes != AVERROR(EAGAIN)))
     {
-        char err1[255];
-        char err2[255];
-        av_make_error_string(err1, 255, readRes);
+        char err1[255] = {0};
+        char err2[255] = {0};
+        av_make_error_string(err1, 255, sendRes);
         av_make_error_string(err2, 255, decodeRes);
-        ERROR_MESSAGE3(ERR_TYPE_ERROR, "Stream", "Stream %s   read: %s    decode: %s", m_name.toUtf8().constData(), err1, err2);
+        ERROR_MESSAGE3(ERR_TYPE_MESSAGE, "Stream",
+                       "Stream %s error decoding video frame avcodec_send_packet(): %s\tavcodec_receive_frame(): %s",
+                       m_name.toUtf8().constData(), err1, err2);
+        m_decodeErrorsInRow.fetchAndAddRelaxed(1);
+    }
+    else
+    {
+        m_decodeErrorsInRow.store(0);
+    }
+
+    QMutexLocker lock(&m_statsMutex);
+    m_decodeCpuUs += ThreadCpuTimeUs() - cpuStartUs;
+    m_packetsDecoded++;
+}
+
+void Stream::ReportStatistics()
+{
+    int64_t nowUs = MonotonicTimeUs();
+    int64_t elapsedUs = nowUs - m_statsStartUs;
+
+    if (elapsedUs < STATS_INTERVAL_MSEC * 1000)
+    {
+        return;
+    }
+
+    {
+        QMutexLocker lock(&m_statsMutex);
+
+        ERROR_MESSAGE6(ERR_TYPE_MESSAGE, "Stream",
+                       "Stream %s stats: %lld frames, capture cpu %.2f%%, decode cpu %.2f%%, read->delivery latency avg %.2f ms max %.2f ms",
+                       m_name.toUtf8().constData(),
+                       (long long)m_framesEmitted,
+                       100.0 * (double)m_captureCpuUs / (double)elapsedUs,
+                       100.0 * (double)m_decodeCpuUs / (double)elapsedUs,
+                       m_latencyStat.Average() / 1000.0,
+                       m_latencyStat.Max() / 1000.0);
+
+        // Skipped packets cost almost nothing, so each of them saves about one decoded frame
+        int64_t framesSkipped = FFMAX(0, m_packetsDecoded - m_framesEmitted);
+        double  cpuPerFrameUs = m_framesEmitted ? (double)m_decodeCpuUs / (double)m_framesEmitted : 0.0;
+
+        ERROR_MESSAGE5(ERR_TYPE_MESSAGE, "Stream",
+                       "Stream %s decode policy %s: %lld packets, %lld frames skipped, est. decode cpu saved %.2f%%",
+                       m_name.toUtf8().constData(),
+                       DecodePolicyNames[m_decodePolicy],
+                       (long long)m_packetsDecoded,
+                       (long long)framesSkipped,
+                       100.0 * framesSkipped * cpuPerFrameUs / (double)elapsedUs);
+
+        m_framesEmitted = 0;
+        m_packetsDecoded = 0;
+        m_decodeCpuUs = 0;
+        m_latencyStat.Reset();
+    }
+
+    if (NULL != m_pPacketQueue)
+    {
+        ERROR_MESSAGE6(ERR_TYPE_MESSAGE, "Stream",
+                       "Stream %s queue: depth %d/%d, max %d, %lld packets dropped, %lld empty polls",
+                       m_name.toUtf8().constData(),
+                       m_pPacketQueue->Depth(),
+                       m_pPacketQueue->Capacity(),
+                       m_pPacketQueue->maxDepth,
+                       (long long)m_pPacketQueue->droppedPackets,
+                       (long long)m_emptyPolls);
+        m_pPacketQueue->ResetCounters();
+    }
+    else if (CAPTURE_MODE_TIMER == m_params.captureMode)
+    {
+        ERROR_MESSAGE2(ERR_TYPE_MESSAGE, "Stream", "Stream %s: %lld empty polls", m_name.toUtf8().constData(), (long long)m_emptyPolls);
+    }
 
-        if (++m_errorsInRow > 300 && !m_stop)
+    int     poolHits = 0;
+    int     poolMisses = 0;
+    int64_t pooledBytes = 0;
+
+    for (int i = 0; i < m_sinks.size(); i++)
+    {
+        if (NULL != m_sinks[i].pFramePool)
         {
-            ERROR_MESSAGE1(ERR_TYPE_CRITICAL, "Stream", "Stream %s 300 errors in a row", m_name.toUtf8().constData());
-            // Try to reonnect to the stream
-            while (!Initialize()) {
-                ERROR_MESSAGE1(ERR_TYPE_MESSAGE, "Stream", "Stream %s reinitializing...", m_name.toUtf8().constData());
-            };
-            emit Reinit();
-            m_pCaptureTimer->start();
+            poolHits += m_sinks[i].pFramePool->hits.fetchAndStoreRelaxed(0);
+            poolMisses += m_sinks[i].pFramePool->misses.fetchAndStoreRelaxed(0);
+            pooledBytes += m_sinks[i].pFramePool->PooledBytes();
         }
     }
+
+    ERROR_MESSAGE6(ERR_TYPE_MESSAGE, "Stream", "Stream %s frame pool: %d sinks, %d hits, %d misses, %lld KB pooled, process RSS %lld KB",
+                   m_name.toUtf8().constData(),
+                   m_sinks.size(),
+                   poolHits,
+                   poolMisses,
+                   (long long)(pooledBytes / 1024),
+                   (long long)ResidentSetSizeKb());
+
+    m_statsStartUs = nowUs;
+    m_captureCpuUs = 0;
+    m_emptyPolls = 0;
 }
 
-QSharedPointer<AVFrame> Stream::ScaleFrame(AVFrame *pInFrame)
+bool Stream::DeliverFrame(Sink& sink, AVFrame* pInFrame)
+{
+    if (NULL != sink.pCanvas)
+    {
+        // Zero-copy compose: scale straight into the output canvas
+        return sink.pCanvas->WriteTile(sink.canvasTile, pInFrame, sink.pScaler);
+    }
+
+    QSharedPointer<AVFrame> pScaledFrame = ScaleFrame(sink, pInFrame);
+
+    if (pScaledFrame.isNull())
+    {
+        return false;
+    }
+
+    // Frame is read only from here on, so all buffers share it
+    for (int i = 0; i < sink.frameBuffers.size(); i++)
+    {
+        sink.frameBuffers[i]->AddFrame(pScaledFrame);
+    }
+    return true;
+}
+
+QSharedPointer<AVFrame> Stream::ScaleFrame(Sink& sink, AVFrame *pInFrame)
 {
     int targetWidth;
     int targetHeight;
-    double scale = std::min((double)m_targetWidth / (double)pInFrame->width,
-                            (double)m_targetHeight/ (double)pInFrame->height);
 
-    targetWidth = (int)(pInFrame->width * scale + 0.5f)  & 0xFFFFFFFC; // width and height are better when even
-    targetHeight = (int)(pInFrame->height * scale + 0.5f) & 0xFFFFFFFC;
+    VideoScaler::fitSize(pInFrame->width, pInFrame->height, sink.targetWidth, sink.targetHeight, &targetWidth, &targetHeight);
 
-    QSharedPointer<AVFrame> pOutFrame(av_frame_alloc(), [] (AVFrame *ptr) {av_frame_free(&ptr);});
+    // Frame buffer goes back to the pool when the last shared pointer is dropped
+    AVFrame* pPooledFrame = sink.pFramePool->GetFrame(targetWidth, targetHeight);
+    if (NULL == pPooledFrame)
+    {
+        ERROR_MESSAGE1(ERR_TYPE_ERROR, "Stream", "Stream %s Failed to alocate frame buffer", m_name.toUtf8().constData());
+        return QSharedPointer<AVFrame>(NULL);
+    }
+
+    QSharedPointer<AVFrame> pOutFrame(pPooledFrame, [] (AVFrame *ptr) {av_frame_free(&ptr);});
 
     av_frame_copy_props(pOutFrame.data(), pInFrame);
 
-    pOutFrame->format = AV_PIX_FMT_YUV420P;
-    pOutFrame->width  = targetWidth;
-    pOutFrame->height = targetHeight;
+    // Mosaic is encoded as limited range, full range sources are converted by scaler
+    pOutFrame->color_range = AVCOL_RANGE_MPEG;
 
-    if (0 > av_frame_get_buffer(pOutFrame.data(), 0))  // allocates aligned buffer for y,u,v planes
+    if (!sink.pScaler->scaleFrame(pInFrame, pOutFrame.data()))
     {
-        ERROR_MESSAGE1(ERR_TYPE_ERROR, "Stream", "Stream %s Failed to alocate frame buffer", m_name.toUtf8().constData());
         return QSharedPointer<AVFrame>(NULL);
     }
 
-    m_scaler.scaleFrame(pInFrame, pOutFrame.data());
-
     return pOutFrame;
 }
@@ -2,53 +2,167 @@
 #define STREAM_H
 
 #include "common.h"
+#include "statistics.h"
+#include "framePool.h"
+#include "canvas.h"
+#include "frameBuffer.h"
+#include "packetQueue.h"
+#include "decoderPool.h"
 #include "videoScaler.h"
 
 #include <QTimer>
+#include <QDateTime>
 #include <QThread>
+#include <QRunnable>
+#include <QThreadPool>
 #include <QObject>
+#include <QMutex>
+#include <QAtomicInt>
 
 #define READ_TIMEOUT_MSEC 20000
+#define CONNECT_RETRY_MSEC 1000     // Delay between failed connection attempts
+#define DECODE_TASK_BATCH 8         // Max packets decoded by one decoder pool task
 
-class Stream : public QObject
+enum CaptureMode
+{
+    CAPTURE_MODE_TIMER,     // Non-blocking reads polled by the capture timer, many streams share one capture thread
+    CAPTURE_MODE_BLOCKING   // Blocking reads in a loop, the stream occupies its capture thread
+};
+
+#define DECIMATION_FPS_RATIO        1.5         // Drop non-reference frames if input fps exceeds output fps this much
+#define KEYFRAME_ONLY_MAX_TILE_AREA (160*120)   // Tiles this small are refreshed from keyframes only
+
+enum DecodePolicy
+{
+    DECODE_POLICY_AUTO,     // Choose one of policies below from tile size and fps
+    DECODE_POLICY_FULL,     // Decode every frame
+    DECODE_POLICY_NONREF,   // Skip non-reference frames (AVDISCARD_NONREF)
+    DECODE_POLICY_KEYFRAME  // Decode keyframes only (AVDISCARD_NONKEY)
+};
+
+struct StreamParameters
+{
+    StreamParameters()
+    {
+        captureMode = CAPTURE_MODE_TIMER;
+        packetQueueDepth = 0;
+        decodePolicy = DECODE_POLICY_AUTO;
+        outputFps = 0;
+    }
+
+    CaptureMode     captureMode;
+    int             packetQueueDepth;   /// Packets between demux and decode stages. 0 - decode on capture thread
+    DecodePolicy    decodePolicy;
+    int             outputFps;          /// Rate at which compositor samples decoded frames
+};
+
+class Stream : public QObject, public DecodeTask
 {
     Q_OBJECT
 public:
-    Stream(QString name, QString inputUrl, int targetWidth, int targetHeight);
+    // Decode stage runs on pDecoderPool when it is set and packetQueueDepth > 0
+    // Timer mode opens the input on pConnectPool, so cameras sharing the capture thread keep capturing meanwhile
+    Stream(QString name, QString inputUrl, StreamParameters params, DecoderPool* pDecoderPool, QThreadPool* pConnectPool);
     ~Stream();
 
     bool    Initialize();
 
     int64_t lastFrameReadMs;
 
+    void    RequestStop() { m_stop.storeRelease(1); }    /// Thread-safe, interrupts blocking reads
+    bool    StopRequested() const { return 0 != m_stop.loadAcquire(); }
+    bool    ReadTimedOut() const { return READ_TIMEOUT_MSEC < QDateTime::currentMSecsSinceEpoch() - lastFrameReadMs; }   /// No packet since READ_TIMEOUT_MSEC, counted from connection
+
+    void    RunDecodeTask();    /// Decode stage. Called by decoder pool workers
+
+    // Consumers of decoded frames, one per mosaic tile showing this camera. Call before capture start
+    void    AddFrameBuffer(FrameBuffer* pBuffer, int targetWidth, int targetHeight);   /// Buffers of the same size share one scaled frame
+    void    AddCanvasTile(Canvas* pCanvas, int tile, int targetWidth, int targetHeight); /// Zero-copy compose: frames are scaled straight into the tile
+
 signals:
-    void    FrameReady(QSharedPointer<AVFrame> pNewFrame);
     void    Reinit();
 
 public slots:
     void    Deinitialize();
     void    CaptureNewFrame();
-    void    StartCapture() { while (!Initialize() && !m_stop); m_pCaptureTimer->start(); }
-    void    StopCapture() { m_stop = true; m_pCaptureTimer->stop(); }
+    void    StartCapture();
+    void    StopCapture();
+
+private slots:
+    void    Connect();              /// Timer mode. Opens input on connect pool
+    void    Connected(bool ok);     /// Timer mode. Starts capture timer or schedules next attempt
 
 private:
+    class ConnectTask : public QRunnable
+    {
+    public:
+        ConnectTask(Stream* pStream) : m_pStream(pStream) {}
+
+    protected:
+        void run();
+
+    private:
+        Stream*     m_pStream;
+    };
+
     QString     m_name;             /// Stream name
     QString     m_inputUrl;         /// Input stream url
+    StreamParameters m_params;
     QTimer*     m_pCaptureTimer;    /// Main loop timer. It will call CaptureNewFrame()
                                     /// as often as possible and keep all events alive.
                                     /// Must be created within the same thread Capture instance is running in
-    VideoScaler m_scaler;
-    int         m_targetWidth;      /// Width of output (scaled) frames
-    int         m_targetHeight;     /// Height of output (scaled) frames
+                                    /// Not used in CAPTURE_MODE_BLOCKING
+    QThreadPool* m_pConnectPool;    /// Runs blocking Initialize() in timer mode
+    bool        m_reconnecting;     /// Connection is being reopened after errors, consumers get Reinit() once it is up
+
+    // Each decoded frame is scaled once per sink
+    struct Sink
+    {
+        int                     targetWidth;    /// Size of output (scaled) frames
+        int                     targetHeight;
+        Canvas*                 pCanvas;        /// Output canvas in zero-copy compose mode, otherwise NULL
+        int                     canvasTile;
+        QVector<FrameBuffer*>   frameBuffers;   /// Copy mode: buffers receiving the scaled frame
+        VideoScaler*            pScaler;
+        FramePool*              pFramePool;     /// Scaled frames buffers, copy mode only
+    };
+
+    QVector<Sink>   m_sinks;
 
     AVFormatContext*    m_pInputContext;
-    AVCodecContext*     m_pCodecContext;
-    AVFrame*            m_pFrame;           /// Decoded frame locates here
+    AVCodecContext*     m_pCodecContext;    /// Guarded by m_decoderMutex
+    AVFrame*            m_pFrame;           /// Decoded frame locates here. Guarded by m_decoderMutex
+    AVRational          m_timeBase;         /// Input video stream time base. Guarded by m_decoderMutex
+    DecodePolicy        m_decodePolicy;     /// Policy in effect for current connection (never AUTO)
     int                 m_videoStreamIndex;
-    int                 m_errorsInRow;      /// Number of read or decode errors in a row
-    bool                m_stop;             /// Flag to exit from while loop
+    int                 m_errorsInRow;      /// Number of read errors in a row
+    QAtomicInt          m_decodeErrorsInRow;/// Number of decode errors in a row
+    QAtomicInt          m_stop;             /// Flag to exit from while loop (set from other threads)
+
+    // Decode stage
+    QMutex              m_decoderMutex;     /// Serializes decoding with decoder (re)initialization
+    DecoderPool*        m_pDecoderPool;
+    int                 m_decoderAffinity;  /// Home worker in decoder pool
+    PacketQueue*        m_pPacketQueue;     /// Demux -> decode queue. NULL if decoding on capture thread
+    QAtomicInt          m_packetsPending;   /// Queued packets not yet processed by decode tasks
+
+    // Statistics
+    int64_t             m_statsStartUs;     /// Start of current statistics interval
+    int64_t             m_captureCpuUs;     /// Cpu time spent in CaptureNewFrame(), capture thread may be shared with other streams
+    int64_t             m_emptyPolls;       /// Timer wakeups without any packet available
+    QMutex              m_statsMutex;       /// Guards decode stage counters below
+    int64_t             m_framesEmitted;
+    int64_t             m_packetsDecoded;   /// Packets sent to decoder
+    int64_t             m_decodeCpuUs;      /// Cpu time spent in decode and scale
+    RunningStat         m_latencyStat;      /// Packet read -> frame delivered to sinks latency, us
 
-    QSharedPointer<AVFrame> ScaleFrame(AVFrame* pInFrame);
+    void                ConnectBlocking();  /// Blocking mode. Retries every CONNECT_RETRY_MSEC until connected or stopped
+    void                ReadPacket();
+    void                DecodePacket(AVPacket* pPacket, int64_t readUs);
+    DecodePolicy        SelectDecodePolicy(AVStream* pStream);
+    bool                DeliverFrame(Sink& sink, AVFrame* pInFrame);
+    QSharedPointer<AVFrame> ScaleFrame(Sink& sink, AVFrame* pInFrame);
+    void                ReportStatistics();
 };
 
 #endif // STREAM_H
@@ -1,22 +1,57 @@
 #include "videoEncoder.h"
 
 
-VideoEncoder::VideoEncoder(int width, int height, int fps, int crf) :
+VideoEncoder::VideoEncoder(const EncoderParameters& parameters) :
     QObject(NULL),
-    m_crf(crf),
-    m_framerate(fps),
-    m_frameWidth(width),
-    m_frameHeight(height),
+    m_params(parameters),
+    m_lastPts(AV_NOPTS_VALUE),
+    m_preset(0),
+    m_gopFrames(0),
+    m_pGovernor(NULL),
+    m_pRegionsIgnoredBy(NULL),
     m_isOpen(false),
+    m_flushed(false),
     m_pCodecContext(NULL),
-    m_pCodecParams(NULL)
+    m_pCodecParams(NULL),
+    m_pThread(NULL),
+    m_stop(false),
+    m_statsStartUs(MonotonicTimeUs()),
+    m_packets(0),
+    m_bytes(0),
+    m_deltaPackets(0),
+    m_deltaBytes(0),
+    m_keyPackets(0),
+    m_framesSkipped(0),
+    m_framesDropped(0),
+    m_framesRepeated(0)
 {
+    m_preset = m_params.preset;
+    if (m_params.adaptivePreset)
+    {
+        m_pGovernor = new PresetGovernor(m_params.fps, m_params.preset, m_params.slowestPreset);
+        m_preset = m_pGovernor->Preset();
+    }
 
+    m_params.queueDepth = FFMAX(0, m_params.queueDepth);
+    if (m_params.queueDepth > 0)
+    {
+        m_pThread = new EncoderThread(this);
+    }
 }
 
 VideoEncoder::~VideoEncoder()
 {
     ERROR_MESSAGE0(ERR_TYPE_MESSAGE, "VideoEncoder", "~VideoEncoder() called");
+    Stop();
+    delete m_pThread;
+    CloseCodecContext();
+    delete m_pGovernor;
+    DEBUG_MESSAGE0("VideoEncoder", "~VideoEncoder() finished");
+}
+
+void VideoEncoder::CloseCodecContext()
+{
+    m_isOpen = false;
     if(NULL != m_pCodecContext)
     {
         avcodec_close(m_pCodecContext);
@@ -27,106 +62,567 @@ VideoEncoder::~VideoEncoder()
     {
         avcodec_parameters_free(&m_pCodecParams);
     }
-    DEBUG_MESSAGE0("VideoEncoder", "~VideoEncoder() finished");
 }
 
 void VideoEncoder::Initialize()
 {
-    AVCodec* pCodec;
-
     m_isOpen = false;
     DEBUG_MESSAGE0("VideoEncoderH264", "Open() called");
 
-    // Find encoder
-    pCodec = avcodec_find_encoder(AV_CODEC_ID_H264);
-    if (NULL == pCodec)
+    if (!OpenCodec())
     {
-        ERROR_MESSAGE0(ERR_TYPE_ERROR, "VideoEncoderH264", "H264 encoder not found");
         return;
     }
 
+    m_lastPts = AV_NOPTS_VALUE;
+    m_flushed = false;
+    m_sendTimeUs.clear();
+
+    // Get current codec parameters and send them to subscribers
+    m_pCodecParams = avcodec_parameters_alloc();
+    avcodec_parameters_from_context(m_pCodecParams, m_pCodecContext);
+
+    emit NewParameters(m_pCodecParams);
+
+    m_isOpen = true;
+    DEBUG_MESSAGE0("VideoEncoderH264", "Video encoder opened successfully");
+
+}
+
+const AVCodec* VideoEncoder::FindEncoder()
+{
+    const char*     names[2] = {NULL, NULL};
+    const AVCodec*  pCodec = NULL;
+
+    // Preferred implementation first, codecs missing from this ffmpeg build fall back to H.264
+    switch (m_params.codec)
+    {
+    case ENCODER_CODEC_HEVC:
+        names[0] = "libx265";
+        break;
+    case ENCODER_CODEC_AV1:
+        names[0] = "libsvtav1";
+        names[1] = "libaom-av1";
+        break;
+    default:
+        names[0] = "libx264";
+        break;
+    }
+
+    for (int i = 0; (NULL == pCodec) && (i < 2) && (NULL != names[i]); i++)
+    {
+        pCodec = avcodec_find_encoder_by_name(names[i]);
+    }
+
+    if ((NULL == pCodec) && (ENCODER_CODEC_H264 != m_params.codec))
+    {
+        ERROR_MESSAGE1(ERR_TYPE_WARNING, "VideoEncoder", "%s encoder is not available, falling back to H.264", names[0]);
+        m_params.codec = ENCODER_CODEC_H264;
+        pCodec = avcodec_find_encoder_by_name("libx264");
+    }
+
+    if (NULL == pCodec)
+    {
+        pCodec = avcodec_find_encoder(AV_CODEC_ID_H264);
+    }
+    return pCodec;
+}
+
+void VideoEncoder::SetCodecOptions(const AVCodec* pCodec, AVDictionary** ppOptions)
+{
+    // Quantiser range of AV1 is 0..63 instead of 0..51, so equal crf means roughly equal quality
+    int av1Quantiser = av_clip(m_params.crf * 63 / 51, 0, 63);
+    // AV1 speed presets count down from fastest 8, the ladder counts up from ultrafast 0
+    int av1Speed = av_clip(8 - m_preset, 0, 8);
+
+    if (!strcmp(pCodec->name, "libx265"))
+    {
+        av_dict_set(ppOptions, "preset", PresetGovernor::PresetName(m_preset), 0);
+        av_dict_set(ppOptions, "tune", "zerolatency", 0);
+        av_dict_set_int(ppOptions, "crf", m_params.crf, 0);
+
+        // Parameter sets go with every keyframe, outputs pick them up without global header
+        QByteArray params("repeat-headers=1");
+        if (m_params.lookahead >= 0)
+        {
+            params += ":rc-lookahead=" + QByteArray::number(m_params.lookahead);
+        }
+        av_dict_set(ppOptions, "x265-params", params.constData(), 0);
+    }
+    else if (!strcmp(pCodec->name, "libsvtav1"))
+    {
+        av_dict_set_int(ppOptions, "preset", av1Speed, 0);
+        av_dict_set_int(ppOptions, "rc", 0, 0);     // Constant quantiser
+        av_dict_set_int(ppOptions, "qp", av1Quantiser, 0);
+        av_dict_set_int(ppOptions, "la_depth", FFMAX(0, m_params.lookahead), 0);
+    }
+    else if (!strcmp(pCodec->name, "libaom-av1"))
+    {
+        av_dict_set_int(ppOptions, "cpu-used", av1Speed, 0);
+        av_dict_set_int(ppOptions, "crf", av1Quantiser, 0);
+        av_dict_set_int(ppOptions, "lag-in-frames", FFMAX(0, m_params.lookahead), 0);
+        av_dict_set_int(ppOptions, "row-mt", 1, 0);
+    }
+    else
+    {
+        av_dict_set(ppOptions, "preset", PresetGovernor::PresetName(m_preset), 0);
+        av_dict_set(ppOptions, "tune", "zerolatency", 0);
+        av_dict_set_int(ppOptions, "crf", m_params.crf, 0);
+
+        // Set after tune, so they override what zerolatency picked
+        av_dict_set(ppOptions, "x264-params", m_params.slicedThreads ? "sliced-threads=1" : "sliced-threads=0", 0);
+        if (m_params.lookahead >= 0)
+        {
+            av_dict_set_int(ppOptions, "rc-lookahead", m_params.lookahead, 0);
+        }
+
+        // Only the first frame is IDR, then a refresh column sweeps the picture once per GOP and x264 marks
+        // the frame starting each sweep with recovery point SEI. Those frames come out flagged as key
+        // and carry SPS/PPS, so outputs keep starting and fragmenting on them
+        if (m_params.intraRefresh)
+        {
+            av_dict_set_int(ppOptions, "intra-refresh", 1, 0);
+        }
+    }
+}
+
+bool VideoEncoder::OpenCodec()
+{
+    const AVCodec* pCodec = FindEncoder();
+
+    if (NULL == pCodec)
+    {
+        ERROR_MESSAGE0(ERR_TYPE_ERROR, "VideoEncoder", "No video encoder found");
+        return false;
+    }
+
     // Allocate codec context
     m_pCodecContext = avcodec_alloc_context3(pCodec);
     if (NULL == m_pCodecContext)
     {
-        ERROR_MESSAGE0(ERR_TYPE_ERROR, "VideoEncoderH264", "Failed to allocate codec context");
-        return;
+        ERROR_MESSAGE0(ERR_TYPE_ERROR, "VideoEncoder", "Failed to allocate codec context");
+        return false;
     }
 
-    m_pCodecContext->time_base = av_make_q(1, m_framerate);
-    m_pCodecContext->gop_size = m_framerate;
+    m_pCodecContext->time_base = av_make_q(1, m_params.fps);
+    m_pCodecContext->gop_size = m_params.fps;
     m_pCodecContext->pix_fmt = AV_PIX_FMT_YUV420P;
-    m_pCodecContext->width = m_frameWidth;
-    m_pCodecContext->height = m_frameHeight;
-    m_pCodecContext->profile = FF_PROFILE_H264_BASELINE;
+    m_pCodecContext->width = m_params.width;
+    m_pCodecContext->height = m_params.height;
+    m_pCodecContext->max_b_frames = 0;
+    m_pCodecContext->thread_count = FFMAX(0, m_params.threads);
+    if (AV_CODEC_ID_H264 == pCodec->id)
+    {
+        m_pCodecContext->profile = FF_PROFILE_H264_BASELINE;
+    }
+
+    // Governor reopens the encoder with another preset, outputs keep the parameter sets of the first keyframe.
+    // x265 and AV1 presets change sequence and picture level flags, so only x264 is governed
+    if ((NULL != m_pGovernor) && (AV_CODEC_ID_H264 != pCodec->id))
+    {
+        ERROR_MESSAGE1(ERR_TYPE_WARNING, "VideoEncoder", "Preset governor is not supported with %s, preset stays fixed", pCodec->name);
+        delete m_pGovernor;
+        m_pGovernor = NULL;
+    }
+
+    // Of the baseline SPS/PPS fields only the reference count differs between x264 presets, fixing it
+    // keeps parameter sets identical across preset switches
+    if (NULL != m_pGovernor)
+    {
+        m_pCodecContext->refs = 1;
+    }
 
     // Open codec
     {
         AVDictionary*   options(0);
 
-        av_dict_set(&options, "preset", "veryfast", 0);
-        av_dict_set(&options, "tune", "zerolatency", 0);
-        av_dict_set_int(&options, "crf", m_crf, 0);
+        SetCodecOptions(pCodec, &options);
 
         if (0 > avcodec_open2(m_pCodecContext, pCodec, &options))
         {
-            ERROR_MESSAGE0(ERR_TYPE_ERROR, "VideoEncoderH264", "Failed to open video codec");
+            ERROR_MESSAGE1(ERR_TYPE_ERROR, "VideoEncoder", "Failed to open %s video codec", pCodec->name);
             av_dict_free(&options);
-            return;
+            avcodec_free_context(&m_pCodecContext);
+            return false;
         }
         av_dict_free(&options);
     }
 
-    m_currentPts = 0;
+    m_gopFrames = 0;
 
-    // Get current codec parameters and send them to subscribers
-    m_pCodecParams = avcodec_parameters_alloc();
-    avcodec_parameters_from_context(m_pCodecParams, m_pCodecContext);
+    // Regions of interest side data is read by libx264 and libx265 only. libx264 skips it without adaptive
+    // quantisation, which ultrafast turns off, and the governor may switch to ultrafast at any GOP
+    if (AV_CODEC_ID_AV1 == pCodec->id)
+    {
+        m_pRegionsIgnoredBy.storeRelease(pCodec->name);
+    }
+    else if ((AV_CODEC_ID_H264 == pCodec->id) && !strcmp(PresetGovernor::PresetName(m_preset), "ultrafast"))
+    {
+        m_pRegionsIgnoredBy.storeRelease("libx264 ultrafast preset (aq-mode 0)");
+    }
+    else
+    {
+        m_pRegionsIgnoredBy.storeRelease(NULL);
+    }
 
-    emit NewParameters(m_pCodecParams);
+    // x265 does not flag its refresh frames as key nor repeat parameter sets on them, so outputs would never
+    // start a new fragment and late joiners would get nothing to decode
+    if (m_params.intraRefresh && (AV_CODEC_ID_H264 != pCodec->id))
+    {
+        ERROR_MESSAGE1(ERR_TYPE_WARNING, "VideoEncoder", "Intra refresh is not supported with %s, regular keyframes are used", pCodec->name);
+    }
 
-    m_isOpen = true;
-    DEBUG_MESSAGE0("VideoEncoderH264", "Video encoder opened successfully");
+    ERROR_MESSAGE6(ERR_TYPE_MESSAGE, "VideoEncoder", "Encoder opened: %s %dx%d, preset %s, %d threads (0 - auto), lookahead %d",
+                   pCodec->name, m_params.width, m_params.height, PresetGovernor::PresetName(m_preset), m_params.threads,
+                   m_params.lookahead);
+    return true;
+}
 
+void VideoEncoder::SwitchPreset(int preset)
+{
+    ERROR_MESSAGE2(ERR_TYPE_MESSAGE, "VideoEncoder", "Governor switches preset %s -> %s",
+                   PresetGovernor::PresetName(m_preset), PresetGovernor::PresetName(preset));
+
+    // x264 can't change preset on the fly. Old encoder is drained, the new one starts with IDR frame
+    // carrying its own SPS/PPS, so decoders just see the next GOP. Pts continue from m_lastPts
+    avcodec_send_frame(m_pCodecContext, NULL);
+    DrainPackets();
+    m_sendTimeUs.clear();
+    avcodec_close(m_pCodecContext);
+    avcodec_free_context(&m_pCodecContext);
+
+    m_preset = preset;
+    if (!OpenCodec())
+    {
+        m_isOpen = false;
+    }
 }
 
-void VideoEncoder::EncodeFrame(AVFrame *pFrame)
+void VideoEncoder::Start()
 {
-    // Encode frame
-    if (m_isOpen)
+    // Codec does not accept frames after end of stream
+    if (m_flushed)
     {
-        int  encodeRes = 0;
-        int  recvRes = 0;
-        AVPacket* pkt = av_packet_alloc();
+        CloseCodecContext();
+        Initialize();
+    }
+
+    if (NULL == m_pThread)
+    {
+        return;
+    }
 
-        // Increment pts
-        pFrame->pts = m_currentPts++;
+    {
+        QMutexLocker lock(&m_queueMutex);
+        m_stop = false;
+    }
+    m_pThread->start();
+}
 
+void VideoEncoder::Stop()
+{
+    if (NULL != m_pThread)
+    {
+        {
+            QMutexLocker lock(&m_queueMutex);
+            m_stop = true;
+            m_queueCondition.wakeAll();
+        }
+        m_pThread->wait();
+
+        // Queued frames may reference canvas buffers, they are released before the canvas goes away
+        QMutexLocker lock(&m_queueMutex);
+        m_queue.clear();
+    }
+}
+
+void VideoEncoder::EncodeFrame(QSharedPointer<AVFrame> pFrame)
+{
+    if (NULL == m_pThread)
+    {
+        Encode(pFrame.data());
+        ReportStatistics(MonotonicTimeUs());
+        return;
+    }
+
+    QMutexLocker lock(&m_queueMutex);
+
+    // Compositor never waits for the encoder: full queue gives up one frame according to the policy
+    if (m_queue.size() >= m_params.queueDepth)
+    {
+        if (ENCODER_QUEUE_REPEAT == m_params.queuePolicy)
+        {
+            m_framesRepeated++;
+            m_queueDepthStat.Add(m_queue.size());
+            return;
+        }
+        m_queue.remove(0);
+        m_framesDropped++;
+    }
+
+    m_queue.append(pFrame);
+    m_queueDepthStat.Add(m_queue.size());
+    m_queueCondition.wakeOne();
+}
+
+void VideoEncoder::SkipFrame()
+{
+    m_framesSkipped.ref();
+}
+
+void VideoEncoder::EncodeLoop()
+{
+    ERROR_MESSAGE2(ERR_TYPE_MESSAGE, "VideoEncoder", "Encoder thread started, queue depth %d, %s when full",
+                   m_params.queueDepth, (ENCODER_QUEUE_REPEAT == m_params.queuePolicy) ? "repeat previous frame" : "drop oldest frame");
+
+    while (true)
+    {
+        QSharedPointer<AVFrame> pFrame;
+
+        {
+            QMutexLocker lock(&m_queueMutex);
+
+            while (m_queue.isEmpty() && !m_stop)
+            {
+                m_queueCondition.wait(&m_queueMutex);
+            }
+            if (m_stop)
+            {
+                break;
+            }
+            pFrame = m_queue.takeFirst();
+        }
+
+        Encode(pFrame.data());
+
+        // Frame is released here, so canvas buffer or pooled copy can be reused right away
+        pFrame.clear();
+        ReportStatistics(MonotonicTimeUs());
+    }
+
+    // Flushed packets are emitted from this thread, so they queue up behind the ones emitted before
+    SendEndOfStream();
+
+    ERROR_MESSAGE0(ERR_TYPE_MESSAGE, "VideoEncoder", "Encoder thread stopped");
+}
+
+void VideoEncoder::Encode(AVFrame *pFrame)
+{
+    if (!m_isOpen || m_flushed)
+    {
+        ERROR_MESSAGE0(ERR_TYPE_ERROR, "VideoEncoder", "Video encoder has not been initialized properly");
+        return;
+    }
+
+    // Pts is the output tick, frames dropped upstream leave gaps instead of slowing the stream down
+    if ((AV_NOPTS_VALUE == pFrame->pts) || ((AV_NOPTS_VALUE != m_lastPts) && (pFrame->pts <= m_lastPts)))
+    {
+        pFrame->pts = (AV_NOPTS_VALUE == m_lastPts) ? 0 : m_lastPts + 1;
+    }
+    m_lastPts = pFrame->pts;
+
+    // Preset only changes between GOPs
+    if ((NULL != m_pGovernor) && (m_gopFrames >= m_pCodecContext->gop_size))
+    {
+        m_gopFrames = 0;
+        if (m_pGovernor->EndGop())
+        {
+            SwitchPreset(m_pGovernor->Preset());
+            if (!m_isOpen)
+            {
+                return;
+            }
+        }
+    }
+
+    int64_t startUs = MonotonicTimeUs();
+    int     encodeRes = avcodec_send_frame(m_pCodecContext, pFrame);
+
+    // Encoder input is full until its pending packets are taken out
+    if (AVERROR(EAGAIN) == encodeRes)
+    {
+        DrainPackets();
         encodeRes = avcodec_send_frame(m_pCodecContext, pFrame);
-        recvRes = avcodec_receive_packet(m_pCodecContext, pkt); // Generates ref-counted packet
+    }
 
-        if (!encodeRes && !recvRes)
+    if (0 > encodeRes)
+    {
+        char    err[255] = {0};
+        av_make_error_string(err, 255, encodeRes);
+        ERROR_MESSAGE1(ERR_TYPE_ERROR, "VideoEncoder", "Error encoding video frame avcodec_send_frame(): %s", err);
+    }
+    else
+    {
+        m_sendTimeUs.insert(pFrame->pts, startUs);
+        m_gopFrames++;
+    }
+
+    // Frame threading and lookahead hold frames back, so one frame in may give zero or several packets out
+    DrainPackets();
+
+    int64_t encodeUs = MonotonicTimeUs() - startUs;
+    m_encodeTimeStat.Add(encodeUs);
+    if (NULL != m_pGovernor)
+    {
+        m_pGovernor->AddFrame(encodeUs);
+    }
+}
+
+void VideoEncoder::DrainPackets()
+{
+    while (true)
+    {
+        AVPacket* pkt = av_packet_alloc();
+        int       recvRes = avcodec_receive_packet(m_pCodecContext, pkt); // Generates ref-counted packet
+
+        if (0 > recvRes)
+        {
+            av_packet_free(&pkt);
+            if ((AVERROR(EAGAIN) != recvRes) && (AVERROR_EOF != recvRes))
+            {
+                char    err[255] = {0};
+                av_make_error_string(err, 255, recvRes);
+                ERROR_MESSAGE1(ERR_TYPE_ERROR, "VideoEncoder", "Error encoding video frame avcodec_receive_packet(): %s", err);
+            }
+            return;
+        }
+
+        if (m_sendTimeUs.contains(pkt->pts))
+        {
+            m_latencyStat.Add(MonotonicTimeUs() - m_sendTimeUs.take(pkt->pts));
+        }
+        m_packets++;
+        m_bytes += pkt->size;
+        m_packetSizeStat.Add(pkt->size);
+        if (!(pkt->flags & AV_PKT_FLAG_KEY))
         {
-            // Packet duration is always 1 in 1/fps timebase
-            pkt->duration = 1;
-            av_packet_rescale_ts(pkt, m_pCodecContext->time_base, AV_TIME_BASE_Q);
-            DEBUG_MESSAGE0("VideoEncoder", "PacketReady() emitted. packet");
-            emit PacketReady(QSharedPointer<AVPacket>(pkt, [](AVPacket *p){av_packet_free(&p);}));
+            m_deltaPackets++;
+            m_deltaBytes += pkt->size;
         }
         else
         {
-            char    err1[255] = {0};
-            char    err2[255] = {0};
-            av_make_error_string(err1, 255, encodeRes);
-            av_make_error_string(err2, 255, recvRes);
-            ERROR_MESSAGE2(ERR_TYPE_ERROR, "VideoEncoder", "Error encoding video frame   " \
-                           "avcodec_send_frame(): %s\tavcodec_receive_packet(): %s", err1, err2);
-            return;
+            m_keyPackets++;
         }
+
+        // Packet duration is always 1 in 1/fps timebase
+        pkt->duration = 1;
+        av_packet_rescale_ts(pkt, m_pCodecContext->time_base, AV_TIME_BASE_Q);
+        DEBUG_MESSAGE0("VideoEncoder", "PacketReady() emitted. packet");
+        emit PacketReady(QSharedPointer<AVPacket>(pkt, [](AVPacket *p){av_packet_free(&p);}));
+    }
+}
+
+void VideoEncoder::Flush()
+{
+    // Encoder thread flushes on its own when it stops
+    if (NULL == m_pThread)
+    {
+        SendEndOfStream();
+    }
+}
+
+void VideoEncoder::SendEndOfStream()
+{
+    if (!m_isOpen || m_flushed)
+    {
+        return;
+    }
+
+    // Frames held back by the encoder are written out instead of being lost with the codec context
+    int64_t packets = m_packets;
+    int     res = avcodec_send_frame(m_pCodecContext, NULL);
+
+    if (0 > res)
+    {
+        char    err[255] = {0};
+        av_make_error_string(err, 255, res);
+        ERROR_MESSAGE1(ERR_TYPE_ERROR, "VideoEncoder", "Failed to flush encoder: %s", err);
     }
     else
     {
-        ERROR_MESSAGE0(ERR_TYPE_ERROR, "VideoEncoder", "Video encoder has not been initialized properly");
+        DrainPackets();
     }
+
+    m_flushed = true;
+    m_sendTimeUs.clear();
+    ERROR_MESSAGE1(ERR_TYPE_MESSAGE, "VideoEncoder", "Encoder flushed, %lld delayed packets written", (long long)(m_packets - packets));
 }
 
+void VideoEncoder::ReportStatistics(int64_t nowUs)
+{
+    if (nowUs - m_statsStartUs < STATS_INTERVAL_MSEC * 1000)
+    {
+        return;
+    }
+
+    // Throughput is what one encoder thread could sustain, latency includes frames held back by threading and lookahead
+    ERROR_MESSAGE6(ERR_TYPE_MESSAGE, "VideoEncoder", "Encoder stats: %lld frames, %lld packets, encode time avg %.2f ms max %.2f ms (%.1f fps), latency avg %.2f ms",
+                   (long long)m_encodeTimeStat.Count(),
+                   (long long)m_packets,
+                   m_encodeTimeStat.Average() / 1000.0,
+                   m_encodeTimeStat.Max() / 1000.0,
+                   m_encodeTimeStat.Sum() ? m_encodeTimeStat.Count() * 1000000.0 / m_encodeTimeStat.Sum() : 0.0,
+                   m_latencyStat.Average() / 1000.0);
+
+    // Skipped frames are valued at average encode time and delta frame size, an upper bound as static frames encode cheaper
+    int     skipped = m_framesSkipped.fetchAndStoreRelaxed(0);
+    double  intervalSec = (nowUs - m_statsStartUs) / 1000000.0;
+
+    ERROR_MESSAGE3(ERR_TYPE_MESSAGE, "VideoEncoder", "Encoder stats: %s output %.1f kbit/s, delta frame avg %.1f KB",
+                   m_pCodecContext ? m_pCodecContext->codec->name : "none",
+                   m_bytes * 8 / 1000.0 / intervalSec,
+                   m_deltaPackets ? m_deltaBytes / 1024.0 / m_deltaPackets : 0.0);
+    // Keyframe spikes show up as peak to average ratio, intra refresh should keep it close to the delta frames
+    ERROR_MESSAGE4(ERR_TYPE_MESSAGE, "VideoEncoder", "Encoder stats: packet size avg %.1f KB max %.1f KB, peak to average %.1f, %lld keyframes",
+                   m_packetSizeStat.Average() / 1024.0,
+                   m_packetSizeStat.Max() / 1024.0,
+                   (m_packetSizeStat.Average() > 0) ? m_packetSizeStat.Max() / m_packetSizeStat.Average() : 0.0,
+                   (long long)m_keyPackets);
+    if (skipped > 0)
+    {
+        ERROR_MESSAGE4(ERR_TYPE_MESSAGE, "VideoEncoder", "Encoder stats: %d unchanged frames skipped, saved up to %.1f ms CPU per second and %.1f kbit/s (%.1f%% of frames)",
+                       skipped,
+                       skipped * m_encodeTimeStat.Average() / 1000.0 / intervalSec,
+                       m_deltaPackets ? skipped * ((double)m_deltaBytes / m_deltaPackets) * 8 / 1000.0 / intervalSec : 0.0,
+                       skipped * 100.0 / (skipped + m_encodeTimeStat.Count()));
+    }
+
+    m_encodeTimeStat.Reset();
+    m_latencyStat.Reset();
+    m_packets = 0;
+    m_bytes = 0;
+    m_deltaPackets = 0;
+    m_deltaBytes = 0;
+    m_keyPackets = 0;
+    m_packetSizeStat.Reset();
+
+    if (NULL != m_pGovernor)
+    {
+        int64_t histogram[GOVERNOR_HISTOGRAM_BUCKETS];
+        int     stepsFaster;
+        int     stepsSlower;
+
+        m_pGovernor->TakeCounters(histogram, &stepsFaster, &stepsSlower);
+        ERROR_MESSAGE3(ERR_TYPE_MESSAGE, "VideoEncoder", "Encoder governor: preset %s, %d steps to faster preset, %d to slower",
+                       PresetGovernor::PresetName(m_preset), stepsFaster, stepsSlower);
+        ERROR_MESSAGE6(ERR_TYPE_MESSAGE, "VideoEncoder", "Encoder governor: frames by encode time / budget <25%% %lld, <50%% %lld, <75%% %lld, <100%% %lld, <150%% %lld, more %lld",
+                       (long long)histogram[0], (long long)histogram[1], (long long)histogram[2],
+                       (long long)histogram[3], (long long)histogram[4], (long long)histogram[5]);
+    }
+
+    if (NULL != m_pThread)
+    {
+        QMutexLocker lock(&m_queueMutex);
+
+        ERROR_MESSAGE5(ERR_TYPE_MESSAGE, "VideoEncoder", "Encoder queue: depth avg %.2f max %lld of %d, %lld frames dropped, %lld repeated",
+                       m_queueDepthStat.Average(),
+                       (long long)m_queueDepthStat.Max(),
+                       m_params.queueDepth,
+                       (long long)m_framesDropped,
+                       (long long)m_framesRepeated);
+        m_queueDepthStat.Reset();
+        m_framesDropped = 0;
+        m_framesRepeated = 0;
+    }
+    m_statsStartUs = nowUs;
+}
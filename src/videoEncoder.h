@@ -1,38 +1,135 @@
 #ifndef VIDEOENCODER_H
 #define VIDEOENCODER_H
 
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QMap>
 #include <QObject>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
 #include "videoScaler.h"
+#include "statistics.h"
+#include "presetGovernor.h"
+
+enum EncoderQueuePolicy
+{
+    ENCODER_QUEUE_DROP_OLDEST,  // Full queue drops its oldest frame, output skips ahead to the newest picture
+    ENCODER_QUEUE_REPEAT        // Full queue rejects the new frame, output keeps showing the previous picture
+};
+
+enum EncoderCodec
+{
+    ENCODER_CODEC_H264,     // libx264, baseline profile
+    ENCODER_CODEC_HEVC,     // libx265
+    ENCODER_CODEC_AV1       // libsvtav1 or libaom-av1, whichever is available
+};
+
+struct EncoderParameters
+{
+    int  width;
+    int  height;
+    int  fps;
+    int  crf;               /// x264 crf scale, mapped onto the quantiser range of other codecs
+    EncoderCodec codec;
+    int  queueDepth;        /// Frames waiting for encoder thread. 0 - encode on caller thread
+    EncoderQueuePolicy queuePolicy;
+    int  threads;           /// Encoder threads. 0 - one per cpu core
+    bool slicedThreads;     /// x264 only. Slice threading keeps latency at one frame, frame threading delays output by thread count frames
+    int  lookahead;         /// Rate control lookahead in frames, delays output by as many frames. -1 - low latency default (none)
+    int  preset;            /// Index in PresetGovernor ladder, starting preset if governor is on
+    int  slowestPreset;     /// Governor never goes slower than this one
+    bool adaptivePreset;    /// Governor steps preset up and down by measured encode time. x264 only, reference count is fixed to 1
+    bool intraRefresh;      /// Intra refresh column sweeps across each GOP instead of IDR frames. x264 only
+};
 
 class VideoEncoder : public QObject
 {
     Q_OBJECT
 public:
-    VideoEncoder(int width, int height, int fps, int crf);
+    /// Zero queue depth encodes on the caller thread, otherwise frames are handed off to encoder thread through bounded queue
+    VideoEncoder(const EncoderParameters& parameters);
     ~VideoEncoder();
 
     void Initialize();
+    void Start();   /// Starts encoder thread. Encoder flushed by Stop() is reopened
+    void Stop();    /// Stops encoder thread, frames still queued are discarded and delayed packets are flushed by the thread
+    void Flush();   /// Sends end of stream and emits delayed packets. Synchronous mode only, call from the thread feeding frames
+
+
+    int  QueueDepth() const { return m_params.queueDepth; }
+    const char* RegionsIgnoredBy() const { return m_pRegionsIgnoredBy.loadAcquire(); }   /// Codec or preset dropping regions of interest, NULL if they are honoured. Thread-safe
 
 signals:
     void    PacketReady(QSharedPointer<AVPacket> pPacket);  // This packet should be unrefed inside VideoEncoder
     void    NewParameters(AVCodecParameters* pParams);
 
 public slots:
-    void    EncodeFrame(AVFrame* pFrame);
+    /// Frame pts is the output tick index. Frame must not be written until the last reference is dropped
+    void    EncodeFrame(QSharedPointer<AVFrame> pFrame);
+    void    SkipFrame();    /// Builder had nothing new in this tick. Only counted, so statistics can show what was saved
 
 protected:
-    int                 m_crf;              /// Crf of output stream
-    int                 m_framerate;        /// Framerate (for timebase calculation)
-    int                 m_frameWidth;
-    int                 m_frameHeight;
-    uint64_t            m_currentPts;
+    EncoderParameters   m_params;
+    int64_t             m_lastPts;          /// Pts of the last encoded frame, pts must grow strictly
+    int                 m_preset;           /// Preset the codec is open with
+    int                 m_gopFrames;        /// Frames sent to the codec in current GOP
+    PresetGovernor*     m_pGovernor;        /// NULL if preset is fixed
+    QAtomicPointer<const char> m_pRegionsIgnoredBy; /// Static string, changes when codec is reopened
 
     bool                m_isOpen;
+    bool                m_flushed;          /// End of stream was sent, codec must be reopened to encode again
 
     AVCodecContext*     m_pCodecContext;
     AVCodecParameters*  m_pCodecParams;
 
     void                CloseCodecContext();
+    bool                OpenCodec();
+    const AVCodec*      FindEncoder();
+    void                SetCodecOptions(const AVCodec* pCodec, AVDictionary** ppOptions);
+    void                SwitchPreset(int preset);
+
+private:
+    class EncoderThread : public QThread
+    {
+    public:
+        EncoderThread(VideoEncoder* pEncoder) : QThread(NULL), m_pEncoder(pEncoder) {}
+
+    protected:
+        void run() { m_pEncoder->EncodeLoop(); }
+
+    private:
+        VideoEncoder*   m_pEncoder;
+    };
+
+    EncoderThread*      m_pThread;          /// NULL in synchronous mode
+    QMutex              m_queueMutex;
+    QWaitCondition      m_queueCondition;   /// Frame queued or stop
+    QVector<QSharedPointer<AVFrame> > m_queue;  /// Guarded by m_queueMutex
+    bool                m_stop;             /// Guarded by m_queueMutex
+
+    // Statistics
+    int64_t             m_statsStartUs;     /// Encoding thread
+    RunningStat         m_encodeTimeStat;   /// Encoding thread. Send and receive time per frame, us
+    RunningStat         m_latencyStat;      /// Encoding thread. Time from frame sent to its packet received, us
+    QMap<int64_t, int64_t> m_sendTimeUs;    /// Encoding thread. Send time of frames still inside the encoder, keyed on pts
+    int64_t             m_packets;          /// Encoding thread
+    int64_t             m_bytes;            /// Encoding thread. Size of all packets
+    int64_t             m_deltaPackets;     /// Encoding thread. Non-key packets
+    int64_t             m_deltaBytes;       /// Encoding thread
+    int64_t             m_keyPackets;       /// Encoding thread. IDR or recovery point packets
+    RunningStat         m_packetSizeStat;   /// Encoding thread. Bytes
+    QAtomicInt          m_framesSkipped;    /// Ticks builder did not encode
+    RunningStat         m_queueDepthStat;   /// Guarded by m_queueMutex. Queue depth after each hand-off
+    int64_t             m_framesDropped;    /// Guarded by m_queueMutex
+    int64_t             m_framesRepeated;   /// Guarded by m_queueMutex
+
+    void                EncodeLoop();
+    void                Encode(AVFrame* pFrame);
+    void                DrainPackets();     /// Emits every packet encoder has ready
+    void                SendEndOfStream();
+    void                ReportStatistics(int64_t nowUs);
 };
 
 #endif // VIDEOENCODER_H
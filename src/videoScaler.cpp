@@ -1,50 +1,194 @@
 
 #include "videoScaler.h"
+#include "boxScaler.h"
 
-VideoScaler::VideoScaler()
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+VideoScaler::VideoScaler(int flags)
 {
-    m_pSwsContext = NULL;
-    m_dstWidth = 0;
-    m_dstHeight = 0;
+    memset(m_cache, 0, sizeof(m_cache));
+    m_useCounter = 0;
+    m_flags = flags;
+    m_lastFailedFormat = AV_PIX_FMT_NONE;
 }
 
 VideoScaler::~VideoScaler()
 {
-    if(m_pSwsContext != NULL)
+    for (int i = 0; i < SCALER_CACHE_SIZE; i++)
     {
-        sws_freeContext(m_pSwsContext);
+        if (m_cache[i].pSwsContext != NULL)
+        {
+            sws_freeContext(m_cache[i].pSwsContext);
+        }
     }
 }
 
-void VideoScaler::scaleFrame(AVFrame *pInFrame, AVFrame *pOutFrame)
+bool VideoScaler::ScalerKey::operator==(const ScalerKey& other) const
+{
+    return (srcWidth == other.srcWidth) && (srcHeight == other.srcHeight) &&
+           (srcFormat == other.srcFormat) && (srcFullRange == other.srcFullRange) &&
+           (dstWidth == other.dstWidth) && (dstHeight == other.dstHeight) &&
+           (dstFormat == other.dstFormat) && (dstFullRange == other.dstFullRange) &&
+           (flags == other.flags);
+}
+
+bool VideoScaler::scaleFrame(AVFrame *pInFrame, AVFrame *pOutFrame)
 {
-    if ((m_dstWidth != pOutFrame->width) || (m_dstHeight != pOutFrame->height))
+    ScalerKey   key;
+
+    key.srcWidth = pInFrame->width;
+    key.srcHeight = pInFrame->height;
+    key.srcFormat = normalizeFormat(pInFrame->format, pInFrame->color_range, &key.srcFullRange);
+    key.dstWidth = pOutFrame->width;
+    key.dstHeight = pOutFrame->height;
+    key.dstFormat = normalizeFormat(pOutFrame->format, pOutFrame->color_range, &key.dstFullRange);
+    key.flags = m_flags;
+
+    // Integer ratio downscale is done by box filter, which is much cheaper than swscale
+    if (key.srcFullRange == key.dstFullRange)
     {
-        // Reallocate scale context
-        if (m_pSwsContext != NULL)
+        int ratio = BoxScaleRatio(pInFrame, pOutFrame);
+        if (ratio > 0)
         {
-            sws_freeContext(m_pSwsContext);
+            BoxScaleFrame(pInFrame, pOutFrame, ratio);
+            return true;
         }
+    }
 
-        m_pSwsContext = sws_getContext(pInFrame->width,
-                                       pInFrame->height,
-                                       AV_PIX_FMT_YUV420P,
-                                       pOutFrame->width,
-                                       pOutFrame->height,
-                                       AV_PIX_FMT_YUV420P,
-                                       SWS_FAST_BILINEAR, NULL, NULL, NULL);
-
-        m_dstWidth = pOutFrame->width;
-        m_dstHeight = pOutFrame->height;
+    SwsContext* pSwsContext = GetContext(key);
+    if (NULL == pSwsContext)
+    {
+        return false;
     }
 
-    // Scale current frame
-    sws_scale(m_pSwsContext,
+    // Colour conversion and scaling in one pass
+    sws_scale(pSwsContext,
               pInFrame->data,
               pInFrame->linesize,
               0,
               pInFrame->height,
               pOutFrame->data,
               pOutFrame->linesize);
+
+    return true;
+}
+
+SwsContext* VideoScaler::GetContext(const ScalerKey& key)
+{
+    CacheEntry* pVictim = &m_cache[0];
+
+    m_useCounter++;
+    for (int i = 0; i < SCALER_CACHE_SIZE; i++)
+    {
+        CacheEntry& entry = m_cache[i];
+
+        if ((entry.pSwsContext != NULL) && (entry.key == key))
+        {
+            entry.lastUsed = m_useCounter;
+            return entry.pSwsContext;
+        }
+
+        // Empty entries have lastUsed 0 and are taken first
+        if (entry.lastUsed < pVictim->lastUsed)
+        {
+            pVictim = &entry;
+        }
+    }
+
+    if (!sws_isSupportedInput((AVPixelFormat)key.srcFormat))
+    {
+        if (m_lastFailedFormat != key.srcFormat)
+        {
+            ERROR_MESSAGE1(ERR_TYPE_DISPOSABLE, "VideoScaler", "Unsupported source pixel format %s",
+                           av_get_pix_fmt_name((AVPixelFormat)key.srcFormat));
+            m_lastFailedFormat = key.srcFormat;
+        }
+        return NULL;
+    }
+
+    SwsContext* pSwsContext = sws_getContext(key.srcWidth,
+                                             key.srcHeight,
+                                             (AVPixelFormat)key.srcFormat,
+                                             key.dstWidth,
+                                             key.dstHeight,
+                                             (AVPixelFormat)key.dstFormat,
+                                             key.flags, NULL, NULL, NULL);
+    if (NULL == pSwsContext)
+    {
+        ERROR_MESSAGE5(ERR_TYPE_DISPOSABLE, "VideoScaler", "Failed to create %dx%d %s -> %dx%d scaler",
+                       key.srcWidth, key.srcHeight, av_get_pix_fmt_name((AVPixelFormat)key.srcFormat),
+                       key.dstWidth, key.dstHeight);
+        return NULL;
+    }
+
+    // Range is not known from normalized formats, so it is set explicitly
+    const int* pCoefficients = sws_getCoefficients(SWS_CS_DEFAULT);
+    sws_setColorspaceDetails(pSwsContext,
+                             pCoefficients, key.srcFullRange ? 1 : 0,
+                             pCoefficients, key.dstFullRange ? 1 : 0,
+                             0, 1 << 16, 1 << 16);
+
+    ERROR_MESSAGE6(ERR_TYPE_MESSAGE, "VideoScaler", "New scaler %dx%d %s%s -> %dx%d",
+                   key.srcWidth, key.srcHeight,
+                   av_get_pix_fmt_name((AVPixelFormat)key.srcFormat), key.srcFullRange ? " full range" : "",
+                   key.dstWidth, key.dstHeight);
+
+    if (pVictim->pSwsContext != NULL)
+    {
+        sws_freeContext(pVictim->pSwsContext);
+    }
+
+    pVictim->key = key;
+    pVictim->pSwsContext = pSwsContext;
+    pVictim->lastUsed = m_useCounter;
+
+    return pSwsContext;
 }
 
+AVPixelFormat VideoScaler::normalizeFormat(int format, int colorRange, bool* pFullRange)
+{
+    *pFullRange = (colorRange == AVCOL_RANGE_JPEG);
+
+    switch (format)
+    {
+    case AV_PIX_FMT_YUVJ420P:
+        *pFullRange = true;
+        return AV_PIX_FMT_YUV420P;
+    case AV_PIX_FMT_YUVJ422P:
+        *pFullRange = true;
+        return AV_PIX_FMT_YUV422P;
+    case AV_PIX_FMT_YUVJ444P:
+        *pFullRange = true;
+        return AV_PIX_FMT_YUV444P;
+    case AV_PIX_FMT_YUVJ440P:
+        *pFullRange = true;
+        return AV_PIX_FMT_YUV440P;
+    case AV_PIX_FMT_YUVJ411P:
+        *pFullRange = true;
+        return AV_PIX_FMT_YUV411P;
+    default:
+        break;
+    }
+
+    // RGB is always full range
+    const AVPixFmtDescriptor* pDescriptor = av_pix_fmt_desc_get((AVPixelFormat)format);
+    if ((NULL != pDescriptor) && (pDescriptor->flags & AV_PIX_FMT_FLAG_RGB))
+    {
+        *pFullRange = true;
+    }
+
+    return (AVPixelFormat)format;
+}
+
+void VideoScaler::fitSize(int srcWidth, int srcHeight, int boxWidth, int boxHeight, int* pWidth, int* pHeight)
+{
+    double scale = std::min((double)boxWidth / (double)srcWidth,
+                            (double)boxHeight/ (double)srcHeight);
+
+    *pWidth = (int)(srcWidth * scale + 0.5f)  & 0xFFFFFFFC; // width and height are better when even
+    *pHeight = (int)(srcHeight * scale + 0.5f) & 0xFFFFFFFC;
+}
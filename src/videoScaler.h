@@ -3,24 +3,60 @@
 
 #include "common.h"
 
+#define SCALER_CACHE_SIZE   4   // Contexts kept per scaler (resolution switches, several targets)
+
 /*
  * Class for convenient scaling video frames
  * Performs on-the-fly sws_context allocaltion
  * Can be initialized with no parameters
+ *
+ * Contexts are cached by full source/destination geometry, format and range,
+ * so colour conversion and scaling are always done by a single sws_scale pass
 */
 
 class VideoScaler
 {
 public:
-    VideoScaler();
+    VideoScaler(int flags = SWS_FAST_BILINEAR);
     ~VideoScaler();
 
-    void  scaleFrame(AVFrame* pInFrame, AVFrame *pOutFrame);
+    bool  scaleFrame(AVFrame* pInFrame, AVFrame *pOutFrame);
+
+    // Size of the frame fitted into target box with aspect ratio kept (multiple of 4)
+    static void fitSize(int srcWidth, int srcHeight, int boxWidth, int boxHeight, int* pWidth, int* pHeight);
+
+    // Deprecated YUVJ formats are replaced by plain YUV ones with full range flag
+    static AVPixelFormat normalizeFormat(int format, int colorRange, bool* pFullRange);
 
 private:
-    SwsContext*         m_pSwsContext;      /// Scaling context
-    int                 m_dstWidth;         /// Last width
-    int                 m_dstHeight;        /// Last height
+    struct ScalerKey
+    {
+        int     srcWidth;
+        int     srcHeight;
+        int     srcFormat;
+        bool    srcFullRange;
+        int     dstWidth;
+        int     dstHeight;
+        int     dstFormat;
+        bool    dstFullRange;
+        int     flags;
+
+        bool operator==(const ScalerKey& other) const;
+    };
+
+    struct CacheEntry
+    {
+        ScalerKey   key;
+        SwsContext* pSwsContext;
+        uint64_t    lastUsed;
+    };
+
+    SwsContext* GetContext(const ScalerKey& key);
+
+    CacheEntry          m_cache[SCALER_CACHE_SIZE]; /// Scaling contexts, least recently used is replaced
+    uint64_t            m_useCounter;               /// Cache access clock
+    int                 m_flags;                    /// Scaling algorithm
+    int                 m_lastFailedFormat;         /// To report unsupported format once
 };
 
 #endif // VIDEOSCALER_H